@@ -46,6 +46,10 @@
 
 #define DQR_MAXCORES	16
 
+// trace file name for a Trace object that is given its trace bytes by Trace::pushTraceData()
+
+#define DQR_PUSHED_TRACE	"<pushed>"
+
 extern int globalDebugFlag;
 extern const char * const DQR_VERSION;
 
@@ -142,6 +146,7 @@ public:
   	DQERR_BM   = 4,		// bad message (mallformed)
   	DQERR_ERR  = 5,		// general error
   	DQERR_DONE = 6,		// done with trace message
+  	DQERR_WOULDBLOCK = 7,	// no more trace data yet (live trace); wait and try again
   } DQErr;
 
   typedef enum {
@@ -386,7 +391,10 @@ public:
 	};
 };
 
-// class Instruction: work with an instruction
+// class Instruction: work with an instruction. instructionText, addressLabel and operandLabel point
+// into the decoder's caches, as do the file, function and line pointers of class Source. They are not
+// copied, so they are only valid while the Trace, ObjFile or Simulator that filled them in exists and
+// until its setLabelMode() replaces the disassembler. Copy the strings to keep them longer
 
 #ifdef SWIG
 	%ignore Instruction::addressToText(char *dst,size_t len,int labelLevel);
@@ -405,9 +413,9 @@ public:
 	void instructionToText(char *dst,size_t len,int labelLevel);
 	std::string instructionToString(int labelLevel);
 
-	static int        addrSize;
-	static uint32_t   addrDispFlags;
-	static int        addrPrintWidth;
+	int               addrSize = 0;
+	uint32_t          addrDispFlags = 0;
+	int               addrPrintWidth = 0;
 
 	uint8_t           coreId;
 
@@ -417,7 +425,10 @@ public:
 	TraceDqr::ADDRESS address;
 	int               instSize;
 	TraceDqr::RV_INST instruction;
-	char              instructionText[64];
+#ifdef SWIG
+	%immutable		instructionText;
+#endif // SWIG
+	const char       *instructionText;	// owned by the decoder; see above
 #ifdef SWIG
 	%immutable		addressLabel;
 #endif // SWIG
@@ -478,6 +489,21 @@ private:
 	const char *stripPath(const char *path);
 };
 
+// class InstructionBlock: range of addresses executed in order, returned by Trace::NextBlock(). The
+// block ends with a change of flow, or with the instruction before a gap in the addresses. CRFlag and
+// brFlags are those of the last instruction. timestamp is the time of the first instruction
+
+class InstructionBlock {
+public:
+	uint8_t             coreId;
+	TraceDqr::ADDRESS   startAddress;
+	TraceDqr::ADDRESS   endAddress;		// address after the last instruction in the block
+	int                 numInstructions;
+	int                 CRFlag;
+	int                 brFlags;
+	TraceDqr::TIMESTAMP timestamp;
+};
+
 // class NexusMessage: class to hold Nexus messages and convert them to text
 
 #ifdef SWIG
@@ -585,7 +611,7 @@ public:
     	} ictWS;
     };
 
-    uint32_t offset;
+    uint64_t offset;
     uint8_t  rawData[32];
 
     int getI_Cnt();
@@ -621,8 +647,12 @@ public:
 
 	TraceDqr::DQErr updateTraceInfo(NexusMessage &nm,uint32_t bits,uint32_t meso_bits,uint32_t ts_bits,uint32_t addr_bits);
 	TraceDqr::DQErr updateInstructionInfo(uint32_t core_id,uint32_t inst,int instSize,int crFlags,TraceDqr::BranchFlags brFlags);
+	TraceDqr::DQErr updateBlockInfo(uint32_t core_id,int numInst16,int numInst32);
+	TraceDqr::DQErr updateBranchInfo(uint32_t core_id,int numTaken,int numNotTaken);
 	int currentTraceMsgNum() { return num_trace_msgs_all_cores; }
+	void setCurrentTraceMsgNum(int msgNum) { num_trace_msgs_all_cores = msgNum; }
 	void setSrcBits(int sbits) { srcBits = sbits; }
+	void setParseOnly(bool po) { parseOnly = po; }
 	void toText(char *dst,int dst_len,int detailLevel);
 	std::string toString(int detailLevel);
 
@@ -635,6 +665,7 @@ private:
 	uint32_t cores;
 
 	int srcBits;
+	bool parseOnly;		// messages were parsed but instructions not followed, so there are no instruction counts
 
 	uint32_t num_trace_msgs_all_cores;
 	uint32_t num_trace_mseo_bits_all_cores;
@@ -826,6 +857,75 @@ private:
 	class Disassembler    *disassembler;
 };
 
+// class TraceIndex: index of the synchronizing messages in a trace file, so a large trace can be entered
+// at any sync point without decoding from the start. Built in memory, or saved as a sidecar file that is a
+// TraceIndexHeader followed by TraceIndexHeader::numEntries TraceIndexEntry records, in trace file order,
+// in host byte order. The sidecar file is memory mapped when opened
+
+#define DQR_INDEX_MAGIC		"DQRINDEX"
+#define DQR_INDEX_VERSION	2
+
+struct TraceIndexHeader {
+	char     magic[8];		// DQR_INDEX_MAGIC, not nul terminated
+	uint32_t version;		// DQR_INDEX_VERSION
+	uint32_t entrySize;		// sizeof(TraceIndexEntry)
+	uint32_t srcBits;
+	uint32_t tsSize;
+	uint64_t traceSize;		// number of bytes of trace data indexed
+	uint64_t numMsgs;		// number of trace messages in the trace file
+	uint64_t numEntries;
+};
+
+struct TraceIndexEntry {
+	uint64_t offset;		// trace file offset of the first byte of the message
+	uint64_t faddr;			// full address from the message
+	uint64_t timestamp;		// full timestamp rebuilt from the messages before it, 0 if none
+	uint64_t maxTimestamp;	// largest full timestamp of any core up to this message, never decreases
+	uint64_t coreTime[DQR_MAXCORES];	// time base of every core at this message, 0 if unknown
+	uint32_t msgNum;		// message number in the trace file, same as NexusMessage::msgNum
+	uint8_t  core;
+	uint8_t  tcode;
+	uint8_t  reserved[2];
+};
+
+#ifdef SWIG
+	%ignore TraceIndex::getEntry(int64_t index);
+#endif // SWIG
+
+class TraceIndex {
+public:
+	TraceIndex();
+	~TraceIndex();
+	void cleanUp();
+
+	enum Key {
+		KEY_OFFSET,
+		KEY_MSGNUM,
+		KEY_TIMESTAMP,
+	};
+
+	TraceDqr::DQErr build(char *tf_name,int srcBits,int tsSize);
+	TraceDqr::DQErr save(char *idx_name);
+	TraceDqr::DQErr open(char *idx_name);
+
+	TraceDqr::DQErr getStatus() { return status; }
+	int64_t getNumEntries() { return (header != nullptr) ? (int64_t)header->numEntries : 0; }
+	const TraceIndexEntry *getEntry(int64_t index);
+	int64_t findEntry(Key key,uint64_t value);
+	int64_t getTraceSize() { return (header != nullptr) ? (int64_t)header->traceSize : 0; }
+	int64_t getNumMsgs() { return (header != nullptr) ? (int64_t)header->numMsgs : 0; }
+	int getSrcBits() { return (header != nullptr) ? (int)header->srcBits : 0; }
+	int getTSSize() { return (header != nullptr) ? (int)header->tsSize : 0; }
+
+private:
+	TraceDqr::DQErr         status;
+	uint8_t                *idxData;
+	int64_t                 idxSize;
+	bool                    mapped;
+	const TraceIndexHeader *header;
+	const TraceIndexEntry  *entries;
+};
+
 // class Trace: high level class that performs the raw trace data to dissasemble and decorated instruction trace
 
 #ifdef SWIG
@@ -835,8 +935,18 @@ private:
 	%ignore Trace::analyticsToText(char *dst,int dst_len,int detailLevel);
 	%ignore Trace::getITCPrintStr(int core,bool &haveData,TraceDqr::TIMESTAMP &startTime,TraceDqr::TIMESTAMP &endtime);
 	%ignore Trace::flushITCPrintStr(int core,bool &haveData,TraceDqr::TIMESTAMP &startTime,TraceDqr::TIMESTAMP &endtime);
+	%ignore Trace::NextMessage(NexusMessage **msgInfo);
+	%ignore Trace::NextRawMessage(NexusMessage **msgInfo);
+	%ignore Trace::saveCheckpoint(uint8_t *&data,int64_t &size);
+	%ignore Trace::restoreCheckpoint(const uint8_t *data,int64_t size);
+	%ignore Trace::decodeTraceData(const uint8_t *data,int size,TraceRecordCallback callback,void *arg,int flags);
 #endif // SWIG
 
+// called by Trace::decodeTraceData() for each record. Pointers are null for records not asked for or
+// not produced, and are only valid during the call
+
+typedef void (*TraceRecordCallback)(void *arg,Instruction *instInfo,NexusMessage *msgInfo,Source *srcInfo);
+
 class Trace {
 public:
     Trace(char *tf_name,char *ef_name,int numAddrBits,uint32_t addrDispFlags,int srcBits,uint32_t freq = 0);
@@ -845,6 +955,7 @@ public:
     void cleanUp();
     static const char *version();
     TraceDqr::DQErr setTraceType(TraceDqr::TraceType tType);
+	TraceDqr::TraceType getTraceType() { return traceType; }
 	TraceDqr::DQErr setTSSize(int size);
 	TraceDqr::DQErr setITCPrintOptions(int intFlags,int buffSize,int channel);
 	TraceDqr::DQErr setPathType(TraceDqr::pathType pt);
@@ -867,7 +978,60 @@ public:
 	TraceDqr::DQErr NextInstruction(Instruction **instInfo, NexusMessage **msgInfo, Source **srcInfo);
 	TraceDqr::DQErr NextInstruction(Instruction *instInfo, NexusMessage *msgInfo, Source *srcInfo, int *flags);
 
-	TraceDqr::DQErr getTraceFileOffset(int &size,int &offset);
+	// Return the next executed range of addresses, without disassembly or source information. Blocks
+	// from different cores are returned in the order they end. Do not mix with NextInstruction()
+
+	TraceDqr::DQErr NextBlock(InstructionBlock *blockInfo);
+
+	// Parse only: return the next trace message without following the program, so the elf file is not
+	// used. Timestamps are rebuilt as NextInstruction() does, and NxtAddr is the last address carried by a
+	// message from that core. Analytics count messages but not instructions. Do not mix with
+	// NextInstruction() or NextBlock()
+
+	TraceDqr::DQErr NextMessage(NexusMessage **msgInfo);
+	TraceDqr::DQErr NextMessage(NexusMessage *msgInfo,int *flags);
+
+	// offset is the number of trace bytes consumed. size is 0 if not known (stdin, pipes, or
+	// compressed files), in which case progress can only be shown as bytes consumed
+
+	TraceDqr::DQErr getTraceFileOffset(int64_t &size,int64_t &offset);
+	TraceDqr::DQErr getTraceFileReadStats(int64_t &blocks,int64_t &stalls);
+
+	// Reposition the trace at the last sync message at or before a timestamp, message number, or trace
+	// file offset, and resume decoding from there with NextInstruction(). Uses the index set with
+	// setTraceIndex(), or <tracefile>.idx if it matches the trace, or else builds one on first use
+
+	TraceDqr::DQErr setTraceIndex(char *idx_name);
+	TraceDqr::DQErr seekToTimestamp(TraceDqr::TIMESTAMP ts);
+	TraceDqr::DQErr seekToMessageNumber(int msgNum);
+	TraceDqr::DQErr seekToFileOffset(int64_t offset);
+
+	// The index used by the seek functions (loaded or built if needed), and seeking to one of its entries
+	// directly, for tools that split the trace at sync messages
+
+	TraceIndex     *getTraceIndex();
+	TraceDqr::DQErr seekToIndexEntry(const TraceIndexEntry *entry);
+
+	// Save the decode state between calls to NextInstruction() or NextBlock(), and restore it into this or
+	// another Trace object opened on the same trace with the same settings, which then carries on from the
+	// same point with the same call stack. The checkpoint from saveCheckpoint(data,size) is freed by the
+	// caller with delete []. Not supported for trace sockets or with a cycle accurate trace file
+
+	TraceDqr::DQErr saveCheckpoint(uint8_t *&data,int64_t &size);
+	TraceDqr::DQErr restoreCheckpoint(const uint8_t *data,int64_t size);
+	TraceDqr::DQErr saveCheckpoint(char *cp_name);
+	TraceDqr::DQErr restoreCheckpoint(char *cp_name);
+
+	// Decode a multi-core trace with one Trace object per core, or group of cores. One Trace reads the
+	// trace file with NextRawMessage(), which parses each message but does not decode it. It only switches
+	// the trace type to HTM when NextInstruction() would, so getTraceType() after the call is the type
+	// to decode the message with. Each message is then given to the pushed trace (DQR_PUSHED_TRACE) for
+	// its core with pushTraceMsg(). Messages are pushed one at a time: push the next one when
+	// NextInstruction() or NextMessage() returns DQERR_WOULDBLOCK. msgInfo must stay valid until then.
+	// Push nullptr at the end of the trace
+
+	TraceDqr::DQErr NextRawMessage(NexusMessage **msgInfo);
+	TraceDqr::DQErr pushTraceMsg(const NexusMessage *msgInfo);
 
 	TraceDqr::DQErr haveITCPrintData(int numMsgs[DQR_MAXCORES], bool havePrintData[DQR_MAXCORES]);
 	bool        getITCPrintMsg(int core,char *dst, int dstLen,TraceDqr::TIMESTAMP &startTime,TraceDqr::TIMESTAMP &endTime);
@@ -892,6 +1056,24 @@ public:
 
 	TraceDqr::DQErr getNumBytesInSWTQ(int &numBytes);
 
+	// Live traces (an SWT server:port, or DQR_PUSHED_TRACE): when the data received so far ends part way
+	// through the trace, NextInstruction(), NextMessage() and NextBlock() return DQERR_OK with no records
+	// for compatibility. After setWouldBlock(true) they return DQERR_WOULDBLOCK instead, and the caller
+	// can wait with waitForTraceData() (timeoutMs < 0 waits forever), or poll getTraceFd() for input,
+	// rather than spinning. Pushed traces always return DQERR_WOULDBLOCK, and get more data only from
+	// pushTraceData(); push a size of 0 at the end of the trace
+
+	TraceDqr::DQErr setWouldBlock(bool wb);
+	int             getTraceFd();
+	TraceDqr::DQErr waitForTraceData(int timeoutMs);
+	TraceDqr::DQErr pushTraceData(const uint8_t *data,int size,int &consumed);
+
+	// Push all of data into a pushed trace and call callback for every record it completes. flags is
+	// the TRACE_HAVE_INSTINFO, TRACE_HAVE_MSGINFO and TRACE_HAVE_SRCINFO records wanted. Returns DQERR_OK
+	// when all of data is decoded, DQERR_EOF once the end of the trace (size 0) is decoded, or an error
+
+	TraceDqr::DQErr decodeTraceData(const uint8_t *data,int size,TraceRecordCallback callback,void *arg,int flags);
+
 private:
 	enum state {
 		TRACE_STATE_SYNCCATE,
@@ -946,6 +1128,10 @@ private:
 
 	NexusMessage     nm;
 
+	bool             msgsPushed;		// messages come from pushTraceMsg() instead of the trace file
+	const NexusMessage *pushedMsg;
+	bool             pushedMsgsEnd;
+
 	NexusMessage     messageInfo;
 	Instruction      instructionInfo;
 	Source           sourceInfo;
@@ -955,8 +1141,18 @@ private:
 	class CATrace   *caTrace;
 	TraceDqr::TIMESTAMP lastCycle[DQR_MAXCORES];
 	int               eCycleCount[DQR_MAXCORES];
+	TraceIndex      *traceIndex;
+	class BasicBlockCache *bbCache;
+	bool             blockMode;
+	bool             wouldBlock;	// return DQERR_WOULDBLOCK when a live trace runs out of data
+	InstructionBlock blocks[DQR_MAXCORES];	// block being built for each core by NextBlock()
+	InstructionBlock readyBlocks[2];
+	int              numReadyBlocks;
 
 	TraceDqr::DQErr configure(class TraceSettings &settings);
+	TraceDqr::DQErr loadTraceIndex();
+	TraceDqr::DQErr readNextTraceMsg(bool &haveMsg);
+	TraceDqr::DQErr updateTraceType();
 
 	int decodeInstructionSize(uint32_t inst, int &inst_size);
 	int decodeInstruction(uint32_t instruction,int &inst_size,TraceDqr::InstType &inst_type,TraceDqr::Reg &rs1,TraceDqr::Reg &rd,int32_t &immediate,bool &is_branch);
@@ -964,6 +1160,11 @@ private:
 	TraceDqr::DQErr nextAddr(TraceDqr::ADDRESS addr,TraceDqr::ADDRESS &nextAddr,int &crFlag);
 	TraceDqr::DQErr nextAddr(int currentCore,TraceDqr::ADDRESS addr,TraceDqr::ADDRESS &pc,TraceDqr::TCode tcode,int &crFlag,TraceDqr::BranchFlags &brFlag);
 	TraceDqr::DQErr nextCAAddr(TraceDqr::ADDRESS &addr,TraceDqr::ADDRESS &savedAddr);
+	struct BasicBlock *getBasicBlock(TraceDqr::ADDRESS addr);
+	void retireHistoryBlocks(int core);
+	int  Disassemble(TraceDqr::ADDRESS addr,bool getInstInfo,bool getSrcInfo);
+	void addToBlock(int core,TraceDqr::ADDRESS start,TraceDqr::ADDRESS end,int numInsts,int crFlag,int brFlags,bool endsBlock);
+	void resetBlocks();
 
 	TraceDqr::ADDRESS computeAddress();
 	TraceDqr::DQErr processTraceMessage(NexusMessage &nm,TraceDqr::ADDRESS &pc,TraceDqr::ADDRESS &faddr,TraceDqr::TIMESTAMP &ts,bool &consumed);
@@ -1005,7 +1206,7 @@ public:
 	void cleanUp();
 	TraceDqr::DQErr getStatus() {return status;}
 
-	TraceDqr::DQErr getTraceFileOffset(int &size,int &offset);
+	TraceDqr::DQErr getTraceFileOffset(int64_t &size,int64_t &offset);
 	int Disassemble(SRec *srec);
 
 	TraceDqr::DQErr NextInstruction(Instruction **instInfo, NexusMessage **msgInfo, Source **srcInfo);
@@ -1042,6 +1243,7 @@ private:
 	disassemble_info disasm_info;
 	disassembler_ftype disasm_func;
 	uint32_t instructionBuffer[2];
+	char     instructionText[64];	// disassembly when there is no elf file
 
 	uint64_t currentTime[DQR_MAXCORES];
 	int  enterISR[DQR_MAXCORES];
@@ -12,6 +12,7 @@
 %pointer_functions(int, intp);
 %pointer_functions(bool, boolp);
 %pointer_functions(double, doublep);
+%pointer_functions(long long, longlongp);
 
 typedef unsigned char uint8_t;
 typedef unsigned short uint16_t;
@@ -42,6 +42,10 @@
 #include <cstdint>
 #include <cassert>
 #include <fcntl.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <zlib.h>
 
 #ifdef DO_TIMES
 class Timer {
@@ -58,14 +62,24 @@ private:
 #endif // DO_TIMES
 
 void sanePath(TraceDqr::pathType pt,const char *src,char *dst);
+TraceDqr::DQErr loadFile(const char *name,char *&buff,int64_t &size);
+
+// cachedInstInfo: source and disassembly for one address. Each half is filled in the first time it is
+// asked for
 
 class cachedInstInfo {
 public:
-	cachedInstInfo(const char *file,int cutPathIndex,const char *func,int linenum,const char *lineTxt,const char *instText,TraceDqr::RV_INST inst,int instSize,const char *addresslabel,int addresslabeloffset,bool haveoperandaddress,TraceDqr::ADDRESS operandaddress,const char *operandlabel,int operandlabeloffset);
+	cachedInstInfo();
 	~cachedInstInfo();
 
+	void setSrcInfo(const char *file,int cutPathIndex,const char *func,int linenum,const char *lineTxt);
+	void setInstInfo(const char *instText,TraceDqr::RV_INST inst,int instSize,const char *addresslabel,int addresslabeloffset,bool haveoperandaddress,TraceDqr::ADDRESS operandaddress,const char *operandlabel,int operandlabeloffset);
+
 	void dump();
 
+	bool        haveSrc;
+	bool        haveInst;
+
 	const char *filename;
 	int         cutPathIndex;
 	const char *functionname;
@@ -85,6 +99,57 @@ public:
 	int               operandLabelOffset;
 };
 
+// decodedInst: the instruction at one half-word of a code section, decoded once and kept in the
+// section's table. rc is the return value of Disassembler::decodeInstruction()
+
+#define DECODE_PAGE_SIZE 2048	// half-words per page of decoded instructions
+
+struct decodedInst {
+	TraceDqr::RV_INST inst;
+	int32_t           immediate;
+	uint16_t          type;
+	uint8_t           rs1;
+	uint8_t           rd;
+	int8_t            size;
+	int8_t            rc;
+	bool              isBranch;
+	bool              decoded;
+
+	int getDecodedFields(int &inst_size,TraceDqr::InstType &inst_type,TraceDqr::Reg &inst_rs1,TraceDqr::Reg &inst_rd,int32_t &inst_immediate,bool &is_branch) const
+	{
+		inst_size = size;
+		inst_type = (TraceDqr::InstType)type;
+		inst_rs1 = (TraceDqr::Reg)rs1;
+		inst_rd = (TraceDqr::Reg)rd;
+		inst_immediate = immediate;
+		is_branch = isBranch;
+
+		return rc;
+	}
+};
+
+// class elfImage: read only mapping of an elf file. Created by ElfReader and left in the bfd's
+// usrdata so a Disassembler on the same bfd shares it. Reference counted; pages are only read
+// in when a section is used
+
+class elfImage {
+public:
+	static elfImage *mapFile(const char *name);
+
+	elfImage *attach();
+	void      release();
+
+	const uint16_t *getSectionCode(asection *sp);
+
+private:
+	elfImage();
+	~elfImage();
+
+	uint8_t *data;
+	size_t   size;
+	int      refCount;
+};
+
 // class section: work with elf file sections using libbfd
 
 class section {
@@ -92,11 +157,11 @@ public:
 	section();
 	~section();
 
-	section *initSection(section **head,asection *newsp,bool enableInstCaching);
-	section *getSectionByAddress(TraceDqr::ADDRESS addr);
+	section *initSection(section **head,asection *newsp,bool enableInstCaching,elfImage *image = nullptr);
 
-	cachedInstInfo *setCachedInfo(TraceDqr::ADDRESS addr,const char *file,int cutPathIndex,const char *func,int linenum,const char *lineTxt,const char *instTxt,TraceDqr::RV_INST inst,int instSize,const char *addresslabel,int addresslabeloffset,bool haveoperandaddress,TraceDqr::ADDRESS operandaddress,const char *operandlabel,int operandlabeloffset);
+	cachedInstInfo *setCachedInfo(TraceDqr::ADDRESS addr);
 	cachedInstInfo *getCachedInfo(TraceDqr::ADDRESS addr);
+	decodedInst *getDecodedInst(TraceDqr::ADDRESS addr);
 
 	section     *next;
 	bfd         *abfd;
@@ -105,7 +170,38 @@ public:
 	int          size;
 	asection    *asecptr;
 	uint16_t    *code;
+	bool         codeMapped;	// code points into an elfImage, not a copy
 	cachedInstInfo **cachedInfo;
+	decodedInst **decodedPages;	// allocated a page at a time, when first used
+	int          numDecodedPages;
+};
+
+// class sectionMap: address sorted array of code sections for lookups. The section list
+// still owns the sections. Overlapping sections (overlays) are split into disjoint ranges,
+// each mapped to the section a walk of the list would have found first
+
+class sectionMap {
+public:
+	sectionMap();
+	~sectionMap();
+
+	TraceDqr::DQErr init(section *head);
+	section *getSectionByAddress(TraceDqr::ADDRESS addr);
+
+private:
+	typedef struct {
+		TraceDqr::ADDRESS start;
+		TraceDqr::ADDRESS end;
+		section          *sp;
+		int               order;	// position in the section list
+	} sectionRange_t;
+
+	sectionRange_t *ranges;
+	int             numRanges;
+	int             lastHit;	// index into ranges of the last hit, or -1
+
+	static int sectionRange_compare_func(const void *arg1,const void *arg2);
+	static int address_compare_func(const void *arg1,const void *arg2);
 };
 
 // class fileReader: Helper class to handler list of source code files
@@ -153,12 +249,32 @@ public:
 	void         dump();
 
 private:
+	// entry in the address index; sorted by address, then by symbol table index
+
+	typedef struct {
+		TraceDqr::ADDRESS addr;
+		int               index;
+	} sym_addr_t;
+
 	bfd      *abfd;
 	long      number_of_symbols;
     asymbol **symbol_table;
 
+    // name hash (open addressing, holds symbol table index + 1, 0 is empty) and
+    // address sorted index of function symbols. Both are built once by the constructor
+
+    int         *nameHash;
+    int          nameHashSize;
+    sym_addr_t  *addrIndex;
+    int          numAddrs;
+
     TraceDqr::ADDRESS vma;
     int          index;
+
+    void         buildIndexes();
+    int          findSymbolByAddress(TraceDqr::ADDRESS addr,int first);
+    static unsigned int hashName(const char *name);
+    static int   sym_addr_compare_func(const void *arg1,const void *arg2);
 };
 
 // Class ElfReader: Interface class between dqr and bfd
@@ -169,6 +285,7 @@ public:
 	          ~ElfReader();
 	TraceDqr::DQErr getStatus() { return status; }
 	TraceDqr::DQErr getInstructionByAddress(TraceDqr::ADDRESS addr, TraceDqr::RV_INST &inst);
+	TraceDqr::DQErr getDecodedInstruction(TraceDqr::ADDRESS addr, const decodedInst *&di);
 	Symtab    *getSymtab();
 	bfd       *get_bfd() {return abfd;}
 	int        getArchSize() { return archSize; }
@@ -187,9 +304,49 @@ private:
 	int	        bitsPerWord;
 	int         bitsPerAddress;
 	section	   *codeSectionLst;
+	sectionMap  codeSections;
+	elfImage   *image;
 	Symtab     *symtab;
 };
 
+// class CheckpointBuffer: decoder state written by Trace::saveCheckpoint() and read back by
+// Trace::restoreCheckpoint(). Grows as it is written. Reads fail instead of running past the end
+
+#define DQR_CHECKPOINT_MAGIC	"DQRCKPT"
+#define DQR_CHECKPOINT_VERSION	1
+
+struct TraceCheckpointHeader {
+	char     magic[8];		// DQR_CHECKPOINT_MAGIC, nul terminated
+	uint32_t version;		// DQR_CHECKPOINT_VERSION
+	uint32_t maxCores;		// DQR_MAXCORES
+	uint32_t msgSize;		// sizeof(NexusMessage)
+	uint32_t srcBits;
+	uint32_t tsSize;
+	uint32_t reserved;
+	uint64_t traceSize;		// size of the trace file, 0 if not known
+	uint64_t traceOffset;	// trace file offset of the next message to read
+	uint64_t size;			// size of the checkpoint, including this header
+};
+
+class CheckpointBuffer {
+public:
+	CheckpointBuffer();
+	CheckpointBuffer(const uint8_t *data,int64_t size);
+	~CheckpointBuffer();
+
+	bool put(const void *src,int64_t n);
+	bool get(void *dst,int64_t n);
+	uint8_t *release(int64_t &size);
+	int64_t getSize() { return size; }
+
+private:
+	uint8_t       *wrData;		// buffer being written, nullptr when reading
+	const uint8_t *rdData;		// caller's checkpoint being read
+	int64_t        allocSize;
+	int64_t        size;
+	int64_t        pos;
+};
+
 class TsList {
 public:
 	TsList();
@@ -217,9 +374,13 @@ public:
 	int  getITCPrintMask();
 	int  getITCFlushMask();
 	bool haveITCPrintMsgs();
+	void reset();
+	TraceDqr::DQErr saveState(CheckpointBuffer &cb);
+	TraceDqr::DQErr restoreState(CheckpointBuffer &cb);
 
 private:
 	int  roomInITCPrintQ(uint8_t core);
+	void freeTsList(int core);
 	TsList *consumeTerminatedTsList(int core);
 	TsList *consumeOldestTsList(int core);
 
@@ -236,42 +397,117 @@ private:
 	class TsList *freeList;
 };
 
+// class BlockReader: Reads a trace file or stream a block at a time on a separate thread so that
+// slow I/O (network file systems, pipes) overlaps with message parsing and instruction decode
+
+class BlockReader {
+public:
+	BlockReader(int fd,bool compressed,int numBuffers,int bufferSize);
+	~BlockReader();
+
+	TraceDqr::DQErr getStatus() { return status; }
+	TraceDqr::DQErr nextBlock(uint8_t *&data,int &size);
+	TraceDqr::DQErr getStats(int64_t &blocks,int64_t &stalls);
+
+private:
+	TraceDqr::DQErr status;
+	int             fd;
+	gzFile          gz;		// gzip compressed input, decompressed on the reader thread
+	int             numBuffers;
+	int             bufferSize;
+	uint8_t       **buffers;
+	int            *bufferLen;
+	int             fillIndex;
+	int             drainIndex;
+	int             numFull;		// includes the block held by the consumer
+	bool            haveBlock;		// consumer is holding the block at drainIndex
+	bool            eof;
+	bool            readErr;
+	bool            exitReader;
+	int64_t         numBlocks;
+	int64_t         numStalls;	// times nextBlock() had to wait for the reader
+
+	std::mutex              mutex;
+	std::condition_variable cv;
+	std::thread            *reader;
+
+	void readerThread();
+	int  readBlock(uint8_t *buff);
+};
+
 // class SliceFileParser: Class to parse binary or ascii nexus messages into a NexusMessage object
 class SliceFileParser {
 public:
              SliceFileParser(char *filename,int srcBits);
              ~SliceFileParser();
   TraceDqr::DQErr readNextTraceMsg(NexusMessage &nm,class Analytics &analytics,bool &haveMsg);
-  TraceDqr::DQErr getFileOffset(int &size,int &offset);
+  TraceDqr::DQErr getFileOffset(int64_t &size,int64_t &offset);
+  TraceDqr::DQErr seek(int64_t offset);
 
   TraceDqr::DQErr getErr() { return status; };
   void       dump();
 
   TraceDqr::DQErr getNumBytesInSWTQ(int &numBytes);
+  TraceDqr::DQErr getReadStats(int64_t &blocks,int64_t &stalls);
+
+  int             pushData(const uint8_t *data,int size);
+  TraceDqr::DQErr waitForData(int timeoutMs);
+  bool            isStarved() { return starved; }
+  int             getSocket() { return SWTsock; }
 
 private:
   TraceDqr::DQErr status;
 
   // add other counts for each message type
 
+  struct msgSpan {
+	  int64_t skip;		// start of the bytes skipped to get to this message
+	  int64_t offset;
+	  int     length;
+  };
+
   int           srcbits;
-  std::ifstream tf;
-  int           tfSize;
+  char         *tfName;		// copy of the trace file name, so a streamed file can be reopened to seek backwards
+  int64_t       tfSize;
+  bool          tfRegular;	// trace file is a regular file, so it can be reopened to seek backwards
+  uint8_t      *tfData;		// memory mapped trace file, or nullptr if using blockReader or SWTsock
+  int64_t       tfPos;		// number of trace file bytes consumed
+  int64_t       scanPos;	// next byte in tfData not yet split into spans
+  uint32_t     *msgEnds;	// scratch for scanMappedMsgs()
+  msgSpan      *spans;		// messages found by scanMappedMsgs(), not yet parsed
+  int           numSpans;
+  int           nextSpan;
+  BlockReader  *blockReader;	// trace file that cannot be mapped, or nullptr
+  uint8_t      *blockData;
+  int           blockSize;
+  int           blockPos;
   int           SWTsock;
   int           bitIndex;
   int           msgSlices;
-  uint32_t      msgOffset;
+  uint64_t      msgOffset;
   int           pendingMsgIndex;
-  uint8_t       msg[64];
+  uint8_t      *msg;		// points to msgBuffer, or to the current message in tfData
+  uint8_t       msgBuffer[64];
+  uint64_t      msgBits[7];	// msg payload with the MSEO bits stripped, lsb first. One spare word so reads can run past the end
+  uint64_t      msgFieldEnds;	// bit n set if slice n of msg ends a field (MSEO bits not 0b00)
+  uint64_t      msgEOMs;	// bit n set if slice n of msg ends the message (MSEO bits 0b11)
   bool          eom;
 
   int           bufferInIndex;
   int           bufferOutIndex;
-  uint8_t       sockBuffer[2048];
+  uint8_t       sockBuffer[2048];	// ring of bytes read from SWTsock, or given to pushData()
+  bool          pushed;		// trace bytes come from pushData() instead of a file or socket
+  bool          endOfStream;	// socket closed by the server, or pushData() given a size of 0
+  bool          starved;	// last read ran out of socket or pushed bytes part way through the trace
 
+  TraceDqr::DQErr openTraceFile(char *filename);
   TraceDqr::DQErr readBinaryMsg(bool &haveMsg);
+  TraceDqr::DQErr readMappedMsg(bool &haveMsg);
+  void            scanMappedMsgs();
+  TraceDqr::DQErr readBlockByte(uint8_t &byte);
   TraceDqr::DQErr bufferSWT();
-  TraceDqr::DQErr readNextByte(uint8_t *byte);
+  void            packMsg();
+  uint64_t        getMsgBits(int pos,int width);
   TraceDqr::DQErr parseVarField(uint64_t *val,int *width);
   TraceDqr::DQErr parseFixedField(int width, uint64_t *val);
   TraceDqr::DQErr parseDirectBranch(NexusMessage &nm,Analytics &analytics);
@@ -628,7 +864,14 @@ class Disassembler {
 public:
 	      Disassembler(bfd *abfd,bool labelsAreFunctionsls);
 	      ~Disassembler();
-	int   Disassemble(TraceDqr::ADDRESS addr);
+	enum {
+		DIS_INSTRUCTION = 0x01,	// instruction text and labels
+		DIS_SOURCE      = 0x02,	// source file, function, and line
+		DIS_ALL         = DIS_INSTRUCTION | DIS_SOURCE,
+	};
+
+	int   Disassemble(TraceDqr::ADDRESS addr,int fields = DIS_ALL);
+	int   Disassemble(TraceDqr::ADDRESS addr,int fields,Instruction *instInfo,Source *srcInfo);
 
 	int   getSrcLines(TraceDqr::ADDRESS addr,const char **filename,int *cutPathIndex,const char **functionname,unsigned int *linenumber,const char **line);
 
@@ -639,8 +882,8 @@ public:
 	void  getAddressSyms(bfd_vma vma);
 	void  clearOperandAddress();
 
-	Instruction getInstructionInfo() { return instruction; }
-	Source      getSourceInfo() { return source; }
+	const Instruction &getInstructionInfo() { return instruction; }
+	const Source      &getSourceInfo() { return source; }
 
 	TraceDqr::DQErr setPathType(TraceDqr::pathType pt);
 	TraceDqr::DQErr subSrcPath(const char *cutPath,const char *newRoot);
@@ -654,6 +897,33 @@ private:
 		int      func_size;
 	} func_info_t;
 
+	// address ranges of the symbols with some flags, sorted by start and not overlapping, for binary
+	// search by lookup_symbol_by_address(). Symbols at the same address are represented by the last one
+
+	typedef struct {
+		bfd_vma start;
+		bfd_vma end;	// func_vma + func_size. Zero sized symbols only match start
+		int     index;	// into sorted_syms[] and func_info[]
+	} sym_range_t;
+
+	typedef struct {
+		flagword     flags;
+		sym_range_t *ranges;
+		int          numRanges;
+	} sym_index_t;
+
+	typedef struct {
+		flagword flags;
+		int      index;
+		bfd_vma  vma;
+		int      size;
+	} sym_cache_t;
+
+	enum {
+		SYM_INDEX_CLASSES = 2,	// BSF_FUNCTION | BSF_OBJECT, and BSF_FUNCTION
+		SYM_CACHE_SIZE    = 4,
+	};
+
 	bfd               *abfd;
 	disassembler_ftype disassemble_func;
 	TraceDqr::DQErr         status;
@@ -669,13 +939,16 @@ private:
 	func_info_t      *func_info;
 	disassemble_info *info;
 	section	         *codeSectionLst;
+	sectionMap        codeSections;
+	elfImage         *image;
 	int               prev_index;
-	int               cached_sym_index;
-	bfd_vma           cached_sym_vma;
-	int               cached_sym_size;
+	sym_index_t       sym_index[SYM_INDEX_CLASSES];
+	sym_cache_t       sym_cache[SYM_CACHE_SIZE];	// recent lookup_symbol_by_address() hits
+	int               next_sym_cache;
 
 	Instruction instruction;
 	Source      source;
+	char        instructionText[64];	// libopcodes output for the last address not in the cache
 
 	class fileReader *fileReader;
 
@@ -685,6 +958,10 @@ private:
 	void print_address_and_instruction(bfd_vma vma);
 	void setInstructionAddress(bfd_vma vma);
 
+	int  lookupSrcLines(section *sp,TraceDqr::ADDRESS addr,const char **filename,int *cutPathIndex,const char **functionname,unsigned int *linenumber,const char **line);
+
+	TraceDqr::DQErr buildSymIndex(sym_index_t &si,flagword flags);
+	static int sym_range_compare_func(const void *arg1,const void *arg2);
 	int lookup_symbol_by_address(bfd_vma,flagword flags,int *index,int *offset);
 	int lookupInstructionByAddress(bfd_vma vma,uint32_t *ins,int *ins_size);
 //	int get_ins(bfd_vma vma,uint32_t *ins,int *ins_size);
@@ -710,6 +987,8 @@ public:
 	int push(TraceDqr::ADDRESS addr);
 	TraceDqr::ADDRESS pop();
 	int getNumOnStack() { return stackSize - sp; }
+	TraceDqr::DQErr saveState(CheckpointBuffer &cb);
+	TraceDqr::DQErr restoreState(CheckpointBuffer &cb);
 
 private:
 	int stackSize;
@@ -733,6 +1012,8 @@ public:
 	TraceDqr::DQErr setCounts(NexusMessage *nm);
 	int consumeICnt(int core,int numToConsume);
 	int consumeHistory(int core,bool &taken);
+	int consumeHistory(int core,int numBits);
+	int getTakenRun(int core);
 	int consumeTakenCount(int core);
 	int consumeNotTakenCount(int core);
 
@@ -741,7 +1022,7 @@ public:
 	int getNumHistoryBits(int core) { return histBit[core]; }
 	uint32_t getTakenCount(int core) { return takenCount[core]; }
 	uint32_t getNotTakenCount(int core) { return notTakenCount[core]; }
-	uint32_t isTaken(int core) { return (history[core] & (1 << histBit[core])) != 0; }
+	uint32_t isTaken(int core) { return (history[core] & (((uint64_t)1) << histBit[core])) != 0; }
 
 	int push(int core,TraceDqr::ADDRESS addr) { return stack[core].push(addr); }
 	TraceDqr::ADDRESS pop(int core) { return stack[core].pop(); }
@@ -751,6 +1032,9 @@ public:
 
 	void dumpCounts(int core);
 
+	TraceDqr::DQErr saveState(CheckpointBuffer &cb);
+	TraceDqr::DQErr restoreState(CheckpointBuffer &cb);
+
 //	int getICnt(int core);
 //	int adjustICnt(int core,int delta);
 //	bool isHistory(int core);
@@ -765,6 +1049,40 @@ private:
     AddrStack stack[DQR_MAXCORES];
 };
 
+// BasicBlock: run of instructions from startAddr that always fall through to the next instruction,
+// and the control flow instruction at the end of it. length is the run, not counting the terminating
+// instruction, in half-words (the units of an i-cnt). Code does not change while a trace is decoded,
+// so blocks are built once and kept
+
+#define BB_MAX_INSTS	1024
+
+struct BasicBlock {
+	TraceDqr::ADDRESS  startAddr;
+	int                length;
+	int                numInst16;
+	int                numInst32;
+	TraceDqr::ADDRESS  termAddr;	// control flow instruction ending the block
+	TraceDqr::InstType termType;	// INST_UNKNOWN if the block ended because it was too long or left the code
+	int                termSize;
+	TraceDqr::ADDRESS  termTarget;	// target of a direct jump or branch, -1 if not known until it executes
+	int                termCRFlags;	// isCall if the terminating jump is a direct call
+};
+
+// BasicBlockCache: direct mapped cache of basic blocks, by start address
+
+class BasicBlockCache {
+public:
+	BasicBlockCache(int size = 4096);
+	~BasicBlockCache();
+
+	BasicBlock *lookup(TraceDqr::ADDRESS addr);
+	BasicBlock *insert(BasicBlock &bb);
+
+private:
+	int         size;
+	BasicBlock *blocks;
+};
+
 #endif /* TRACE_HPP_ */
 
 
@@ -36,14 +36,28 @@
 #else // WINDOWS
 #include <netdb.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <poll.h>
 #include <errno.h>
 #endif // WINDOWS
+#ifdef LINUX
+#include <sys/vfs.h>
+#endif // LINUX
+#include <sys/stat.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif // defined(__x86_64__) || defined(__i386__)
 
 #include "dqr.hpp"
 #include "trace.hpp"
 
 //#define DQR_MAXCORES	8
 
+// number of bytes of a mapped trace file split into messages at a time
+
+#define MSG_SCAN_WINDOW	(16*1024)
+
 int globalDebugFlag = 0;
 
 // DECODER_VERSION is passed in from the Makefile, from version.mk in the root.
@@ -51,21 +65,116 @@ const char *const DQR_VERSION = DECODER_VERSION;
 
 // static C type helper functions
 
-static int atoh(char a)
+#ifndef WINDOWS
+static bool isNetworkFile(int fd)
 {
-	if (a >= '0' && a <= '9') {
-		return a-'0';
+#ifdef LINUX
+	struct statfs sfs;
+
+	if (fstatfs(fd,&sfs) < 0) {
+		return false;
 	}
 
-	if (a >= 'a' && a <= 'f') {
-		return a-'a'+10;
+	switch ((uint32_t)sfs.f_type) {
+	case 0x00006969:	// NFS
+	case 0x0000517b:	// SMB
+	case 0xfe534d42:	// SMB2
+	case 0xff534d42:	// CIFS
+		return true;
 	}
+#endif // LINUX
+
+	return false;
+}
+#endif // WINDOWS
 
-	if (a >= 'A' && a <= 'F') {
-		return a-'A'+10;
+// find the slices that end a message (MSEO bits 0b11) in data[0..size-1] and put their indexes
+// in ends. Returns the number found
+
+static int findMsgEndsScalar(const uint8_t *data,int size,uint32_t *ends,int i,int n)
+{
+	for ( ; i < size; i++) {
+		if ((data[i] & 0x03) == TraceDqr::MSEO_END) {
+			ends[n] = i;
+			n += 1;
+		}
 	}
 
-	return -1;
+	return n;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static int findMsgEndsAVX2(const uint8_t *data,int size,uint32_t *ends)
+{
+	const __m256i mseo = _mm256_set1_epi8(0x03);
+	int n = 0;
+	int i;
+
+	for (i = 0; i + 32 <= size; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)&data[i]);
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(v,mseo),mseo));
+
+		while (mask != 0) {
+			ends[n] = i + __builtin_ctz(mask);
+			n += 1;
+			mask &= mask - 1;
+		}
+	}
+
+	return findMsgEndsScalar(data,size,ends,i,n);
+}
+
+__attribute__((target("sse2")))
+static int findMsgEndsSSE2(const uint8_t *data,int size,uint32_t *ends)
+{
+	const __m128i mseo = _mm_set1_epi8(0x03);
+	int n = 0;
+	int i;
+
+	for (i = 0; i + 16 <= size; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)&data[i]);
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(v,mseo),mseo));
+
+		while (mask != 0) {
+			ends[n] = i + __builtin_ctz(mask);
+			n += 1;
+			mask &= mask - 1;
+		}
+	}
+
+	return findMsgEndsScalar(data,size,ends,i,n);
+}
+#endif // defined(__x86_64__) || defined(__i386__)
+
+static int findMsgEnds(const uint8_t *data,int size,uint32_t *ends)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	static int simd = -1;
+
+	if (simd < 0) {
+		__builtin_cpu_init();
+
+		if (__builtin_cpu_supports("avx2")) {
+			simd = 2;
+		}
+		else if (__builtin_cpu_supports("sse2")) {
+			simd = 1;
+		}
+		else {
+			simd = 0;
+		}
+	}
+
+	switch (simd) {
+	case 2:
+		return findMsgEndsAVX2(data,size,ends);
+	case 1:
+		return findMsgEndsSSE2(data,size,ends);
+	}
+#endif // defined(__x86_64__) || defined(__i386__)
+
+	return findMsgEndsScalar(data,size,ends,0,0);
 }
 
 static void override_print_address(bfd_vma addr, struct disassemble_info *info)
@@ -225,6 +334,12 @@ __attribute__((unused)) static void dump_syms(asymbol **syms, int num_syms) // @
 
 static char *dis_output;
 
+// libbfd and libopcodes keep global state (the bfd open file cache, dis_output above) and are not
+// thread safe. Calls into them that may run while Trace objects on other threads are decoding hold
+// bfdMutex. Disassemble() caches its results, so this is mostly taken while a trace warms up
+
+static std::recursive_mutex bfdMutex;
+
 static int stringify_callback(FILE *stream, const char *format, ...)
 {
 	char buffer[128];
@@ -248,7 +363,30 @@ static int stringify_callback(FILE *stream, const char *format, ...)
 }
 
 // Section Class Methods
-cachedInstInfo::cachedInstInfo(const char *file,int cutPathIndex,const char *func,int linenum,const char *lineTxt,const char *instText,TraceDqr::RV_INST inst,int instSize,const char *addresslabel,int addresslabeloffset,bool haveoperandaddress,TraceDqr::ADDRESS operandaddress,const char *operandlabel,int operandlabeloffset)
+cachedInstInfo::cachedInstInfo()
+{
+	haveSrc = false;
+	haveInst = false;
+
+	filename = nullptr;
+	cutPathIndex = 0;
+	functionname = nullptr;
+	linenumber = 0;
+	lineptr = nullptr;
+
+	instruction = 0;
+	instsize = 0;
+	instructionText = nullptr;
+
+	addressLabel = nullptr;
+	addressLabelOffset = 0;
+	haveOperandAddress = false;
+	operandAddress = 0;
+	operandLabel = nullptr;
+	operandLabelOffset = 0;
+}
+
+void cachedInstInfo::setSrcInfo(const char *file,int cutPathIndex,const char *func,int linenum,const char *lineTxt)
 {
 	// Don't need to allocate and copy file and function. They will remain until trace object is deleted
 
@@ -258,6 +396,11 @@ cachedInstInfo::cachedInstInfo(const char *file,int cutPathIndex,const char *fun
 	linenumber = linenum;
 	lineptr = lineTxt;
 
+	haveSrc = true;
+}
+
+void cachedInstInfo::setInstInfo(const char *instText,TraceDqr::RV_INST inst,int instSize,const char *addresslabel,int addresslabeloffset,bool haveoperandaddress,TraceDqr::ADDRESS operandaddress,const char *operandlabel,int operandlabeloffset)
+{
 	instruction = inst;
 	instsize = instSize;
 
@@ -271,14 +414,18 @@ cachedInstInfo::cachedInstInfo(const char *file,int cutPathIndex,const char *fun
 
 	// Need to allocate and copy instruction. src changes every time an instruction is disassembled, so we need to save it
 
+	if (instructionText != nullptr) {
+		delete [] instructionText;
+		instructionText = nullptr;
+	}
+
 	if (instText != nullptr) {
 		int	s = strlen(instText)+1;
 		instructionText = new char [s];
 		strcpy(instructionText,instText);
 	}
-	else {
-		instructionText = nullptr;
-	}
+
+	haveInst = true;
 }
 
 cachedInstInfo::~cachedInstInfo()
@@ -314,6 +461,123 @@ void cachedInstInfo::dump()
 	printf("operandLabelOffset: %d\n",operandLabelOffset);
 }
 
+// read only mapping of an elf file
+
+elfImage::elfImage()
+{
+	data = nullptr;
+	size = 0;
+	refCount = 1;
+}
+
+elfImage::~elfImage()
+{
+#ifndef WINDOWS
+	if (data != nullptr) {
+		munmap(data,size);
+		data = nullptr;
+	}
+#endif // WINDOWS
+}
+
+// returns nullptr if the file cannot be mapped. Sections are then copied as before
+
+elfImage *elfImage::mapFile(const char *name)
+{
+#ifdef WINDOWS
+	return nullptr;
+#else // WINDOWS
+	if (name == nullptr) {
+		return nullptr;
+	}
+
+	int fd;
+
+	fd = open(name,O_RDONLY);
+	if (fd < 0) {
+		return nullptr;
+	}
+
+	struct stat sb;
+
+	if ((fstat(fd,&sb) < 0) || !S_ISREG(sb.st_mode) || (sb.st_size == 0)) {
+		close(fd);
+		return nullptr;
+	}
+
+	void *p;
+
+	p = mmap(nullptr,sb.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+
+	// the mapping stays valid after the file is closed
+
+	close(fd);
+
+	if (p == MAP_FAILED) {
+		return nullptr;
+	}
+
+	elfImage *ip = new (std::nothrow) elfImage;
+	if (ip == nullptr) {
+		munmap(p,sb.st_size);
+		return nullptr;
+	}
+
+	ip->data = (uint8_t*)p;
+	ip->size = sb.st_size;
+
+	return ip;
+#endif // WINDOWS
+}
+
+elfImage *elfImage::attach()
+{
+	refCount += 1;
+
+	return this;
+}
+
+void elfImage::release()
+{
+	refCount -= 1;
+
+	if (refCount <= 0) {
+		delete this;
+	}
+}
+
+// returns the contents of sp in the mapping, or nullptr if they must be read through bfd (no file
+// contents, relocations, compressed, in an archive member, or not half-word aligned in the file)
+
+const uint16_t *elfImage::getSectionCode(asection *sp)
+{
+	if ((data == nullptr) || (sp == nullptr) || (sp->owner == nullptr)) {
+		return nullptr;
+	}
+
+	if ((sp->owner->my_archive != nullptr) || (sp->owner->origin != 0)) {
+		return nullptr;
+	}
+
+	if (((sp->flags & SEC_HAS_CONTENTS) == 0) || (sp->flags & (SEC_RELOC | SEC_IN_MEMORY | SEC_ELF_COMPRESS))) {
+		return nullptr;
+	}
+
+	if (sp->compress_status != COMPRESS_SECTION_NONE) {
+		return nullptr;
+	}
+
+	// code is read a half-word at a time, including the half-word holding an odd last byte
+
+	bfd_size_type bytes = (sp->size + 1) & ~(bfd_size_type)1;
+
+	if ((sp->filepos < 0) || (sp->filepos & 1) || ((bfd_size_type)sp->filepos > size) || (bytes > size - sp->filepos)) {
+		return nullptr;
+	}
+
+	return (const uint16_t*)(data + sp->filepos);
+}
+
 // work with elf file sections using libbfd
 
 section::section()
@@ -325,18 +589,24 @@ section::section()
 	startAddr = (TraceDqr::ADDRESS)0;
 	endAddr   = (TraceDqr::ADDRESS)0;
 	code      = nullptr;
+	codeMapped = false;
 	cachedInfo = nullptr;
+	decodedPages = nullptr;
+	numDecodedPages = 0;
 }
 
 section::~section()
 {
 	if (code != nullptr) {
-		delete [] code;
+		if (codeMapped == false) {
+			delete [] code;
+		}
+
 		code = nullptr;
 	}
 
 	if (cachedInfo != nullptr) {
-		for (int i = 0; i < size/2; i++) {
+		for (int i = 0; i < (size+1)/2; i++) {
 			if (cachedInfo[i] != nullptr) {
 				delete cachedInfo[i];
 				cachedInfo[i] = nullptr;
@@ -346,9 +616,24 @@ section::~section()
 		delete [] cachedInfo;
 		cachedInfo = nullptr;
 	}
+
+	if (decodedPages != nullptr) {
+		for (int i = 0; i < numDecodedPages; i++) {
+			if (decodedPages[i] != nullptr) {
+				delete [] decodedPages[i];
+				decodedPages[i] = nullptr;
+			}
+		}
+
+		delete [] decodedPages;
+		decodedPages = nullptr;
+	}
 }
 
-section *section::initSection(section **head, asection *newsp,bool enableInstCaching)
+// If image is given and the section can be used straight from the file mapping, code points into
+// the mapping. Otherwise the contents are copied with bfd_get_section_contents()
+
+section *section::initSection(section **head, asection *newsp,bool enableInstCaching,elfImage *image)
 {
 	next = *head;
 	*head = this;
@@ -362,29 +647,38 @@ section *section::initSection(section **head, asection *newsp,bool enableInstCac
 	int words = (size+1)/2;
 
 	code = nullptr;
+	codeMapped = false;
 
-//	could make code only read when it is needed (lazzy eval), so if nver used, no memory is
-//	ever allocated and no time to read
+	if (image != nullptr) {
+		// code is never written, so the mapping can be used as is
 
-	code = new (std::nothrow) uint16_t[words];
+		code = (uint16_t*)image->getSectionCode(newsp);
+		if (code != nullptr) {
+			codeMapped = true;
+		}
+	}
 
 	if (code == nullptr) {
-		printf("Error: section::initSection(): Could not create code object\n");
+		code = new (std::nothrow) uint16_t[words];
 
-		return nullptr;
-	}
+		if (code == nullptr) {
+			printf("Error: section::initSection(): Could not create code object\n");
 
-    bfd_boolean rc;
-    rc = bfd_get_section_contents(abfd,newsp,(void*)code,0,size);
-    if (rc != TRUE) {
-      printf("Error: bfd_get_section_contents() failed\n");
-      return nullptr;
-    }
+			return nullptr;
+		}
+
+	    bfd_boolean rc;
+	    rc = bfd_get_section_contents(abfd,newsp,(void*)code,0,size);
+	    if (rc != TRUE) {
+	      printf("Error: bfd_get_section_contents() failed\n");
+	      return nullptr;
+	    }
+	}
 
     if (enableInstCaching) {
-    	cachedInfo = new cachedInstInfo*[size/2];	// divide by 2 because we want entries for addr/2
+    	cachedInfo = new cachedInstInfo*[words];	// one entry per half-word because we want entries for addr/2
 
-    	for (int i = 0; i < size/2; i++) {
+    	for (int i = 0; i < words; i++) {
     		cachedInfo[i] = nullptr;
     	}
     }
@@ -392,133 +686,390 @@ section *section::initSection(section **head, asection *newsp,bool enableInstCac
     	cachedInfo = nullptr;
     }
 
+    numDecodedPages = (words + DECODE_PAGE_SIZE - 1) / DECODE_PAGE_SIZE;
+
+    decodedPages = new (std::nothrow) decodedInst*[numDecodedPages];
+    if (decodedPages == nullptr) {
+    	printf("Error: section::initSection(): Could not create decoded instruction table\n");
+
+    	return nullptr;
+    }
+
+    for (int i = 0; i < numDecodedPages; i++) {
+    	decodedPages[i] = nullptr;
+    }
+
     return this;
 }
 
-section *section::getSectionByAddress(TraceDqr::ADDRESS addr)
+sectionMap::sectionMap()
 {
-	section *sp = this;
-
-	while (sp != nullptr) {
-		if ((addr >= sp->startAddr) && (addr <= sp->endAddr)) {
-			return sp;
-		}
+	ranges = nullptr;
+	numRanges = 0;
+	lastHit = -1;
+}
 
-		sp = sp->next;
+sectionMap::~sectionMap()
+{
+	if (ranges != nullptr) {
+		delete [] ranges;
+		ranges = nullptr;
 	}
 
-	return nullptr;
+	numRanges = 0;
+	lastHit = -1;
 }
 
-cachedInstInfo *section::setCachedInfo(TraceDqr::ADDRESS addr,const char *file,int cutPathIndex,const char *func,int linenum,const char *lineTxt,const char *instTxt,TraceDqr::RV_INST inst,int instSize,const char *addresslabel,int addresslabeloffset,bool haveoperandaddress,TraceDqr::ADDRESS operandaddress,const char *operandlabel,int operandlabeloffset)
+int sectionMap::sectionRange_compare_func(const void *arg1,const void *arg2)
 {
-	if ((addr >= startAddr) && (addr <= endAddr)) {
-		if (cachedInfo != nullptr) {
+	const sectionRange_t *first = (const sectionRange_t *)arg1;
+	const sectionRange_t *second = (const sectionRange_t *)arg2;
 
-			int index = (addr - startAddr) >> 1;
+	if (first->start < second->start) {
+		return -1;
+	}
 
-			if (cachedInfo[index] != nullptr) {
-				printf("Error: section::setCachedInfo(): cachedInfo[%d] not null\n",index);
-				return nullptr;
-			}
+	if (first->start > second->start) {
+		return 1;
+	}
 
-			cachedInstInfo *cci;
-			cci = new cachedInstInfo(file,cutPathIndex,func,linenum,lineTxt,instTxt,inst,instSize,addresslabel,addresslabeloffset,haveoperandaddress,operandaddress,operandlabel,operandlabeloffset);
+	return first->order - second->order;
+}
 
-			cachedInfo[index] = cci;
+int sectionMap::address_compare_func(const void *arg1,const void *arg2)
+{
+	TraceDqr::ADDRESS first = *(const TraceDqr::ADDRESS *)arg1;
+	TraceDqr::ADDRESS second = *(const TraceDqr::ADDRESS *)arg2;
 
-			return cci;
-		}
+	if (first < second) {
+		return -1;
 	}
 
-	return nullptr;
+	if (first > second) {
+		return 1;
+	}
+
+	return 0;
 }
 
-cachedInstInfo *section::getCachedInfo(TraceDqr::ADDRESS addr)
+// build the map from the section list. Must be called again if the list changes
+
+TraceDqr::DQErr sectionMap::init(section *head)
 {
-	if ((addr >= startAddr) && (addr <= endAddr)) {
-		if (cachedInfo != nullptr) {
-			return cachedInfo[(addr - startAddr) >> 1];
-		}
+	if (ranges != nullptr) {
+		delete [] ranges;
+		ranges = nullptr;
 	}
 
-	return nullptr;
-}
+	numRanges = 0;
+	lastHit = -1;
 
-int      Instruction::addrSize;
-uint32_t Instruction::addrDispFlags;
-int      Instruction::addrPrintWidth;
+	int n = 0;
 
-std::string Instruction::addressToString(int labelLevel)
-{
-	char dst[128];
+	for (section *sp = head; sp != nullptr; sp = sp->next) {
+		if (sp->endAddr >= sp->startAddr) {
+			n += 1;
+		}
+	}
 
-	addressToText(dst,sizeof dst,labelLevel);
+	if (n == 0) {
+		return TraceDqr::DQERR_OK;
+	}
 
-	return std::string(dst);
-}
+	sectionRange_t *secs = new (std::nothrow) sectionRange_t[n];
+	if (secs == nullptr) {
+		printf("Error: sectionMap::init(): Could not allocate section ranges\n");
 
-void Instruction::addressToText(char *dst,size_t len,int labelLevel)
-{
-	if (dst == nullptr) {
-		printf("Error: Instruction::addressToText(): Argument dst is null\n");
-		return;
+		return TraceDqr::DQERR_ERR;
 	}
 
-	dst[0] = 0;
+	n = 0;
 
-	if (addrDispFlags & TraceDqr::ADDRDISP_WIDTHAUTO) {
-		while (address > (0xffffffffffffffffllu >> (64 - addrPrintWidth*4))) {
-			addrPrintWidth += 1;
+	for (section *sp = head; sp != nullptr; sp = sp->next) {
+		if (sp->endAddr >= sp->startAddr) {
+			secs[n].start = sp->startAddr;
+			secs[n].end = sp->endAddr;
+			secs[n].sp = sp;
+			secs[n].order = n;
+			n += 1;
 		}
 	}
 
-    int n;
+	qsort(secs,n,sizeof secs[0],sectionRange_compare_func);
 
-	if ((addrPrintWidth > 8) && (addrDispFlags & TraceDqr::ADDRDISP_SEP)) {
-		n = snprintf(dst,len,"%0*x.%08x",addrPrintWidth-8,(uint32_t)(address >> 32),(uint32_t)address);
-	}
-	else {
-		n = snprintf(dst,len,"%0*llx",addrPrintWidth,address);
-	}
+	bool overlap = false;
+	TraceDqr::ADDRESS maxEnd = secs[0].end;
 
-    if ((labelLevel >= 1) && (addressLabel != nullptr)) {
-    	if (addressLabelOffset != 0) {
-		    snprintf(dst+n,len-n," <%s+%x>",addressLabel,addressLabelOffset);
+	for (int i = 1; i < n; i++) {
+		if (secs[i].start <= maxEnd) {
+			overlap = true;
 		}
-		else {
-		    snprintf(dst+n,len-n," <%s>",addressLabel);
+
+		if (secs[i].end > maxEnd) {
+			maxEnd = secs[i].end;
 		}
 	}
-}
-
-std::string Instruction::instructionToString(int labelLevel)
-{
-	char dst[128];
 
-	instructionToText(dst,sizeof dst,labelLevel);
-
-	return std::string(dst);
-}
+	if (overlap == false) {
+		ranges = secs;
+		numRanges = n;
 
-void Instruction::instructionToText(char *dst,size_t len,int labelLevel)
-{
-	if (dst == nullptr) {
-		printf("Error: Instruction::instructionToText(): Argument dst is null\n");
-		return;
+		return TraceDqr::DQERR_OK;
 	}
 
-	int n;
+	// split the address space at every section start and end, and give each piece to the
+	// first section in list order that covers it
 
-	dst[0] = 0;
+	TraceDqr::ADDRESS *bounds = new (std::nothrow) TraceDqr::ADDRESS[n*2];
+	if (bounds == nullptr) {
+		printf("Error: sectionMap::init(): Could not allocate section bounds\n");
 
-//	should cache this (as part of other instruction stuff cached)!!
+		delete [] secs;
 
-	if (instSize == 32) {
-		n = snprintf(dst,len,"%08x    %s",instruction,instructionText);
+		return TraceDqr::DQERR_ERR;
 	}
-	else {
-		n = snprintf(dst,len,"%04x        %s",instruction,instructionText);
+
+	int numBounds = 0;
+
+	for (int i = 0; i < n; i++) {
+		bounds[numBounds] = secs[i].start;
+		numBounds += 1;
+
+		if (secs[i].end != (TraceDqr::ADDRESS)-1) {
+			bounds[numBounds] = secs[i].end + 1;
+			numBounds += 1;
+		}
+	}
+
+	qsort(bounds,numBounds,sizeof bounds[0],address_compare_func);
+
+	ranges = new (std::nothrow) sectionRange_t[numBounds];
+	if (ranges == nullptr) {
+		printf("Error: sectionMap::init(): Could not allocate section ranges\n");
+
+		delete [] bounds;
+		delete [] secs;
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	for (int i = 0; i < numBounds; i++) {
+		if ((i > 0) && (bounds[i] == bounds[i-1])) {
+			continue;
+		}
+
+		TraceDqr::ADDRESS start = bounds[i];
+		TraceDqr::ADDRESS end = (TraceDqr::ADDRESS)-1;
+
+		for (int j = i+1; j < numBounds; j++) {
+			if (bounds[j] != start) {
+				end = bounds[j] - 1;
+				break;
+			}
+		}
+
+		int winner = -1;
+
+		for (int j = 0; (j < n) && (secs[j].start <= start); j++) {
+			if ((start <= secs[j].end) && ((winner == -1) || (secs[j].order < secs[winner].order))) {
+				winner = j;
+			}
+		}
+
+		if (winner == -1) {
+			continue;
+		}
+
+		if ((numRanges > 0) && (ranges[numRanges-1].sp == secs[winner].sp) && (ranges[numRanges-1].end + 1 == start)) {
+			ranges[numRanges-1].end = end;
+		}
+		else {
+			ranges[numRanges].start = start;
+			ranges[numRanges].end = end;
+			ranges[numRanges].sp = secs[winner].sp;
+			ranges[numRanges].order = secs[winner].order;
+			numRanges += 1;
+		}
+	}
+
+	delete [] bounds;
+	delete [] secs;
+
+	return TraceDqr::DQERR_OK;
+}
+
+section *sectionMap::getSectionByAddress(TraceDqr::ADDRESS addr)
+{
+	if ((lastHit >= 0) && (addr >= ranges[lastHit].start) && (addr <= ranges[lastHit].end)) {
+		return ranges[lastHit].sp;
+	}
+
+	// find the last range starting at or below addr
+
+	int lo = 0;
+	int hi = numRanges;
+
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if (ranges[mid].start <= addr) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	lo -= 1;
+
+	if ((lo >= 0) && (addr <= ranges[lo].end)) {
+		lastHit = lo;
+
+		return ranges[lo].sp;
+	}
+
+	return nullptr;
+}
+
+// adds an empty cache entry for addr. Returns nullptr if caching is off for the section
+
+cachedInstInfo *section::setCachedInfo(TraceDqr::ADDRESS addr)
+{
+	if ((addr >= startAddr) && (addr <= endAddr)) {
+		if (cachedInfo != nullptr) {
+
+			int index = (addr - startAddr) >> 1;
+
+			if (cachedInfo[index] != nullptr) {
+				printf("Error: section::setCachedInfo(): cachedInfo[%d] not null\n",index);
+				return nullptr;
+			}
+
+			cachedInstInfo *cci;
+			cci = new cachedInstInfo;
+
+			cachedInfo[index] = cci;
+
+			return cci;
+		}
+	}
+
+	return nullptr;
+}
+
+cachedInstInfo *section::getCachedInfo(TraceDqr::ADDRESS addr)
+{
+	if ((addr >= startAddr) && (addr <= endAddr)) {
+		if (cachedInfo != nullptr) {
+			return cachedInfo[(addr - startAddr) >> 1];
+		}
+	}
+
+	return nullptr;
+}
+
+// returns the table entry for addr, allocating its page if needed. The entry is only filled in by
+// ElfReader::getDecodedInstruction()
+
+decodedInst *section::getDecodedInst(TraceDqr::ADDRESS addr)
+{
+	if ((addr < startAddr) || (addr > endAddr) || (decodedPages == nullptr)) {
+		return nullptr;
+	}
+
+	int index = (addr - startAddr) >> 1;
+	int page = index / DECODE_PAGE_SIZE;
+
+	if (decodedPages[page] == nullptr) {
+		decodedPages[page] = new (std::nothrow) decodedInst[DECODE_PAGE_SIZE];
+		if (decodedPages[page] == nullptr) {
+			return nullptr;
+		}
+
+		for (int i = 0; i < DECODE_PAGE_SIZE; i++) {
+			decodedPages[page][i].decoded = false;
+		}
+	}
+
+	return &decodedPages[page][index % DECODE_PAGE_SIZE];
+}
+
+std::string Instruction::addressToString(int labelLevel)
+{
+	char dst[128];
+
+	addressToText(dst,sizeof dst,labelLevel);
+
+	return std::string(dst);
+}
+
+void Instruction::addressToText(char *dst,size_t len,int labelLevel)
+{
+	if (dst == nullptr) {
+		printf("Error: Instruction::addressToText(): Argument dst is null\n");
+		return;
+	}
+
+	dst[0] = 0;
+
+	if (addrDispFlags & TraceDqr::ADDRDISP_WIDTHAUTO) {
+		while (address > (0xffffffffffffffffllu >> (64 - addrPrintWidth*4))) {
+			addrPrintWidth += 1;
+		}
+	}
+
+    int n;
+
+	if ((addrPrintWidth > 8) && (addrDispFlags & TraceDqr::ADDRDISP_SEP)) {
+		n = snprintf(dst,len,"%0*x.%08x",addrPrintWidth-8,(uint32_t)(address >> 32),(uint32_t)address);
+	}
+	else {
+		n = snprintf(dst,len,"%0*llx",addrPrintWidth,address);
+	}
+
+    if ((labelLevel >= 1) && (addressLabel != nullptr)) {
+    	if (addressLabelOffset != 0) {
+		    snprintf(dst+n,len-n," <%s+%x>",addressLabel,addressLabelOffset);
+		}
+		else {
+		    snprintf(dst+n,len-n," <%s>",addressLabel);
+		}
+	}
+}
+
+std::string Instruction::instructionToString(int labelLevel)
+{
+	char dst[128];
+
+	instructionToText(dst,sizeof dst,labelLevel);
+
+	return std::string(dst);
+}
+
+void Instruction::instructionToText(char *dst,size_t len,int labelLevel)
+{
+	if (dst == nullptr) {
+		printf("Error: Instruction::instructionToText(): Argument dst is null\n");
+		return;
+	}
+
+	int n;
+
+	dst[0] = 0;
+
+//	should cache this (as part of other instruction stuff cached)!!
+
+	const char *text = instructionText;
+
+	if (text == nullptr) {
+		text = "";
+	}
+
+	if (instSize == 32) {
+		n = snprintf(dst,len,"%08x    %s",instruction,text);
+	}
+	else {
+		n = snprintf(dst,len,"%04x        %s",instruction,text);
 	}
 
 	if (haveOperandAddress) {
@@ -1102,6 +1653,10 @@ Symtab::Symtab(bfd *abfd)
 		printf("Error: Symtab::Symtab(): abfd was not specified\n");
 
 		symbol_table = nullptr;
+		nameHash = nullptr;
+		nameHashSize = 0;
+		addrIndex = nullptr;
+		numAddrs = 0;
 		vma = 0;
 		index = 0;
 		number_of_symbols = 0;
@@ -1112,6 +1667,12 @@ Symtab::Symtab(bfd *abfd)
 
 	this->abfd = abfd;
 
+	nameHash = nullptr;
+	nameHashSize = 0;
+	addrIndex = nullptr;
+	numAddrs = 0;
+	number_of_symbols = 0;
+
 	if ((bfd_get_file_flags (abfd) & HAS_SYMS)) {
 		long storage_needed;
 
@@ -1134,6 +1695,9 @@ Symtab::Symtab(bfd *abfd)
 			}
 
 			number_of_symbols = bfd_canonicalize_symtab(abfd,symbol_table);
+			if (number_of_symbols < 0) {
+				number_of_symbols = 0;
+			}
 		}
 		else {
 			symbol_table = nullptr;
@@ -1145,117 +1709,264 @@ Symtab::Symtab(bfd *abfd)
 
     vma = 0;
     index = 0;
+
+    buildIndexes();
 }
 
 Symtab::~Symtab()
 {
+	if (nameHash != nullptr) {
+		delete[] nameHash;
+		nameHash = nullptr;
+	}
+
+	if (addrIndex != nullptr) {
+		delete[] addrIndex;
+		addrIndex = nullptr;
+	}
+
 	if (symbol_table != nullptr) {
 		delete[] symbol_table;
 		symbol_table = nullptr;
 	}
 }
 
-TraceDqr::DQErr Symtab::getSymbolByName(char *symName, TraceDqr::ADDRESS &addr)
+unsigned int Symtab::hashName(const char *name)
 {
-	if (symName == nullptr) {
-		return TraceDqr::DQERR_ERR;
-	}
+	// FNV-1a
 
-	struct bfd_section *section;
-	bfd_vma section_base_vma;
+	unsigned int h = 2166136261u;
 
-	for (int i = 0; i < number_of_symbols; i++) {
-	    if (strcmp(symbol_table[i]->name,symName) == 0) {
-			section = symbol_table[i]->section;
-		    section_base_vma = section->vma;
+	while (*name != 0) {
+		h ^= (unsigned char)*name;
+		h *= 16777619u;
+		name += 1;
+	}
+
+	return h;
+}
 
-		    addr = symbol_table[i]->value + section_base_vma;
-		    printf("symtab::getsymbolbyname: found %s at %08llx\n",symName,addr);
+int Symtab::sym_addr_compare_func(const void *arg1,const void *arg2)
+{
+	const sym_addr_t *first = (const sym_addr_t *)arg1;
+	const sym_addr_t *second = (const sym_addr_t *)arg2;
 
-		    return TraceDqr::DQERR_OK;
-	    }
+	if (first->addr < second->addr) {
+		return -1;
 	}
 
-	printf("symtab::getsymbolbyname: %s not found\n",symName);
+	if (first->addr > second->addr) {
+		return 1;
+	}
 
-	return TraceDqr::DQERR_ERR;
+	return first->index - second->index;
 }
-const char *Symtab::getSymbolByAddress(TraceDqr::ADDRESS addr)
+
+void Symtab::buildIndexes()
 {
-	if (addr == 0) {
-		return nullptr;
+	if ((symbol_table == nullptr) || (number_of_symbols == 0)) {
+		return;
 	}
 
-	vma = addr;
+	// name hash. Symbols are inserted in table order and only the first symbol with a
+	// given name is kept, so lookups return the same symbol a linear search would
 
-	struct bfd_section *section;
-	bfd_vma section_base_vma;
+	nameHashSize = 16;
+	while (nameHashSize < number_of_symbols * 2) {
+		nameHashSize <<= 1;
+	}
 
-	index = 0;
+	nameHash = new (std::nothrow) int[nameHashSize];
+	if (nameHash == nullptr) {
+		printf("Error: Symtab::buildIndexes(): Could not allocate name hash\n");
 
-	for (int i = 0; i < number_of_symbols; i++) {
-		section = symbol_table[i]->section;
-	    section_base_vma = section->vma;
+		nameHashSize = 0;
+	}
+	else {
+		for (int i = 0; i < nameHashSize; i++) {
+			nameHash[i] = 0;
+		}
 
-	    if ((section_base_vma + symbol_table[i]->value == vma) && (symbol_table[i]->flags & BSF_FUNCTION)) {
-	    	index = i;
+		for (int i = 0; i < number_of_symbols; i++) {
+			const char *name = symbol_table[i]->name;
 
-	    	return symbol_table[i]->name;
-	    }
+			if (name == nullptr) {
+				continue;
+			}
+
+			unsigned int h = hashName(name) & (nameHashSize-1);
+
+			while ((nameHash[h] != 0) && (strcmp(symbol_table[nameHash[h]-1]->name,name) != 0)) {
+				h = (h + 1) & (nameHashSize-1);
+			}
+
+			if (nameHash[h] == 0) {
+				nameHash[h] = i+1;
+			}
+		}
 	}
 
-	return nullptr;
-}
+	// address index of function symbols
 
-// probably can delete the getNextSymboByAddress() funcs
+	numAddrs = 0;
 
-const char *Symtab::getNextSymbolByAddress()
-{
-	struct bfd_section *section;
-	bfd_vma section_base_vma;
+	for (int i = 0; i < number_of_symbols; i++) {
+		if (symbol_table[i]->flags & BSF_FUNCTION) {
+			numAddrs += 1;
+		}
+	}
 
-	for (int i = index+1; i < number_of_symbols; i++) {
-		section = symbol_table[i]->section;
-	    section_base_vma = section->vma;
+	if (numAddrs == 0) {
+		return;
+	}
 
-	    if ((section_base_vma + symbol_table[i]->value == vma) && (symbol_table[i]->flags & BSF_FUNCTION)) {
-	    	index = i;
+	addrIndex = new (std::nothrow) sym_addr_t[numAddrs];
+	if (addrIndex == nullptr) {
+		printf("Error: Symtab::buildIndexes(): Could not allocate address index\n");
 
-	    	return symbol_table[i]->name;
-	    }
+		numAddrs = 0;
+
+		return;
 	}
 
-	return nullptr;
-}
+	int n = 0;
 
-void Symtab::dump()
-{
-    printf("number_of_symbols: %ld\n",number_of_symbols);
+	for (int i = 0; i < number_of_symbols; i++) {
+		if (symbol_table[i]->flags & BSF_FUNCTION) {
+			addrIndex[n].addr = symbol_table[i]->section->vma + symbol_table[i]->value;
+			addrIndex[n].index = i;
+			n += 1;
+		}
+	}
 
-    for (int i = 0; i < number_of_symbols; i++) {
-      printf("symname: %s: \t",symbol_table[i]->name);
-      bfd_print_symbol_vandf(abfd,stdout,symbol_table[i]);
-      printf("\n");
-    }
+	qsort(addrIndex,numAddrs,sizeof addrIndex[0],sym_addr_compare_func);
 }
 
-bool ElfReader::init = false;
+// return the symbol table index of the first function symbol at addr with a table index
+// of at least first, or -1 if there is none
 
-ElfReader::ElfReader(char *elfname)
+int Symtab::findSymbolByAddress(TraceDqr::ADDRESS addr,int first)
 {
-  if (elfname == nullptr) {
-	printf("Error: ElfReader::ElfReader(): No elf file name specified\n");
-	status = TraceDqr::DQERR_ERR;
-	return;
-  }
+	int lo = 0;
+	int hi = numAddrs;
 
-  if (init == false) {
-	  // only call bfd_init once - not once per object
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
 
-	  bfd_init();
+		if ((addrIndex[mid].addr < addr) || ((addrIndex[mid].addr == addr) && (addrIndex[mid].index < first))) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	if ((lo < numAddrs) && (addrIndex[lo].addr == addr)) {
+		return addrIndex[lo].index;
+	}
+
+	return -1;
+}
+
+TraceDqr::DQErr Symtab::getSymbolByName(char *symName, TraceDqr::ADDRESS &addr)
+{
+	if (symName == nullptr) {
+		return TraceDqr::DQERR_ERR;
+	}
+
+	struct bfd_section *section;
+	bfd_vma section_base_vma;
+
+	if (nameHashSize > 0) {
+		unsigned int h = hashName(symName) & (nameHashSize-1);
+
+		while (nameHash[h] != 0) {
+			int i = nameHash[h]-1;
+
+			if (strcmp(symbol_table[i]->name,symName) == 0) {
+				section = symbol_table[i]->section;
+				section_base_vma = section->vma;
+
+				addr = symbol_table[i]->value + section_base_vma;
+				printf("symtab::getsymbolbyname: found %s at %08llx\n",symName,addr);
+
+				return TraceDqr::DQERR_OK;
+			}
+
+			h = (h + 1) & (nameHashSize-1);
+		}
+	}
+
+	printf("symtab::getsymbolbyname: %s not found\n",symName);
+
+	return TraceDqr::DQERR_ERR;
+}
+const char *Symtab::getSymbolByAddress(TraceDqr::ADDRESS addr)
+{
+	if (addr == 0) {
+		return nullptr;
+	}
+
+	vma = addr;
+
+	index = 0;
+
+	int i = findSymbolByAddress(vma,0);
+	if (i >= 0) {
+		index = i;
+
+		return symbol_table[i]->name;
+	}
+
+	return nullptr;
+}
+
+// probably can delete the getNextSymboByAddress() funcs
+
+const char *Symtab::getNextSymbolByAddress()
+{
+	int i = findSymbolByAddress(vma,index+1);
+	if (i >= 0) {
+		index = i;
+
+		return symbol_table[i]->name;
+	}
+
+	return nullptr;
+}
+
+void Symtab::dump()
+{
+    printf("number_of_symbols: %ld\n",number_of_symbols);
+
+    for (int i = 0; i < number_of_symbols; i++) {
+      printf("symname: %s: \t",symbol_table[i]->name);
+      bfd_print_symbol_vandf(abfd,stdout,symbol_table[i]);
+      printf("\n");
+    }
+}
+
+bool ElfReader::init = false;
+
+ElfReader::ElfReader(char *elfname)
+{
+  if (elfname == nullptr) {
+	printf("Error: ElfReader::ElfReader(): No elf file name specified\n");
+	status = TraceDqr::DQERR_ERR;
+	return;
+  }
+
+  std::lock_guard<std::recursive_mutex> lock(bfdMutex);
+
+  if (init == false) {
+	  // only call bfd_init once - not once per object
+
+	  bfd_init();
 	  init = true;
   }
 
+  image = nullptr;
+
   abfd = bfd_openr(elfname,NULL);
   if (abfd == nullptr) {
     status = TraceDqr::DQERR_ERR;
@@ -1318,15 +2029,26 @@ ElfReader::ElfReader(char *elfname)
   symtab = nullptr;
   codeSectionLst = nullptr;
 
+  // map the file once; code sections point into the mapping, and a Disassembler created on this
+  // bfd finds it through usrdata and shares it
+
+  image = elfImage::mapFile(elfname);
+  bfd_set_usrdata(abfd,image);
+
   for (asection *p = abfd->sections; p != NULL; p = p->next) {
 	  if (p->flags & SEC_CODE) {
           // found a code section, add to list
 
 		  section *sp = new section;
-		  sp->initSection(&codeSectionLst,p,false);
+		  sp->initSection(&codeSectionLst,p,false,image);
 	  }
   }
 
+  if (codeSections.init(codeSectionLst) != TraceDqr::DQERR_OK) {
+	  status = TraceDqr::DQERR_ERR;
+	  return;
+  }
+
   status = TraceDqr::DQERR_OK;
 }
 
@@ -1344,6 +2066,17 @@ ElfReader::~ElfReader()
 	}
 
 	if (abfd != nullptr) {
+		std::lock_guard<std::recursive_mutex> lock(bfdMutex);
+
+		// a Disassembler still holding the image keeps it mapped
+
+		if (image != nullptr) {
+			bfd_set_usrdata(abfd,nullptr);
+
+			image->release();
+			image = nullptr;
+		}
+
 		bfd_close(abfd);
 
 		abfd = nullptr;
@@ -1366,7 +2099,7 @@ TraceDqr::DQErr ElfReader::getInstructionByAddress(TraceDqr::ADDRESS addr,TraceD
 		return status;
 	}
 
-	sp = codeSectionLst->getSectionByAddress(addr);
+	sp = codeSections.getSectionByAddress(addr);
 	if (sp == nullptr) {
 		status = TraceDqr::DQERR_ERR;
 		return status;
@@ -1418,6 +2151,73 @@ TraceDqr::DQErr ElfReader::getInstructionByAddress(TraceDqr::ADDRESS addr,TraceD
 	return status;
 }
 
+// Same as getInstructionByAddress() followed by Disassembler::decodeInstruction(), but each address
+// is only decoded the first time. Check di->rc for decode errors
+
+TraceDqr::DQErr ElfReader::getDecodedInstruction(TraceDqr::ADDRESS addr,const decodedInst *&di)
+{
+	section *sp;
+	decodedInst *dp;
+
+	di = nullptr;
+
+	if (codeSectionLst == nullptr) {
+		status = TraceDqr::DQERR_ERR;
+		return status;
+	}
+
+	sp = codeSections.getSectionByAddress(addr);
+	if (sp == nullptr) {
+		status = TraceDqr::DQERR_ERR;
+		return status;
+	}
+
+	dp = sp->getDecodedInst(addr);
+	if (dp == nullptr) {
+		printf("Error: ElfReader::getDecodedInstruction(): Could not allocate decoded instruction table\n");
+
+		status = TraceDqr::DQERR_ERR;
+		return status;
+	}
+
+	if (dp->decoded == false) {
+		TraceDqr::RV_INST inst;
+		int inst_size;
+		TraceDqr::InstType inst_type;
+		TraceDqr::Reg rs1;
+		TraceDqr::Reg rd;
+		int32_t immediate;
+		bool isBranch;
+
+		status = getInstructionByAddress(addr,inst);
+		if (status != TraceDqr::DQERR_OK) {
+			return status;
+		}
+
+		inst_size = 0;
+		inst_type = TraceDqr::INST_UNKNOWN;
+		rs1 = TraceDqr::REG_unknown;
+		rd = TraceDqr::REG_unknown;
+		immediate = 0;
+		isBranch = false;
+
+		dp->rc = Disassembler::decodeInstruction(inst,archSize,inst_size,inst_type,rs1,rd,immediate,isBranch);
+		dp->inst = inst;
+		dp->size = inst_size;
+		dp->type = inst_type;
+		dp->rs1 = rs1;
+		dp->rd = rd;
+		dp->immediate = immediate;
+		dp->isBranch = isBranch;
+		dp->decoded = true;
+	}
+
+	di = dp;
+
+	status = TraceDqr::DQERR_OK;
+	return status;
+}
+
 TraceDqr::DQErr ElfReader::parseNLSStrings(TraceDqr::nlStrings *nlsStrings)
 {
 	asection *sp;
@@ -2028,6 +2828,202 @@ bool ITCPrint::haveITCPrintMsgs()
 	return false;
 }
 
+// Checkpoint the print buffers. Only the bytes from pbo through pbi are live (pbi holds the temporary
+// nul of a message in progress), and TsList entries are saved newest first with their message as an
+// offset into pbuff
+
+TraceDqr::DQErr ITCPrint::saveState(CheckpointBuffer &cb)
+{
+	bool ok;
+
+	ok = cb.put(&numCores,sizeof numCores);
+	ok = ok && cb.put(&buffSize,sizeof buffSize);
+
+	for (int core = 0; ok && (core < numCores); core++) {
+		int n = pbi[core] - pbo[core];
+		if (n < 0) {
+			n += buffSize;
+		}
+
+		if (n < buffSize - 1) {
+			n += 1;
+		}
+
+		ok = cb.put(&pbi[core],sizeof pbi[core]);
+		ok = ok && cb.put(&pbo[core],sizeof pbo[core]);
+		ok = ok && cb.put(&numMsgs[core],sizeof numMsgs[core]);
+		ok = ok && cb.put(&n,sizeof n);
+
+		for (int i = 0; ok && (i < n); i++) {
+			ok = cb.put(&pbuff[core][(pbo[core] + i) % buffSize],1);
+		}
+
+		int numTsl = 0;
+		TsList *tl = tsList[core];
+
+		if (tl != nullptr) {
+			do {
+				numTsl += 1;
+				tl = tl->next;
+			} while (tl != tsList[core]);
+		}
+
+		ok = ok && cb.put(&numTsl,sizeof numTsl);
+
+		tl = tsList[core];
+
+		for (int i = 0; ok && (i < numTsl); i++) {
+			int msgOffset = -1;
+
+			if (tl->message != nullptr) {
+				msgOffset = (int)(tl->message - pbuff[core]);
+			}
+
+			ok = cb.put(&tl->terminated,sizeof tl->terminated);
+			ok = ok && cb.put(&tl->startTime,sizeof tl->startTime);
+			ok = ok && cb.put(&tl->endTime,sizeof tl->endTime);
+			ok = ok && cb.put(&msgOffset,sizeof msgOffset);
+
+			tl = tl->next;
+		}
+	}
+
+	if (ok == false) {
+		printf("Error: ITCPrint::saveState(): Could not save print buffers\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	return TraceDqr::DQERR_OK;
+}
+
+// put all of a core's timestamp list entries on the free list
+
+void ITCPrint::freeTsList(int core)
+{
+	TsList *tl;
+
+	while ((tl = tsList[core]) != nullptr) {
+		if (tl->next == tl) {
+			tsList[core] = nullptr;
+		}
+		else {
+			tsList[core] = tl->next;
+			tl->prev->next = tl->next;
+			tl->next->prev = tl->prev;
+		}
+
+		tl->next = freeList;
+		tl->prev = nullptr;
+		freeList = tl;
+	}
+}
+
+// discard all buffered print data, complete or not, as if no ITC messages had been seen
+
+void ITCPrint::reset()
+{
+	for (int core = 0; core < numCores; core++) {
+		freeTsList(core);
+
+		pbi[core] = 0;
+		pbo[core] = 0;
+		numMsgs[core] = 0;
+	}
+}
+
+TraceDqr::DQErr ITCPrint::restoreState(CheckpointBuffer &cb)
+{
+	int cpNumCores;
+	int cpBuffSize;
+
+	if ((cb.get(&cpNumCores,sizeof cpNumCores) == false) || (cb.get(&cpBuffSize,sizeof cpBuffSize) == false)) {
+		printf("Error: ITCPrint::restoreState(): Checkpoint is truncated\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	if ((cpNumCores != numCores) || (cpBuffSize != buffSize)) {
+		printf("Error: ITCPrint::restoreState(): Checkpoint was saved with different itc print options\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	for (int core = 0; core < numCores; core++) {
+		TsList *tl;
+
+		freeTsList(core);
+
+		int n;
+		bool ok;
+
+		ok = cb.get(&pbi[core],sizeof pbi[core]);
+		ok = ok && cb.get(&pbo[core],sizeof pbo[core]);
+		ok = ok && cb.get(&numMsgs[core],sizeof numMsgs[core]);
+		ok = ok && cb.get(&n,sizeof n);
+
+		if (ok && ((pbi[core] < 0) || (pbi[core] >= buffSize) || (pbo[core] < 0) || (pbo[core] >= buffSize) || (n < 0) || (n > buffSize))) {
+			ok = false;
+		}
+
+		for (int i = 0; ok && (i < n); i++) {
+			ok = cb.get(&pbuff[core][(pbo[core] + i) % buffSize],1);
+		}
+
+		int numTsl = 0;
+
+		ok = ok && cb.get(&numTsl,sizeof numTsl);
+
+		for (int i = 0; ok && (i < numTsl); i++) {
+			int msgOffset;
+
+			if (freeList != nullptr) {
+				tl = freeList;
+				freeList = tl->next;
+			}
+			else {
+				tl = new TsList();
+			}
+
+			ok = cb.get(&tl->terminated,sizeof tl->terminated);
+			ok = ok && cb.get(&tl->startTime,sizeof tl->startTime);
+			ok = ok && cb.get(&tl->endTime,sizeof tl->endTime);
+			ok = ok && cb.get(&msgOffset,sizeof msgOffset);
+
+			if ((msgOffset >= 0) && (msgOffset < buffSize)) {
+				tl->message = &pbuff[core][msgOffset];
+			}
+			else {
+				tl->message = nullptr;
+			}
+
+			// append, so the first one saved (the newest) stays at the head
+
+			if (tsList[core] == nullptr) {
+				tl->next = tl;
+				tl->prev = tl;
+
+				tsList[core] = tl;
+			}
+			else {
+				tl->next = tsList[core];
+				tl->prev = tsList[core]->prev;
+
+				tsList[core]->prev->next = tl;
+				tsList[core]->prev = tl;
+			}
+		}
+
+		if (ok == false) {
+			printf("Error: ITCPrint::restoreState(): Bad or truncated checkpoint\n");
+
+			return TraceDqr::DQERR_ERR;
+		}
+	}
+
+	return TraceDqr::DQERR_OK;
+}
+
 int ITCPrint::getITCPrintMask()
 {
 	int mask = 0;
@@ -2323,6 +3319,7 @@ bool ITCPrint::flushITCPrintStr(uint8_t core, std::string &s, TraceDqr::TIMESTAM
 Analytics::Analytics()
 {
 	cores = 0;
+	parseOnly = false;
 	num_trace_msgs_all_cores = 0;
 	num_trace_bits_all_cores = 0;
 	num_trace_bits_all_cores_max = 0;
@@ -2816,6 +3813,33 @@ TraceDqr::DQErr Analytics::updateInstructionInfo(uint32_t core_id,uint32_t inst,
 	return status;
 }
 
+// instructions retired a basic block at a time. Conditional branches in them are counted by
+// updateBranchInfo(); other flags never end up in a block
+
+TraceDqr::DQErr Analytics::updateBlockInfo(uint32_t core_id,int numInst16,int numInst32)
+{
+	num_inst_all_cores += numInst16 + numInst32;
+	core[core_id].num_inst += numInst16 + numInst32;
+
+	num_inst16_all_cores += numInst16;
+	core[core_id].num_inst16 += numInst16;
+
+	num_inst32_all_cores += numInst32;
+	core[core_id].num_inst32 += numInst32;
+
+	return status;
+}
+
+// conditional branches retired without going through updateInstructionInfo()
+
+TraceDqr::DQErr Analytics::updateBranchInfo(uint32_t core_id,int numTaken,int numNotTaken)
+{
+	core[core_id].num_taken_branches += numTaken;
+	core[core_id].num_notTaken_branches += numNotTaken;
+
+	return status;
+}
+
 static void updateDst(int n, char *&dst,int &dst_len)
 {
 	if (n >= dst_len) {
@@ -2879,18 +3903,25 @@ void Analytics::toText(char *dst,int dst_len,int detailLevel)
 		updateDst(n,dst,dst_len);
 	}
 
+	if (parseOnly) {
+		n = snprintf(dst,dst_len,"Trace messages parsed only; instructions were not decoded\n");
+		updateDst(n,dst,dst_len);
+	}
+
 	if (detailLevel == 1) {
 		n = snprintf(dst,dst_len,"\n");
 		updateDst(n,dst,dst_len);
 
-		n = snprintf(dst,dst_len,"Instructions             Compressed                   RV32\n");
-		updateDst(n,dst,dst_len);
+		if (parseOnly == false) {
+			n = snprintf(dst,dst_len,"Instructions             Compressed                   RV32\n");
+			updateDst(n,dst,dst_len);
 
-		n = snprintf(dst,dst_len,"  %10u    %10u (%0.2f%%)    %10u (%0.2f%%)\n",num_inst_all_cores,num_inst16_all_cores,((float)num_inst16_all_cores)/num_inst_all_cores*100.0,num_inst32_all_cores,((float)num_inst32_all_cores)/num_inst_all_cores*100.0);
-		updateDst(n,dst,dst_len);
+			n = snprintf(dst,dst_len,"  %10u    %10u (%0.2f%%)    %10u (%0.2f%%)\n",num_inst_all_cores,num_inst16_all_cores,((float)num_inst16_all_cores)/num_inst_all_cores*100.0,num_inst32_all_cores,((float)num_inst32_all_cores)/num_inst_all_cores*100.0);
+			updateDst(n,dst,dst_len);
 
-		n = snprintf(dst,dst_len,"\n");
-		updateDst(n,dst,dst_len);
+			n = snprintf(dst,dst_len,"\n");
+			updateDst(n,dst,dst_len);
+		}
 
 		n = snprintf(dst,dst_len,"Number of Trace Msgs      Avg Length    Min Length    Max Length    Total Length\n");
 		updateDst(n,dst,dst_len);
@@ -2901,14 +3932,16 @@ void Analytics::toText(char *dst,int dst_len,int detailLevel)
 		n = snprintf(dst,dst_len,"\n");
 		updateDst(n,dst,dst_len);
 
-		n = snprintf(dst,dst_len,"Trace bits per instruction:     %5.2f\n",((float)num_trace_bits_all_cores)/num_inst_all_cores);
-		updateDst(n,dst,dst_len);
+		if (parseOnly == false) {
+			n = snprintf(dst,dst_len,"Trace bits per instruction:     %5.2f\n",((float)num_trace_bits_all_cores)/num_inst_all_cores);
+			updateDst(n,dst,dst_len);
 
-		n = snprintf(dst,dst_len,"Instructions per trace message: %5.2f\n",((float)num_inst_all_cores)/num_trace_msgs_all_cores);
-		updateDst(n,dst,dst_len);
+			n = snprintf(dst,dst_len,"Instructions per trace message: %5.2f\n",((float)num_inst_all_cores)/num_trace_msgs_all_cores);
+			updateDst(n,dst,dst_len);
 
-		n = snprintf(dst,dst_len,"Instructions per taken branch:  %5.2f\n",((float)num_inst_all_cores)/num_branches_all_cores);
-		updateDst(n,dst,dst_len);
+			n = snprintf(dst,dst_len,"Instructions per taken branch:  %5.2f\n",((float)num_inst_all_cores)/num_branches_all_cores);
+			updateDst(n,dst,dst_len);
+		}
 
 		if (srcBits > 0) {
 			n = snprintf(dst,dst_len,"Src bits %% of message:          %5.2f%%\n",((float)srcBits*num_trace_msgs_all_cores)/num_trace_bits_all_cores*100.0);
@@ -2951,72 +3984,74 @@ void Analytics::toText(char *dst,int dst_len,int detailLevel)
 		n = snprintf(dst,dst_len,"%s",tmp_dst);
 		updateDst(n,dst,dst_len);
 
-		position = sprintf(tmp_dst,"Instructions");
+		if (parseOnly == false) {
+			position = sprintf(tmp_dst,"Instructions");
 
-		t1 = 0;
-		ts = 0;
+			t1 = 0;
+			ts = 0;
 
-		for (int i = 0; i < DQR_MAXCORES; i++) {
-			if (cores & (1<<i)) {
+			for (int i = 0; i < DQR_MAXCORES; i++) {
+				if (cores & (1<<i)) {
+					while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
+					position += sprintf(tmp_dst+position,"%10u",core[i].num_inst);
+					t1 += core[i].num_inst;
+					ts += 1;
+				}
+			}
+
+			if (srcBits > 0) {
 				while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
-				position += sprintf(tmp_dst+position,"%10u",core[i].num_inst);
-				t1 += core[i].num_inst;
-				ts += 1;
+				position += sprintf(tmp_dst+position,"%10u",t1);
 			}
-		}
 
-		if (srcBits > 0) {
-			while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
-			position += sprintf(tmp_dst+position,"%10u",t1);
-		}
+			n = snprintf(dst,dst_len,"%s\n",tmp_dst);
+			updateDst(n,dst,dst_len);
 
-		n = snprintf(dst,dst_len,"%s\n",tmp_dst);
-		updateDst(n,dst,dst_len);
+			position = sprintf(tmp_dst,"  Compressed");
 
-		position = sprintf(tmp_dst,"  Compressed");
+			t2 = 0;
+			ts = 0;
 
-		t2 = 0;
-		ts = 0;
+			for (int i = 0; i < DQR_MAXCORES; i++) {
+				if (cores & (1<<i)) {
+					while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
+					position += sprintf(tmp_dst+position,"%10u (%0.2f%%)",core[i].num_inst16,((float)core[i].num_inst16)/core[i].num_inst*100.0);
+					t2 += core[i].num_inst16;
+					ts += 1;
+				}
+			}
 
-		for (int i = 0; i < DQR_MAXCORES; i++) {
-			if (cores & (1<<i)) {
+			if (srcBits > 0) {
 				while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
-				position += sprintf(tmp_dst+position,"%10u (%0.2f%%)",core[i].num_inst16,((float)core[i].num_inst16)/core[i].num_inst*100.0);
-				t2 += core[i].num_inst16;
-				ts += 1;
+				position += sprintf(tmp_dst+position,"%10u (%0.2f%%)",t2,((float)t2)/t1*100.0);
 			}
-		}
 
-		if (srcBits > 0) {
-			while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
-			position += sprintf(tmp_dst+position,"%10u (%0.2f%%)",t2,((float)t2)/t1*100.0);
-		}
+			n = snprintf(dst,dst_len,"%s\n",tmp_dst);
+			updateDst(n,dst,dst_len);
 
-		n = snprintf(dst,dst_len,"%s\n",tmp_dst);
-		updateDst(n,dst,dst_len);
+			position = sprintf(tmp_dst,"  RV32");
 
-		position = sprintf(tmp_dst,"  RV32");
+			t2 = 0;
+			ts = 0;
 
-		t2 = 0;
-		ts = 0;
+			for (int i = 0; i < DQR_MAXCORES; i++) {
+				if (cores & (1<<i)) {
+					while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
+					position += sprintf(tmp_dst+position,"%10u (%0.2f%%)",core[i].num_inst32,((float)core[i].num_inst32)/core[i].num_inst*100.0);
+					t2 += core[i].num_inst32;
+					ts += 1;
+				}
+			}
 
-		for (int i = 0; i < DQR_MAXCORES; i++) {
-			if (cores & (1<<i)) {
+			if (srcBits > 0) {
 				while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
-				position += sprintf(tmp_dst+position,"%10u (%0.2f%%)",core[i].num_inst32,((float)core[i].num_inst32)/core[i].num_inst*100.0);
-				t2 += core[i].num_inst32;
-				ts += 1;
+				position += sprintf(tmp_dst+position,"%10u (%0.2f%%)",t2,((float)t2)/t1*100.0);
 			}
-		}
 
-		if (srcBits > 0) {
-			while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
-			position += sprintf(tmp_dst+position,"%10u (%0.2f%%)",t2,((float)t2)/t1*100.0);
+			n = snprintf(dst,dst_len,"%s\n",tmp_dst);
+			updateDst(n,dst,dst_len);
 		}
 
-		n = snprintf(dst,dst_len,"%s\n",tmp_dst);
-		updateDst(n,dst,dst_len);
-
 		position = sprintf(tmp_dst,"Trace Msgs");
 
 		t1 = 0;
@@ -3477,84 +4512,86 @@ void Analytics::toText(char *dst,int dst_len,int detailLevel)
 		n = snprintf(dst,dst_len,"%s\n",tmp_dst);
 		updateDst(n,dst,dst_len);
 
-		position = sprintf(tmp_dst,"Trace Bits/Inst");
+		if (parseOnly == false) {
+			position = sprintf(tmp_dst,"Trace Bits/Inst");
 
-		ts = 0;
-		t1 = 0;
-		t2 = 0;
+			ts = 0;
+			t1 = 0;
+			t2 = 0;
 
-		for (int i = 0; i < DQR_MAXCORES; i++) {
-			if (cores & (1<<i)) {
+			for (int i = 0; i < DQR_MAXCORES; i++) {
+				if (cores & (1<<i)) {
+					while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
+					if (core[i].num_inst != 0) {
+						position += sprintf(tmp_dst+position,"%13.2f",((float)core[i].trace_bits)/core[i].num_inst);
+					}
+					else {
+						position += sprintf(tmp_dst+position,"          -");
+					}
+					t1 += core[i].trace_bits;
+					t2 += core[i].num_inst;
+					ts += 1;
+				}
+			}
+
+			if (srcBits > 0) {
 				while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
-				if (core[i].num_inst != 0) {
-					position += sprintf(tmp_dst+position,"%13.2f",((float)core[i].trace_bits)/core[i].num_inst);
+				if (t2 != 0) {
+					position += sprintf(tmp_dst+position,"%13.2f",((float)t1)/t2);
 				}
 				else {
 					position += sprintf(tmp_dst+position,"          -");
 				}
-				t1 += core[i].trace_bits;
-				t2 += core[i].num_inst;
-				ts += 1;
 			}
-		}
 
-		if (srcBits > 0) {
-			while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
-			if (t2 != 0) {
-				position += sprintf(tmp_dst+position,"%13.2f",((float)t1)/t2);
-			}
-			else {
-				position += sprintf(tmp_dst+position,"          -");
-			}
-		}
+			n = snprintf(dst,dst_len,"%s\n",tmp_dst);
+			updateDst(n,dst,dst_len);
 
-		n = snprintf(dst,dst_len,"%s\n",tmp_dst);
-		updateDst(n,dst,dst_len);
+			position = sprintf(tmp_dst,"Inst/Trace Msg");
 
-		position = sprintf(tmp_dst,"Inst/Trace Msg");
+			ts = 0;
+			t1 = 0;
 
-		ts = 0;
-		t1 = 0;
+			for (int i = 0; i < DQR_MAXCORES; i++) {
+				if (cores & (1<<i)) {
+					while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
+					position += sprintf(tmp_dst+position,"%13.2f",((float)core[i].num_inst)/core[i].num_trace_msgs);
+					t1 += core[i].num_trace_msgs;
+					ts += 1;
+				}
+			}
 
-		for (int i = 0; i < DQR_MAXCORES; i++) {
-			if (cores & (1<<i)) {
+			if (srcBits > 0) {
 				while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
-				position += sprintf(tmp_dst+position,"%13.2f",((float)core[i].num_inst)/core[i].num_trace_msgs);
-				t1 += core[i].num_trace_msgs;
-				ts += 1;
+				position += sprintf(tmp_dst+position,"%13.2f",((float)t2)/t1);
 			}
-		}
 
-		if (srcBits > 0) {
-			while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
-			position += sprintf(tmp_dst+position,"%13.2f",((float)t2)/t1);
-		}
+			n = snprintf(dst,dst_len,"%s\n",tmp_dst);
+			updateDst(n,dst,dst_len);
 
-		n = snprintf(dst,dst_len,"%s\n",tmp_dst);
-		updateDst(n,dst,dst_len);
+			position = sprintf(tmp_dst,"Inst/Taken Branch");
 
-		position = sprintf(tmp_dst,"Inst/Taken Branch");
+			ts = 0;
+			t1 = 0;
 
-		ts = 0;
-		t1 = 0;
+			for (int i = 0; i < DQR_MAXCORES; i++) {
+				if (cores & (1<<i)) {
+					while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
+					position += sprintf(tmp_dst+position,"%13.2f",((float)core[i].num_inst)/(core[i].num_trace_dbranch+core[i].num_trace_ibranch+core[i].num_trace_dbranchws+core[i].num_trace_ibranchws+core[i].num_trace_ihistory_taken_branches+core[i].num_trace_resourcefull_taken_branches));
+					t1 += core[i].num_trace_dbranch+core[i].num_trace_ibranch+core[i].num_trace_dbranchws+core[i].num_trace_ibranchws;
+					ts += 1;
+				}
+			}
 
-		for (int i = 0; i < DQR_MAXCORES; i++) {
-			if (cores & (1<<i)) {
+			if (srcBits > 0) {
 				while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
-				position += sprintf(tmp_dst+position,"%13.2f",((float)core[i].num_inst)/(core[i].num_trace_dbranch+core[i].num_trace_ibranch+core[i].num_trace_dbranchws+core[i].num_trace_ibranchws+core[i].num_trace_ihistory_taken_branches+core[i].num_trace_resourcefull_taken_branches));
-				t1 += core[i].num_trace_dbranch+core[i].num_trace_ibranch+core[i].num_trace_dbranchws+core[i].num_trace_ibranchws;
-				ts += 1;
+				position += sprintf(tmp_dst+position,"%13.2f",((float)t2)/t1);
 			}
-		}
 
-		if (srcBits > 0) {
-			while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
-			position += sprintf(tmp_dst+position,"%13.2f",((float)t2)/t1);
+			n = snprintf(dst,dst_len,"%s\n",tmp_dst);
+			updateDst(n,dst,dst_len);
 		}
 
-		n = snprintf(dst,dst_len,"%s\n",tmp_dst);
-		updateDst(n,dst,dst_len);
-
 		position = sprintf(tmp_dst,"Avg Msg Length");
 
 		ts = 0;
@@ -3955,133 +4992,135 @@ void Analytics::toText(char *dst,int dst_len,int detailLevel)
 		n = snprintf(dst,dst_len,"%s\n",tmp_dst);
 		updateDst(n,dst,dst_len);
 
-		position = sprintf(tmp_dst,"Taken Branches");
+		if (parseOnly == false) {
+			position = sprintf(tmp_dst,"Taken Branches");
 
-		ts = 0;
-		t2 = 0;
+			ts = 0;
+			t2 = 0;
 
-		for (int i = 0; i < DQR_MAXCORES; i++) {
-			if (cores & (1<<i)) {
-				while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
-				position += sprintf(tmp_dst+position,"%10u",core[i].num_taken_branches);
-				ts += 1;
+			for (int i = 0; i < DQR_MAXCORES; i++) {
+				if (cores & (1<<i)) {
+					while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
+					position += sprintf(tmp_dst+position,"%10u",core[i].num_taken_branches);
+					ts += 1;
+				}
 			}
-		}
 
-		n = snprintf(dst,dst_len,"%s\n",tmp_dst);
-		updateDst(n,dst,dst_len);
+			n = snprintf(dst,dst_len,"%s\n",tmp_dst);
+			updateDst(n,dst,dst_len);
 
-		position = sprintf(tmp_dst,"Not Taken Branches");
+			position = sprintf(tmp_dst,"Not Taken Branches");
 
-		ts = 0;
-		t2 = 0;
+			ts = 0;
+			t2 = 0;
 
-		for (int i = 0; i < DQR_MAXCORES; i++) {
-			if (cores & (1<<i)) {
-				while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
-				position += sprintf(tmp_dst+position,"%10u",core[i].num_notTaken_branches);
-				ts += 1;
+			for (int i = 0; i < DQR_MAXCORES; i++) {
+				if (cores & (1<<i)) {
+					while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
+					position += sprintf(tmp_dst+position,"%10u",core[i].num_notTaken_branches);
+					ts += 1;
+				}
 			}
-		}
 
-		n = snprintf(dst,dst_len,"%s\n",tmp_dst);
-		updateDst(n,dst,dst_len);
+			n = snprintf(dst,dst_len,"%s\n",tmp_dst);
+			updateDst(n,dst,dst_len);
 
-		position = sprintf(tmp_dst,"Calls");
+			position = sprintf(tmp_dst,"Calls");
 
-		ts = 0;
-		t2 = 0;
+			ts = 0;
+			t2 = 0;
 
-		for (int i = 0; i < DQR_MAXCORES; i++) {
-			if (cores & (1<<i)) {
-				while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
-				position += sprintf(tmp_dst+position,"%10u",core[i].num_calls);
-				ts += 1;
+			for (int i = 0; i < DQR_MAXCORES; i++) {
+				if (cores & (1<<i)) {
+					while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
+					position += sprintf(tmp_dst+position,"%10u",core[i].num_calls);
+					ts += 1;
+				}
 			}
-		}
 
-		n = snprintf(dst,dst_len,"%s\n",tmp_dst);
-		updateDst(n,dst,dst_len);
+			n = snprintf(dst,dst_len,"%s\n",tmp_dst);
+			updateDst(n,dst,dst_len);
 
-		position = sprintf(tmp_dst,"Returns");
+			position = sprintf(tmp_dst,"Returns");
 
-		ts = 0;
-		t2 = 0;
+			ts = 0;
+			t2 = 0;
 
-		for (int i = 0; i < DQR_MAXCORES; i++) {
-			if (cores & (1<<i)) {
-				while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
-				position += sprintf(tmp_dst+position,"%10u",core[i].num_returns);
-				ts += 1;
+			for (int i = 0; i < DQR_MAXCORES; i++) {
+				if (cores & (1<<i)) {
+					while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
+					position += sprintf(tmp_dst+position,"%10u",core[i].num_returns);
+					ts += 1;
+				}
 			}
-		}
 
-		n = snprintf(dst,dst_len,"%s\n",tmp_dst);
-		updateDst(n,dst,dst_len);
+			n = snprintf(dst,dst_len,"%s\n",tmp_dst);
+			updateDst(n,dst,dst_len);
 
-		position = sprintf(tmp_dst,"Swaps");
+			position = sprintf(tmp_dst,"Swaps");
 
-		ts = 0;
-		t2 = 0;
+			ts = 0;
+			t2 = 0;
 
-		for (int i = 0; i < DQR_MAXCORES; i++) {
-			if (cores & (1<<i)) {
-				while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
-				position += sprintf(tmp_dst+position,"%10u",core[i].num_swaps);
-				ts += 1;
+			for (int i = 0; i < DQR_MAXCORES; i++) {
+				if (cores & (1<<i)) {
+					while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
+					position += sprintf(tmp_dst+position,"%10u",core[i].num_swaps);
+					ts += 1;
+				}
 			}
-		}
 
-		n = snprintf(dst,dst_len,"%s\n",tmp_dst);
-		updateDst(n,dst,dst_len);
+			n = snprintf(dst,dst_len,"%s\n",tmp_dst);
+			updateDst(n,dst,dst_len);
 
-		position = sprintf(tmp_dst,"Exceptions");
+			position = sprintf(tmp_dst,"Exceptions");
 
-		ts = 0;
-		t2 = 0;
+			ts = 0;
+			t2 = 0;
 
-		for (int i = 0; i < DQR_MAXCORES; i++) {
-			if (cores & (1<<i)) {
-				while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
-				position += sprintf(tmp_dst+position,"%10u",core[i].num_exceptions);
-				ts += 1;
+			for (int i = 0; i < DQR_MAXCORES; i++) {
+				if (cores & (1<<i)) {
+					while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
+					position += sprintf(tmp_dst+position,"%10u",core[i].num_exceptions);
+					ts += 1;
+				}
 			}
-		}
 
-		n = snprintf(dst,dst_len,"%s\n",tmp_dst);
-		updateDst(n,dst,dst_len);
+			n = snprintf(dst,dst_len,"%s\n",tmp_dst);
+			updateDst(n,dst,dst_len);
 
-		position = sprintf(tmp_dst,"Exception Returns");
+			position = sprintf(tmp_dst,"Exception Returns");
 
-		ts = 0;
-		t2 = 0;
+			ts = 0;
+			t2 = 0;
 
-		for (int i = 0; i < DQR_MAXCORES; i++) {
-			if (cores & (1<<i)) {
-				while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
-				position += sprintf(tmp_dst+position,"%10u",core[i].num_exception_returns);
-				ts += 1;
+			for (int i = 0; i < DQR_MAXCORES; i++) {
+				if (cores & (1<<i)) {
+					while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
+					position += sprintf(tmp_dst+position,"%10u",core[i].num_exception_returns);
+					ts += 1;
+				}
 			}
-		}
 
-		n = snprintf(dst,dst_len,"%s\n",tmp_dst);
-		updateDst(n,dst,dst_len);
+			n = snprintf(dst,dst_len,"%s\n",tmp_dst);
+			updateDst(n,dst,dst_len);
 
-		position = sprintf(tmp_dst,"Interrupts");
+			position = sprintf(tmp_dst,"Interrupts");
 
-		ts = 0;
-		t2 = 0;
+			ts = 0;
+			t2 = 0;
 
-		for (int i = 0; i < DQR_MAXCORES; i++) {
-			if (cores & (1<<i)) {
-				while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
-				position += sprintf(tmp_dst+position,"%10u",core[i].num_interrupts);
-				ts += 1;
+			for (int i = 0; i < DQR_MAXCORES; i++) {
+				if (cores & (1<<i)) {
+					while (position < tabs[ts]) { position += sprintf(tmp_dst+position," "); }
+					position += sprintf(tmp_dst+position,"%10u",core[i].num_interrupts);
+					ts += 1;
+				}
 			}
-		}
 
-		n = snprintf(dst,dst_len,"%s\n",tmp_dst);
-		updateDst(n,dst,dst_len);
+			n = snprintf(dst,dst_len,"%s\n",tmp_dst);
+			updateDst(n,dst,dst_len);
+		}
 	}
 
 #ifdef DO_TIMES
@@ -5175,7 +6214,7 @@ void  NexusMessage::messageToText(char *dst,size_t dst_len,int level)
 	n = snprintf(dst,dst_len,"Msg # %d, ",msgNum);
 
 	if (level >= 3) {
-		n += snprintf(dst+n,dst_len-n,"Offset %d, ",offset);
+		n += snprintf(dst+n,dst_len-n,"Offset %llu, ",(unsigned long long)offset);
 
 		int i = 0;
 
@@ -6317,13 +7356,43 @@ int Count::consumeHistory(int core,bool &taken)
 		return 1;
 	}
 
-	taken = (history[core] & (1 << histBit[core])) != 0;
+	taken = (history[core] & (((uint64_t)1) << histBit[core])) != 0;
 
 	histBit[core] -= 1;
 
 	return 0;
 }
 
+int Count::consumeHistory(int core,int numBits)
+{
+	if (histBit[core] + 1 < numBits) {
+		return 1;
+	}
+
+	histBit[core] -= numBits;
+
+	return 0;
+}
+
+// number of taken branches in a row at the start of the history bits left
+
+int Count::getTakenRun(int core)
+{
+	if (histBit[core] < 0) {
+		return 0;
+	}
+
+	// move the next bit to bit 63. The bits shifted in are 0s, so the run stops at the end of the history
+
+	uint64_t notTaken = ~(history[core] << (63 - histBit[core]));
+
+	if (notTaken == 0) {
+		return 64;
+	}
+
+	return __builtin_clzll(notTaken);
+}
+
 int Count::consumeTakenCount(int core)
 {
 	if (takenCount[core] <= 0) {
@@ -6351,27 +7420,408 @@ void Count::dumpCounts(int core)
 	printf("Count::dumpCounts(): core: %d, i_cnt: %d, history: 0x%08llx, histBit: %d, takenCount: %d, notTakenCount: %d\n",core,i_cnt[core],history[core],histBit[core],takenCount[core],notTakenCount[core]);
 }
 
-SliceFileParser::SliceFileParser(char *filename,int srcBits)
+TraceDqr::DQErr Count::saveState(CheckpointBuffer &cb)
 {
-	if (filename == nullptr) {
-		printf("Error: SliceFileParser::SliceFaileParser(): No filename specified\n");
-		status = TraceDqr::DQERR_OK;
-		return;
-	}
+	bool ok;
 
-	srcbits = srcBits;
+	ok = cb.put(i_cnt,sizeof i_cnt);
+	ok = ok && cb.put(history,sizeof history);
+	ok = ok && cb.put(histBit,sizeof histBit);
+	ok = ok && cb.put(takenCount,sizeof takenCount);
+	ok = ok && cb.put(notTakenCount,sizeof notTakenCount);
 
-	msgSlices      = 0;
-	bitIndex       = 0;
+	if (ok == false) {
+		printf("Error: Count::saveState(): Could not save counts\n");
 
-	pendingMsgIndex = 0;
+		return TraceDqr::DQERR_ERR;
+	}
 
-	tfSize = 0;
-	bufferInIndex = 0;
-	bufferOutIndex = 0;
+	for (int i = 0; i < (int)(sizeof stack / sizeof stack[0]); i++) {
+		TraceDqr::DQErr rc;
+
+		rc = stack[i].saveState(cb);
+		if (rc != TraceDqr::DQERR_OK) {
+			return rc;
+		}
+	}
+
+	return TraceDqr::DQERR_OK;
+}
+
+TraceDqr::DQErr Count::restoreState(CheckpointBuffer &cb)
+{
+	bool ok;
+
+	ok = cb.get(i_cnt,sizeof i_cnt);
+	ok = ok && cb.get(history,sizeof history);
+	ok = ok && cb.get(histBit,sizeof histBit);
+	ok = ok && cb.get(takenCount,sizeof takenCount);
+	ok = ok && cb.get(notTakenCount,sizeof notTakenCount);
+
+	if (ok == false) {
+		printf("Error: Count::restoreState(): Checkpoint is truncated\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	for (int i = 0; i < (int)(sizeof stack / sizeof stack[0]); i++) {
+		TraceDqr::DQErr rc;
+
+		rc = stack[i].restoreState(cb);
+		if (rc != TraceDqr::DQERR_OK) {
+			return rc;
+		}
+	}
+
+	return TraceDqr::DQERR_OK;
+}
+
+BlockReader::BlockReader(int fd,bool compressed,int numBuffers,int bufferSize)
+{
+	this->fd = fd;
+	this->numBuffers = numBuffers;
+	this->bufferSize = bufferSize;
+
+	fillIndex = 0;
+	drainIndex = 0;
+	numFull = 0;
+	haveBlock = false;
+	eof = false;
+	readErr = false;
+	exitReader = false;
+	numBlocks = 0;
+	numStalls = 0;
+	reader = nullptr;
+	bufferLen = nullptr;
+	gz = nullptr;
+
+	if (compressed) {
+		// gz owns fd from here on
+
+		gz = gzdopen(fd,"rb");
+		if (gz == nullptr) {
+			printf("Error: BlockReader::BlockReader(): gzdopen() failed\n");
+
+			buffers = nullptr;
+
+			status = TraceDqr::DQERR_ERR;
+			return;
+		}
+
+		this->fd = -1;
+
+		gzbuffer(gz,256*1024);
+	}
+
+	buffers = new (std::nothrow) uint8_t*[numBuffers];
+	if (buffers == nullptr) {
+		printf("Error: BlockReader::BlockReader(): Could not allocate buffer list\n");
+
+		status = TraceDqr::DQERR_ERR;
+		return;
+	}
+
+	for (int i = 0; i < numBuffers; i++) {
+		buffers[i] = nullptr;
+	}
+
+	bufferLen = new (std::nothrow) int[numBuffers];
+	if (bufferLen == nullptr) {
+		printf("Error: BlockReader::BlockReader(): Could not allocate buffer lengths\n");
+
+		status = TraceDqr::DQERR_ERR;
+		return;
+	}
+
+	for (int i = 0; i < numBuffers; i++) {
+		buffers[i] = new (std::nothrow) uint8_t[bufferSize];
+		if (buffers[i] == nullptr) {
+			printf("Error: BlockReader::BlockReader(): Could not allocate buffer\n");
+
+			status = TraceDqr::DQERR_ERR;
+			return;
+		}
+
+		bufferLen[i] = 0;
+	}
+
+	reader = new (std::nothrow) std::thread(&BlockReader::readerThread,this);
+	if (reader == nullptr) {
+		printf("Error: BlockReader::BlockReader(): Could not create reader thread\n");
+
+		status = TraceDqr::DQERR_ERR;
+		return;
+	}
+
+	status = TraceDqr::DQERR_OK;
+}
+
+BlockReader::~BlockReader()
+{
+	if (reader != nullptr) {
+		mutex.lock();
+		exitReader = true;
+		mutex.unlock();
+
+		cv.notify_all();
+
+		reader->join();
+
+		delete reader;
+		reader = nullptr;
+	}
+
+	if (buffers != nullptr) {
+		for (int i = 0; i < numBuffers; i++) {
+			if (buffers[i] != nullptr) {
+				delete [] buffers[i];
+				buffers[i] = nullptr;
+			}
+		}
+
+		delete [] buffers;
+		buffers = nullptr;
+	}
+
+	if (bufferLen != nullptr) {
+		delete [] bufferLen;
+		bufferLen = nullptr;
+	}
+
+	if (gz != nullptr) {
+		gzclose(gz);
+		gz = nullptr;
+	}
+
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+}
+
+int BlockReader::readBlock(uint8_t *buff)
+{
+	// return whatever a single read() gives us, so data from a pipe is passed on as soon as
+	// it arrives instead of waiting for a full block. Returns bytes read, 0 at end of file
+	// (or if asked to exit), or -1 on error
+
+	if (gz != nullptr) {
+		int br;
+
+		br = gzread(gz,buff,bufferSize);
+		if (br < 0) {
+			int errnum;
+
+			printf("Error: BlockReader::readBlock(): %s\n",gzerror(gz,&errnum));
+		}
+		else if (br == 0) {
+			// gzclose() is the only place a gzip stream that ends early is reported
+
+			int rc;
+
+			rc = gzclose(gz);
+			gz = nullptr;
+
+			if (rc != Z_OK) {
+				printf("Error: BlockReader::readBlock(): compressed trace file is truncated or corrupt\n");
+
+				return -1;
+			}
+		}
+
+		return br;
+	}
+
+	for (;;) {
+#ifndef WINDOWS
+		// pipes and devices may never have data, so wait with a timeout and check for exit
+
+		struct pollfd pfd;
+		int rc;
+
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		rc = poll(&pfd,1,100);
+		if (rc < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			return -1;
+		}
+
+		if (rc == 0) {
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (exitReader) {
+				return 0;
+			}
+
+			continue;
+		}
+#endif // WINDOWS
+
+		int br;
+
+		br = read(fd,buff,bufferSize);
+		if ((br < 0) && (errno == EINTR)) {
+			continue;
+		}
+
+		return br;
+	}
+}
+
+void BlockReader::readerThread()
+{
+	for (;;) {
+		int index;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			while ((numFull >= numBuffers) && !exitReader) {
+				cv.wait(lock);
+			}
+
+			if (exitReader) {
+				return;
+			}
+
+			index = fillIndex;
+		}
+
+		// read without holding the lock so the parser can drain full buffers meanwhile
+
+		int br;
+
+		br = readBlock(buffers[index]);
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (br > 0) {
+			bufferLen[index] = br;
+			fillIndex = (fillIndex + 1) % numBuffers;
+			numFull += 1;
+			numBlocks += 1;
+		}
+		else if (br == 0) {
+			eof = true;
+		}
+		else {
+			readErr = true;
+		}
+
+		cv.notify_all();
+
+		if (br <= 0) {
+			return;
+		}
+	}
+}
+
+TraceDqr::DQErr BlockReader::nextBlock(uint8_t *&data,int &size)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	// hand the block we were holding back to the reader
+
+	if (haveBlock) {
+		haveBlock = false;
+		drainIndex = (drainIndex + 1) % numBuffers;
+		numFull -= 1;
+
+		cv.notify_all();
+	}
+
+	if ((numFull == 0) && !eof && !readErr) {
+		numStalls += 1;
+
+		while ((numFull == 0) && !eof && !readErr) {
+			cv.wait(lock);
+		}
+	}
+
+	if (numFull > 0) {
+		data = buffers[drainIndex];
+		size = bufferLen[drainIndex];
+		haveBlock = true;
+
+		return TraceDqr::DQERR_OK;
+	}
+
+	if (readErr) {
+		printf("Error: BlockReader::nextBlock(): read failed\n");
+
+		status = TraceDqr::DQERR_ERR;
+
+		return status;
+	}
+
+	return TraceDqr::DQERR_EOF;
+}
+
+TraceDqr::DQErr BlockReader::getStats(int64_t &blocks,int64_t &stalls)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	blocks = numBlocks;
+	stalls = numStalls;
+
+	return TraceDqr::DQERR_OK;
+}
+
+SliceFileParser::SliceFileParser(char *filename,int srcBits)
+{
+	if (filename == nullptr) {
+		printf("Error: SliceFileParser::SliceFaileParser(): No filename specified\n");
+		status = TraceDqr::DQERR_OK;
+		return;
+	}
+
+	srcbits = srcBits;
+
+	msgSlices      = 0;
+	bitIndex       = 0;
+
+	pendingMsgIndex = 0;
+
+	tfName = nullptr;
+	tfSize = 0;
+	tfRegular = false;
+	tfData = nullptr;
+	tfPos = 0;
+	scanPos = 0;
+	msgEnds = nullptr;
+	spans = nullptr;
+	numSpans = 0;
+	nextSpan = 0;
+	blockReader = nullptr;
+	blockData = nullptr;
+	blockSize = 0;
+	blockPos = 0;
+	bufferInIndex = 0;
+	bufferOutIndex = 0;
+	pushed = false;
+	endOfStream = false;
+	starved = false;
+	SWTsock = -1;
+
+	msg = msgBuffer;
 
 	eom = false;
 
+	if (strcmp(filename,DQR_PUSHED_TRACE) == 0) {
+		// no file or socket; Trace::pushTraceData() puts the trace in sockBuffer
+
+		pushed = true;
+
+		status = TraceDqr::DQERR_OK;
+		return;
+	}
+
 	int i;
 
 	// first lets see if it is a windows path
@@ -6492,19 +7942,19 @@ SliceFileParser::SliceFileParser(char *filename,int srcBits)
 		tfSize = 0;
 	}
 	else {
-		tf.open(filename, std::ios::in | std::ios::binary);
-		if (!tf) {
-			printf("Error: SliceFileParder(): could not open file %s for input\n",filename);
-			status = TraceDqr::DQERR_OPEN;
+		tfName = new (std::nothrow) char[strlen(filename)+1];
+		if (tfName == nullptr) {
+			printf("Error: SliceFileParser::SliceFileParser(): Could not allocate file name\n");
+			status = TraceDqr::DQERR_ERR;
 			return;
 		}
-		else {
-			status = TraceDqr::DQERR_OK;
-		}
 
-		tf.seekg (0, tf.end);
-		tfSize = tf.tellg();
-		tf.seekg (0, tf.beg);
+		strcpy(tfName,filename);
+
+		status = openTraceFile(filename);
+		if (status != TraceDqr::DQERR_OK) {
+			return;
+		}
 
 		msgOffset = 0;
 
@@ -6516,8 +7966,31 @@ SliceFileParser::SliceFileParser(char *filename,int srcBits)
 
 SliceFileParser::~SliceFileParser()
 {
-	if (tf.is_open()) {
-		tf.close();
+#ifndef WINDOWS
+	if (tfData != nullptr) {
+		munmap(tfData,tfSize);
+		tfData = nullptr;
+	}
+#endif // WINDOWS
+
+	if (blockReader != nullptr) {
+		delete blockReader;
+		blockReader = nullptr;
+	}
+
+	if (msgEnds != nullptr) {
+		delete [] msgEnds;
+		msgEnds = nullptr;
+	}
+
+	if (spans != nullptr) {
+		delete [] spans;
+		spans = nullptr;
+	}
+
+	if (tfName != nullptr) {
+		delete [] tfName;
+		tfName = nullptr;
 	}
 
 	if (SWTsock >= 0) {
@@ -6536,7 +8009,7 @@ TraceDqr::DQErr SliceFileParser::getNumBytesInSWTQ(int &numBytes)
 {
 	TraceDqr::DQErr rc;
 
-	if (SWTsock < 0) {
+	if ((SWTsock < 0) && (pushed == false)) {
 		return TraceDqr::DQERR_ERR;
 	}
 
@@ -6558,43 +8031,350 @@ TraceDqr::DQErr SliceFileParser::getNumBytesInSWTQ(int &numBytes)
 	return TraceDqr::DQERR_OK;
 }
 
-TraceDqr::DQErr SliceFileParser::getFileOffset(int &size,int &offset)
+// Copy pushed trace bytes into sockBuffer, as many as there is room for. Returns the number taken.
+// A size of 0 marks the end of the trace
+
+int SliceFileParser::pushData(const uint8_t *data,int size)
 {
-	if (!tf.is_open()) {
-		return TraceDqr::DQERR_ERR;
+	if (pushed == false) {
+		return 0;
 	}
 
-	size = tfSize;
-	offset = tf.tellg();
+	if (size <= 0) {
+		endOfStream = true;
+		return 0;
+	}
 
-	return TraceDqr::DQERR_OK;
-}
+	int n;
 
-void SliceFileParser::dump()
-{
-	//msg and msgSlices
+	for (n = 0; n < size; n++) {
+		int next = bufferInIndex + 1;
 
-	for (int i = 0; i < msgSlices; i++) {
-		std::cout << std::setw(2) << i+1;
-		std::cout << " | ";
-		std::cout << std::setfill('0');
-		std::cout << std::setw(2) << std::hex << int(msg[i] >> 2) << std::dec;
-		std::cout << std::setfill(' ');
-		std::cout << " | ";
-		std::cout << int((msg[i] >> 1) & 1);
-		std::cout << " ";
-		std::cout << int(msg[i] & 1);
-		std::cout << std::endl;
+		if ((size_t)next >= sizeof sockBuffer) {
+			next = 0;
+		}
+
+		// keep one byte free so a full buffer is not mistaken for an empty one
+
+		if (next == bufferOutIndex) {
+			break;
+		}
+
+		sockBuffer[bufferInIndex] = data[n];
+		bufferInIndex = next;
 	}
+
+	return n;
 }
 
-TraceDqr::DQErr SliceFileParser::parseICT(NexusMessage &nm,Analytics &analytics)
+// Wait up to timeoutMs (forever if < 0) for the trace to have more to read after a read ran out of
+// data. Returns DQERR_OK if there is, or DQERR_WOULDBLOCK on timeout. Pushed traces only get more when
+// pushData() is called, so they never wait
+
+TraceDqr::DQErr SliceFileParser::waitForData(int timeoutMs)
 {
-	TraceDqr::DQErr rc;
-	uint64_t   tmp;
-	int        width;
-	int        bits = 6;	// start bits at 6 to account for tcode
-	int        ts_bits = 0;
+	if ((starved == false) || (bufferInIndex != bufferOutIndex) || endOfStream) {
+		return TraceDqr::DQERR_OK;
+	}
+
+	if (SWTsock < 0) {
+		return TraceDqr::DQERR_WOULDBLOCK;
+	}
+
+	int rc;
+
+#ifdef WINDOWS
+	fd_set readfds;
+	struct timeval tv;
+
+	FD_ZERO(&readfds);
+	FD_SET(SWTsock,&readfds);
+
+	tv.tv_sec = timeoutMs / 1000;
+	tv.tv_usec = (timeoutMs % 1000) * 1000;
+
+	rc = select(SWTsock+1,&readfds,nullptr,nullptr,(timeoutMs < 0) ? nullptr : &tv);
+#else // WINDOWS
+	struct pollfd pfd;
+
+	pfd.fd = SWTsock;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	do {
+		rc = poll(&pfd,1,timeoutMs);
+	} while ((rc < 0) && (errno == EINTR));
+#endif // WINDOWS
+
+	if (rc < 0) {
+		printf("Error: SliceFileParser::waitForData(): Wait on trace socket failed\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	if (rc == 0) {
+		return TraceDqr::DQERR_WOULDBLOCK;
+	}
+
+	return TraceDqr::DQERR_OK;
+}
+
+TraceDqr::DQErr SliceFileParser::openTraceFile(char *filename)
+{
+	int fd;
+
+	if (strcmp(filename,"-") == 0) {
+		// standard input. Use a copy of the descriptor so it can be closed like any other
+
+#ifdef WINDOWS
+		setmode(0,O_BINARY);
+#endif // WINDOWS
+
+		fd = dup(0);
+	}
+	else {
+#ifdef WINDOWS
+		fd = open(filename,O_RDONLY | O_BINARY);
+#else // WINDOWS
+		fd = open(filename,O_RDONLY);
+#endif // WINDOWS
+	}
+
+	if (fd < 0) {
+		printf("Error: SliceFileParser::openTraceFile(): could not open file %s for input\n",filename);
+
+		return TraceDqr::DQERR_OPEN;
+	}
+
+	struct stat sb;
+
+	if (fstat(fd,&sb) < 0) {
+		printf("Error: SliceFileParser::openTraceFile(): fstat() failed for %s\n",filename);
+
+		close(fd);
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	bool compressed = false;
+
+	tfRegular = S_ISREG(sb.st_mode);
+
+	if (tfRegular) {
+		tfSize = sb.st_size;
+
+		// check for a gzip header
+
+		uint8_t magic[2];
+
+		if ((read(fd,magic,sizeof magic) == sizeof magic) && (magic[0] == 0x1f) && (magic[1] == 0x8b)) {
+			compressed = true;
+
+			tfSize = 0;	// uncompressed size not known
+		}
+
+		lseek(fd,0,SEEK_SET);
+	}
+	else {
+		tfSize = 0;	// pipe or device, size not known
+	}
+
+	tfPos = 0;
+
+#ifndef WINDOWS
+	// map regular files on local file systems. Files on network file systems are read through
+	// blockReader so reads overlap with decoding instead of stalling in page faults
+
+	if ((tfSize > 0) && !compressed && !isNetworkFile(fd)) {
+		void *p;
+
+		p = mmap(nullptr,tfSize,PROT_READ,MAP_PRIVATE,fd,0);
+		if (p != MAP_FAILED) {
+			madvise(p,tfSize,MADV_SEQUENTIAL);
+
+			// the mapping stays valid after the file is closed
+
+			close(fd);
+
+			tfData = (uint8_t*)p;
+
+			// a message is at least two slices, so a window holds at most half as many spans
+
+			msgEnds = new (std::nothrow) uint32_t[MSG_SCAN_WINDOW];
+			spans = new (std::nothrow) msgSpan[MSG_SCAN_WINDOW/2];
+
+			if ((msgEnds == nullptr) || (spans == nullptr)) {
+				printf("Error: SliceFileParser::openTraceFile(): Could not allocate message span buffers\n");
+
+				return TraceDqr::DQERR_ERR;
+			}
+
+			return TraceDqr::DQERR_OK;
+		}
+	}
+#endif // WINDOWS
+
+	// triple buffer 1MB blocks. blockReader owns fd from here on
+
+	blockReader = new (std::nothrow) BlockReader(fd,compressed,3,1024*1024);
+	if (blockReader == nullptr) {
+		printf("Error: SliceFileParser::openTraceFile(): Could not create BlockReader object\n");
+
+		close(fd);
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	if (blockReader->getStatus() != TraceDqr::DQERR_OK) {
+		delete blockReader;
+		blockReader = nullptr;
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	return TraceDqr::DQERR_OK;
+}
+
+// Position the parser so the next message is read starting at offset, such as a NexusMessage::offset.
+// Mapped files are positioned directly. Streamed files skip forward, and are reopened to go back, so
+// stdin, pipes and devices can only seek forward and sockets and pushed traces cannot seek at all
+
+TraceDqr::DQErr SliceFileParser::seek(int64_t offset)
+{
+	if ((SWTsock >= 0) || pushed) {
+		printf("Error: SliceFileParser::seek(): Cannot seek in a trace socket or pushed trace\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	if ((offset < 0) || ((tfSize > 0) && (offset > tfSize))) {
+		printf("Error: SliceFileParser::seek(): Offset %lld is outside of the trace file\n",(long long)offset);
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	if ((tfData == nullptr) && (offset < tfPos)) {
+		// reopening a pipe or device would not start over, it would continue from where it is now
+
+		if ((tfName == nullptr) || !tfRegular) {
+			printf("Error: SliceFileParser::seek(): Cannot seek backwards in trace that is not a regular file\n");
+
+			return TraceDqr::DQERR_ERR;
+		}
+
+		// start over from the beginning of the file
+
+		if (blockReader != nullptr) {
+			delete blockReader;
+			blockReader = nullptr;
+		}
+
+		blockData = nullptr;
+		blockSize = 0;
+		blockPos = 0;
+		tfPos = 0;
+
+		status = openTraceFile(tfName);
+		if (status != TraceDqr::DQERR_OK) {
+			return status;
+		}
+	}
+
+	if (tfData != nullptr) {
+		tfPos = offset;
+		scanPos = offset;
+		numSpans = 0;
+		nextSpan = 0;
+	}
+	else {
+		TraceDqr::DQErr rc;
+
+		while (tfPos < offset) {
+			if (blockPos >= blockSize) {
+				rc = blockReader->nextBlock(blockData,blockSize);
+				if (rc != TraceDqr::DQERR_OK) {
+					blockSize = 0;
+					blockPos = 0;
+
+					if (rc == TraceDqr::DQERR_EOF) {
+						printf("Error: SliceFileParser::seek(): Offset %lld is past the end of the trace\n",(long long)offset);
+					}
+
+					status = rc;
+
+					return rc;
+				}
+
+				blockPos = 0;
+			}
+
+			int n = blockSize - blockPos;
+
+			if (n > offset - tfPos) {
+				n = (int)(offset - tfPos);
+			}
+
+			blockPos += n;
+			tfPos += n;
+		}
+	}
+
+	pendingMsgIndex = 0;
+	msgSlices = 0;
+	bitIndex = 0;
+	eom = false;
+
+	status = TraceDqr::DQERR_OK;
+
+	return status;
+}
+
+TraceDqr::DQErr SliceFileParser::getFileOffset(int64_t &size,int64_t &offset)
+{
+	if ((tfData == nullptr) && (blockReader == nullptr)) {
+		return TraceDqr::DQERR_ERR;
+	}
+
+	size = tfSize;
+	offset = tfPos;
+
+	return TraceDqr::DQERR_OK;
+}
+
+TraceDqr::DQErr SliceFileParser::getReadStats(int64_t &blocks,int64_t &stalls)
+{
+	if (blockReader == nullptr) {
+		return TraceDqr::DQERR_ERR;
+	}
+
+	return blockReader->getStats(blocks,stalls);
+}
+
+void SliceFileParser::dump()
+{
+	//msg and msgSlices
+
+	for (int i = 0; i < msgSlices; i++) {
+		std::cout << std::setw(2) << i+1;
+		std::cout << " | ";
+		std::cout << std::setfill('0');
+		std::cout << std::setw(2) << std::hex << int(msg[i] >> 2) << std::dec;
+		std::cout << std::setfill(' ');
+		std::cout << " | ";
+		std::cout << int((msg[i] >> 1) & 1);
+		std::cout << " ";
+		std::cout << int(msg[i] & 1);
+		std::cout << std::endl;
+	}
+}
+
+TraceDqr::DQErr SliceFileParser::parseICT(NexusMessage &nm,Analytics &analytics)
+{
+	TraceDqr::DQErr rc;
+	uint64_t   tmp;
+	int        width;
+	int        bits = 6;	// start bits at 6 to account for tcode
+	int        ts_bits = 0;
 	int        addr_bits;
 
 	nm.tcode = TraceDqr::TCODE_INCIRCUITTRACE;
@@ -8108,24 +9888,85 @@ TraceDqr::DQErr SliceFileParser::parseDataAcquisition(NexusMessage &nm,Analytics
 	return status;
 }
 
+// Strip the MSEO bits off the slices of msg and pack the 6 bit payloads into msgBits, so fields
+// can be pulled out with a shift and mask instead of walking the slices. The MSEO bits are kept
+// as one bit per slice in msgFieldEnds and msgEOMs, so the end of a variable field is a count
+// trailing zeros away. Must be called once for each message before it is parsed
+
+void SliceFileParser::packMsg()
+{
+	for (int i = 0; i < (int)(sizeof msgBits / sizeof msgBits[0]); i++) {
+		msgBits[i] = 0;
+	}
+
+	msgFieldEnds = 0;
+	msgEOMs = 0;
+
+	int pos = 0;
+
+	for (int i = 0; i < msgSlices; i++) {
+		uint64_t slice = (uint64_t)(msg[i] >> 2);
+		int b = pos & 0x3f;
+
+		msgBits[pos >> 6] |= slice << b;
+
+		if (b > 64-6) {
+			// slice straddles two words
+
+			msgBits[(pos >> 6) + 1] |= slice >> (64-b);
+		}
+
+		switch (msg[i] & 0x03) {
+		case TraceDqr::MSEO_NORMAL:
+			break;
+		case TraceDqr::MSEO_END:
+			msgEOMs |= ((uint64_t)1) << i;
+			// fall through
+		default:
+			msgFieldEnds |= ((uint64_t)1) << i;
+			break;
+		}
+
+		pos += 6;
+	}
+}
+
+// return width (1 - 64) bits of msgBits starting at bit pos
+
+uint64_t SliceFileParser::getMsgBits(int pos,int width)
+{
+	int w = pos >> 6;
+	int b = pos & 0x3f;
+	uint64_t v;
+
+	v = msgBits[w] >> b;
+
+	if ((b != 0) && (b + width > 64)) {
+		v |= msgBits[w+1] << (64-b);
+	}
+
+	if (width < 64) {
+		v &= (((uint64_t)1) << width) - 1;
+	}
+
+	return v;
+}
+
 TraceDqr::DQErr SliceFileParser::parseFixedField(int width, uint64_t *val)
 {
-	if ((width <= 0) || (val == nullptr)) {
+	if ((width <= 0) || (width > 64) || (val == nullptr)) {
 		printf("Error: SliceFileParser::parseFixedField(): Bad width or val argument\n");
 
 		status = TraceDqr::DQERR_ERR;
 		return status;
 	}
 
-	uint64_t tmp_val = 0;
-
+	int start;
 	int i;
-	int b;
 
-	i = bitIndex / 6;
-	b = bitIndex % 6;
+	start = bitIndex;
 
-//	printf("parseFixedField(): bitIndex:%d, i:%d, b:%d, width: %d\n",bitIndex,i,b,width);
+//	printf("parseFixedField(): bitIndex:%d, width: %d\n",bitIndex,width);
 
 	bitIndex += width;
 
@@ -8140,49 +9981,18 @@ TraceDqr::DQErr SliceFileParser::parseFixedField(int width, uint64_t *val)
 		return TraceDqr::DQERR_EOM;
 	}
 
-	if (b+width > 6) {
-		// fixed field crossed byte boundry - get the bits at msg[i]
-
-		// work from lsb's to msb's
-
-		tmp_val = (uint64_t)(msg[i] >> (b+2));	// add 2 because of the mseo bits
-
-		int consumed = 6-b;
-		int remainingWidth = width - consumed;
-
-		i += 1;
-
-//		b = 0; comment this line out because we jsut don't use b anymore. It is 0 for the rest of the call
-
-		// get the middle bits
-
-		while (remainingWidth >= 6) {
-			tmp_val |= ((uint64_t)(msg[i] >> 2)) << consumed;
-			i += 1;
-			remainingWidth -= 6;
-			consumed += 6;
-		}
-
-		// now get the last bits
-
-		if (remainingWidth > 0) {
-			tmp_val |= ((uint64_t)(((uint8_t)(msg[i] << (6-remainingWidth))) >> (6-remainingWidth+2))) << consumed;
-		}
-
-		*val = tmp_val;
-	}
-	else {
-		uint8_t v;
+	*val = getMsgBits(start,width);
 
-		// strip off upper and lower bits not part of field
+	// eom comes from the slice the field ends in, or for a field that crosses slices and ends
+	// on a slice boundary, the slice after it
 
-		v = msg[i] << (6-(b+width));
-		v = v >> ((6-(b+width))+b+2);
+	i = start / 6;
 
-		*val = uint64_t(v);
+	if ((start - i*6) + width > 6) {
+		i = bitIndex / 6;
 	}
 
-	if ((msg[i] & 0x03) == TraceDqr::MSEO_END) {
+	if ((msgEOMs >> i) & 1) {
 		eom = true;
 	}
 
@@ -8198,11 +10008,10 @@ TraceDqr::DQErr SliceFileParser::parseVarField(uint64_t *val,int *width)
 	}
 
 	int i;
-	int b;
-	int w = 0;
+	int w;
+	uint64_t ends;
 
 	i = bitIndex / 6;
-	b = bitIndex % 6;
 
 	if (i >= msgSlices) {
 		// read past end of message
@@ -8212,46 +10021,40 @@ TraceDqr::DQErr SliceFileParser::parseVarField(uint64_t *val,int *width)
 		return TraceDqr::DQERR_EOM;
 	}
 
-	uint64_t v;
-
-	// strip off upper and lower bits not part of field
+	// the field runs to the next slice with MSEO bits set
 
-	w = 6-b;
+	ends = msgFieldEnds >> i;
 
-//	printf("parseVarField(): bitIndex:%d, i:%d, b:%d, width: %d\n",bitIndex,i,b,width);
+	if (ends == 0) {
+		// read past end of message
 
-	v = ((uint64_t)msg[i]) >> (b+2);
+		status = TraceDqr::DQERR_ERR;
 
-	while ((msg[i] & 0x03) == TraceDqr::MSEO_NORMAL) {
-		i += 1;
-		if (i >= msgSlices) {
-			// read past end of message
+		return TraceDqr::DQERR_ERR;
+	}
 
-			status = TraceDqr::DQERR_ERR;
+	i += __builtin_ctzll(ends);
 
-			return TraceDqr::DQERR_ERR;
-		}
+	w = (i+1)*6 - bitIndex;
 
-		v = v | ((((uint64_t)msg[i]) >> 2) << w);
-		w += 6;
-	}
+//	printf("parseVarField(): bitIndex:%d, i:%d, width: %d\n",bitIndex,i,w);
 
-	if (w > (int)sizeof(v)*8) {
-		// variable field overflowed size of v
+	if (w > (int)sizeof(*val)*8) {
+		// variable field overflowed size of val
 
 		status = TraceDqr::DQERR_ERR;
 
 		return TraceDqr::DQERR_ERR;
 	}
 
-	if ((msg[i] & 0x03) == TraceDqr::MSEO_END) {
+	if ((msgEOMs >> i) & 1) {
 		eom = true;
 	}
 
-	bitIndex += w;
-
+	*val = getMsgBits(bitIndex,w);
 	*width = w;
-	*val = v;
+
+	bitIndex += w;
 
 	return TraceDqr::DQERR_OK;
 }
@@ -8261,6 +10064,12 @@ TraceDqr::DQErr SliceFileParser::bufferSWT()
 	int br = 0;
 	int bytesToRead;
 
+	// pushed bytes are already in sockBuffer, and a closed socket has nothing more to read
+
+	if ((SWTsock < 0) || endOfStream) {
+		return TraceDqr::DQERR_OK;
+	}
+
 	// compute room in buffer for read
 
 	if (bufferInIndex == bufferOutIndex) {
@@ -8284,6 +10093,9 @@ TraceDqr::DQErr SliceFileParser::bufferSWT()
 			bufferInIndex = br;
 			bufferOutIndex = 0;
 		}
+		else if (br == 0) {
+			endOfStream = true;
+		}
 	}
 	else if (bufferInIndex < bufferOutIndex) {
 		// empty bytes is (bufferOutIndex - bufferInIndex) - 1
@@ -8306,6 +10118,9 @@ TraceDqr::DQErr SliceFileParser::bufferSWT()
 			if (br > 0) {
 				bufferInIndex += br;
 			}
+			else if (br == 0) {
+				endOfStream = true;
+			}
 		}
 	}
 	else if (bufferInIndex > bufferOutIndex) {
@@ -8355,12 +10170,18 @@ TraceDqr::DQErr SliceFileParser::bufferSWT()
 						if (br > 0) {
 							bufferInIndex = br;
 						}
+						else if (br == 0) {
+							endOfStream = true;
+						}
 					}
 				}
 				else {
 					bufferInIndex += br;
 				}
 			}
+			else if (br == 0) {
+				endOfStream = true;
+			}
 		}
 	}
 
@@ -8388,12 +10209,18 @@ TraceDqr::DQErr SliceFileParser::readBinaryMsg(bool &haveMsg)
 
 	haveMsg = false;
 
-	// if doing SWT, we may have ran out of data last time before getting an entire message
-	// and pendingMsgIndex may not be 0. If not 0, pick up where we left off
+	if (tfData != nullptr) {
+		return readMappedMsg(haveMsg);
+	}
+
+	starved = false;
+
+	// if doing SWT, we may have ran out of data last time before getting an entire message
+	// and pendingMsgIndex may not be 0. If not 0, pick up where we left off
 
 	if (pendingMsgIndex == 0) {
 		do {
-			if (SWTsock >= 0) {
+			if ((SWTsock >= 0) || pushed) {
 				// need a buffer to read from.
 
 				status = bufferSWT();
@@ -8403,6 +10230,13 @@ TraceDqr::DQErr SliceFileParser::readBinaryMsg(bool &haveMsg)
 				}
 
 				if (bufferInIndex == bufferOutIndex) {
+					if (endOfStream) {
+						status = TraceDqr::DQERR_EOF;
+					}
+					else {
+						starved = true;
+					}
+
 					return status;
 				}
 
@@ -8413,19 +10247,12 @@ TraceDqr::DQErr SliceFileParser::readBinaryMsg(bool &haveMsg)
 				}
 			}
 			else {
-				tf.read((char*)&msg[0],sizeof msg[0]);
-				if (!tf) {
-					if (tf.eof()) {
-						status = TraceDqr::DQERR_EOF;
-					}
-					else {
-						status = TraceDqr::DQERR_ERR;
-
+				status = readBlockByte(msg[0]);
+				if (status != TraceDqr::DQERR_OK) {
+					if (status != TraceDqr::DQERR_EOF) {
 						std::cout << "Error reading trace file\n";
 					}
 
-					tf.close();
-
 					return status;
 				}
 			}
@@ -8438,18 +10265,17 @@ TraceDqr::DQErr SliceFileParser::readBinaryMsg(bool &haveMsg)
 		pendingMsgIndex = 1;
 	}
 
-	if (SWTsock >= 0) {
+	if ((SWTsock >= 0) || pushed) {
 		msgOffset = 0;
 	}
 	else {
-		msgOffset = ((uint32_t)tf.tellg())-1;
-
+		msgOffset = tfPos-1;
 	}
 
 	bool done = false;
 
 	while (!done) {
-		if (pendingMsgIndex >= (int)(sizeof msg / sizeof msg[0])) {
+		if (pendingMsgIndex >= (int)(sizeof msgBuffer / sizeof msgBuffer[0])) {
 			if (SWTsock >= 0) {
 #ifdef WINDOWS
 				closesocket(SWTsock);
@@ -8458,9 +10284,6 @@ TraceDqr::DQErr SliceFileParser::readBinaryMsg(bool &haveMsg)
 #endif // WINDOWS
 				SWTsock = -1;
 			}
-			else {
-				tf.close();
-			}
 
 			std::cout << "Error: SliceFileParser::readBinaryMsg(): msg buffer overflow" << std::endl;
 
@@ -8471,7 +10294,7 @@ TraceDqr::DQErr SliceFileParser::readBinaryMsg(bool &haveMsg)
 			return TraceDqr::DQERR_ERR;
 		}
 
-		if (SWTsock >= 0) {
+		if ((SWTsock >= 0) || pushed) {
 			status = bufferSWT();
 
 			if (status != TraceDqr::DQERR_OK) {
@@ -8479,6 +10302,16 @@ TraceDqr::DQErr SliceFileParser::readBinaryMsg(bool &haveMsg)
 			}
 
 			if (bufferInIndex == bufferOutIndex) {
+				if (endOfStream) {
+					printf("Info: SliceFileParser::readBinaryMsg(): Last message in trace stream is incomplete\n");
+
+					pendingMsgIndex = 0;
+					status = TraceDqr::DQERR_EOF;
+				}
+				else {
+					starved = true;
+				}
+
 				return status;
 			}
 
@@ -8490,9 +10323,9 @@ TraceDqr::DQErr SliceFileParser::readBinaryMsg(bool &haveMsg)
 			}
 		}
 		else {
-			tf.read((char*)&msg[pendingMsgIndex],sizeof msg[0]);
-			if (!tf) {
-				if (tf.eof()) {
+			status = readBlockByte(msg[pendingMsgIndex]);
+			if (status != TraceDqr::DQERR_OK) {
+				if (status == TraceDqr::DQERR_EOF) {
 					printf("Info: SliceFileParser::readBinaryMsg(): Last message in trace file is incomplete\n");
 					if (globalDebugFlag) {
 						printf("Debug: Raw msg:");
@@ -8501,16 +10334,11 @@ TraceDqr::DQErr SliceFileParser::readBinaryMsg(bool &haveMsg)
 						}
 						printf("\n");
 					}
-					status = TraceDqr::DQERR_EOF;
 				}
 				else {
-					status = TraceDqr::DQERR_ERR;
-
 					std::cout << "Error reading trace file\n";
 				}
 
-				tf.close();
-
 				return status;
 			}
 		}
@@ -8532,236 +10360,896 @@ TraceDqr::DQErr SliceFileParser::readBinaryMsg(bool &haveMsg)
 	return TraceDqr::DQERR_OK;
 }
 
-TraceDqr::DQErr SliceFileParser::readNextByte(uint8_t *byte)
+TraceDqr::DQErr SliceFileParser::readBlockByte(uint8_t &byte)
 {
-	char c;
+	if (blockPos >= blockSize) {
+		TraceDqr::DQErr rc;
 
-	// strip white space, comments, cr, and lf
+		rc = blockReader->nextBlock(blockData,blockSize);
+		if (rc != TraceDqr::DQERR_OK) {
+			blockSize = 0;
+			blockPos = 0;
 
-	enum {
-		STRIPPING_WHITESPACE,
-		STRIPPING_COMMENT,
-		STRIPPING_DONE
-	} ss = STRIPPING_WHITESPACE;
+			return rc;
+		}
 
-	do {
-		tf.read((char*)&c,sizeof c);
-		if (!tf) {
-			tf.close();
+		blockPos = 0;
+	}
+
+	byte = blockData[blockPos];
+
+	blockPos += 1;
+	tfPos += 1;
+
+	return TraceDqr::DQERR_OK;
+}
+
+// Split the next MSG_SCAN_WINDOW bytes of the mapped trace file into message spans. Message ends
+// are found in bulk by findMsgEnds(). Each span runs from the first slice after the previous end
+// that can start a message (not 0x00, MSEO bits 0b00) to the next end, and remembers where the
+// bytes skipped to get there start so readMappedMsg() can report them in order. Anything else (a
+// message longer than msgBuffer, or one that runs off the end of the window) is left for the
+// byte at a time code in readMappedMsg()
+
+void SliceFileParser::scanMappedMsgs()
+{
+	numSpans = 0;
+	nextSpan = 0;
+
+	int64_t windowSize = tfSize - scanPos;
+
+	if (windowSize > MSG_SCAN_WINDOW) {
+		windowSize = MSG_SCAN_WINDOW;
+	}
+
+	if (windowSize <= 0) {
+		return;
+	}
+
+	const uint8_t *window = &tfData[scanPos];
+	int numEnds;
+	int start = 0;
+	int skip = 0;
+
+	numEnds = findMsgEnds(window,(int)windowSize,msgEnds);
+
+	for (int i = 0; i < numEnds; i++) {
+		int end = msgEnds[i];
+		int s = start;
+
+		while ((s < end) && ((window[s] == 0x00) || ((window[s] & 0x03) != TraceDqr::MSEO_NORMAL))) {
+			s += 1;
+		}
+
+		if ((s < end) && ((end - s + 1) > (int)(sizeof msgBuffer / sizeof msgBuffer[0]))) {
+			break;
+		}
+
+		// if no message starts before end, end itself is skipped too
+
+		if (s < end) {
+			spans[numSpans].skip = scanPos + skip;
+			spans[numSpans].offset = scanPos + s;
+			spans[numSpans].length = end - s + 1;
+			numSpans += 1;
+
+			skip = end + 1;
+		}
+
+		start = end + 1;
+	}
+
+	// skipped bytes after the last span are looked at again with the next window
+
+	scanPos += skip;
+}
+
+TraceDqr::DQErr SliceFileParser::readMappedMsg(bool &haveMsg)
+{
+	// same as readBinaryMsg(), but msg is pointed at the message in the mapped file
+	// instead of copying it into msgBuffer a byte at a time
+
+	haveMsg = false;
+
+	if (nextSpan >= numSpans) {
+		tfPos = scanPos;
+
+		scanMappedMsgs();
+	}
+
+	if (nextSpan < numSpans) {
+		for (int64_t i = spans[nextSpan].skip; i < spans[nextSpan].offset; i++) {
+			if (tfData[i] != 0xff) {
+				printf("Info: SliceFileParser::readMappedMsg(): Skipping: %02x\n",tfData[i]);
+			}
+		}
+
+		msgOffset = spans[nextSpan].offset;
+		msgSlices = spans[nextSpan].length;
+		nextSpan += 1;
+
+		msg = &tfData[msgOffset];
+		tfPos = msgOffset + msgSlices;
+
+		eom = false;
+		bitIndex = 0;
+
+		haveMsg = true;
+
+		return TraceDqr::DQERR_OK;
+	}
+
+	// nothing the scan could split. Do it a byte at a time
 
-			status = TraceDqr::DQERR_EOF;
+	tfPos = scanPos;
 
-			return TraceDqr::DQERR_EOF;
+	// strip off end of message or end of var bytes
+
+	while ((tfPos < tfSize) && ((tfData[tfPos] == 0x00) || ((tfData[tfPos] & 0x03) != TraceDqr::MSEO_NORMAL))) {
+		if (tfData[tfPos] != 0xff) {
+			printf("Info: SliceFileParser::readMappedMsg(): Skipping: %02x\n",tfData[tfPos]);
 		}
 
-		switch (ss) {
-		case STRIPPING_WHITESPACE:
-			switch (c) {
-			case '#':
-				ss = STRIPPING_COMMENT;
+		tfPos += 1;
+	}
+
+	if (tfPos >= tfSize) {
+		status = TraceDqr::DQERR_EOF;
+
+		return status;
+	}
+
+	int64_t msgEnd = tfPos;
+	int64_t maxEnd = tfPos + (int64_t)(sizeof msgBuffer / sizeof msgBuffer[0]);
+
+	if (maxEnd > tfSize) {
+		maxEnd = tfSize;
+	}
+
+	while ((msgEnd < maxEnd) && ((tfData[msgEnd] & 0x03) != TraceDqr::MSEO_END)) {
+		msgEnd += 1;
+	}
+
+	if (msgEnd >= tfSize) {
+		printf("Info: SliceFileParser::readMappedMsg(): Last message in trace file is incomplete\n");
+		if (globalDebugFlag) {
+			printf("Debug: Raw msg:");
+			for (int64_t i = tfPos; i < tfSize; i++) {
+				printf(" %02x",tfData[i]);
+			}
+			printf("\n");
+		}
+
+		tfPos = tfSize;
+
+		status = TraceDqr::DQERR_EOF;
+
+		return status;
+	}
+
+	if (msgEnd >= maxEnd) {
+		std::cout << "Error: SliceFileParser::readMappedMsg(): msg buffer overflow" << std::endl;
+
+		status = TraceDqr::DQERR_ERR;
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	msg = &tfData[tfPos];
+	msgOffset = tfPos;
+	msgSlices = msgEnd - tfPos + 1;
+
+	tfPos = msgEnd + 1;
+	scanPos = tfPos;
+
+	eom = false;
+	bitIndex = 0;
+
+	haveMsg = true;
+
+	return TraceDqr::DQERR_OK;
+}
+
+TraceDqr::DQErr SliceFileParser::readNextTraceMsg(NexusMessage &nm,Analytics &analytics,bool &haveMsg)	// generator to read trace messages one at a time
+{
+	haveMsg = false;
+
+	if (status != TraceDqr::DQERR_OK) {
+		return status;
+	}
+
+	TraceDqr::DQErr rc;
+	uint64_t   val;
+	uint8_t    tcode;
+	int getMsgAttempt = 3;
+
+	do { // we will try to get a good message most 3 times if there are problems
+
+		status = TraceDqr::DQERR_OK;
+
+		// read from file, store in object, compute and fill out full fields, such as address and more later
+
+		rc = readBinaryMsg(haveMsg);
+		if (rc != TraceDqr::DQERR_OK) {
+
+			// all errors from readBinaryMsg() are non-recoverable.
+
+			if (rc != TraceDqr::DQERR_EOF) {
+				std::cout << "Error: (): readNextTraceMsg() returned error " << rc << std::endl;
+			}
+
+			status = rc;
+
+			return status;
+		}
+
+		if (haveMsg == false) {
+			return TraceDqr::DQERR_OK;
+		}
+
+		packMsg();
+
+		nm.offset = msgOffset;
+
+		int i = 0;
+
+		do {
+			nm.rawData[i] = msg[i];
+			i += 1;
+		} while (((size_t)i < sizeof nm.rawData / sizeof nm.rawData[0]) && ((msg[i-1] & 0x03) != TraceDqr::MSEO_END));
+
+		rc = parseFixedField(6, &val);
+		if (rc == TraceDqr::DQERR_OK) {
+			tcode = (uint8_t)val;
+
+			switch (tcode) {
+			case TraceDqr::TCODE_DEBUG_STATUS:
+				std::cout << "Unsupported debug status trace message\n";
+				rc = TraceDqr::DQERR_ERR;
 				break;
-			case '\n':
-			case '\r':
-			case ' ':
-			case '\t':
+			case TraceDqr::TCODE_DEVICE_ID:
+				std::cout << "Unsupported device id trace message\n";
+				rc = TraceDqr::DQERR_ERR;
+				break;
+			case TraceDqr::TCODE_OWNERSHIP_TRACE:
+				rc = parseOwnershipTrace(nm,analytics);
+				break;
+			case TraceDqr::TCODE_DIRECT_BRANCH:
+				rc = parseDirectBranch(nm,analytics);
+				break;
+			case TraceDqr::TCODE_INDIRECT_BRANCH:
+				rc = parseIndirectBranch(nm,analytics);
+				break;
+			case TraceDqr::TCODE_DATA_WRITE:
+				std::cout << "unsupported data write trace message\n";
+				rc = TraceDqr::DQERR_ERR;
+				break;
+			case TraceDqr::TCODE_DATA_READ:
+				std::cout << "unsupported data read trace message\n";
+				rc = TraceDqr::DQERR_ERR;
+				break;
+			case TraceDqr::TCODE_DATA_ACQUISITION:
+				rc = parseDataAcquisition(nm,analytics);
+				break;
+			case TraceDqr::TCODE_ERROR:
+				rc = parseError(nm,analytics);
+				break;
+			case TraceDqr::TCODE_SYNC:
+				rc = parseSync(nm,analytics);
+				break;
+			case TraceDqr::TCODE_CORRECTION:
+				std::cout << "Unsupported correction trace message\n";
+				rc = TraceDqr::DQERR_ERR;
+				break;
+			case TraceDqr::TCODE_DIRECT_BRANCH_WS:
+				rc = parseDirectBranchWS(nm,analytics);
+				break;
+			case TraceDqr::TCODE_INDIRECT_BRANCH_WS:
+				rc = parseIndirectBranchWS(nm,analytics);
+				break;
+			case TraceDqr::TCODE_DATA_WRITE_WS:
+				std::cout << "unsupported data write with sync trace message\n";
+				rc = TraceDqr::DQERR_ERR;
+				break;
+			case TraceDqr::TCODE_DATA_READ_WS:
+				std::cout << "unsupported data read with sync trace message\n";
+				rc = TraceDqr::DQERR_ERR;
+				break;
+			case TraceDqr::TCODE_WATCHPOINT:
+				std::cout << "unsupported watchpoint trace message\n";
+				rc = TraceDqr::DQERR_ERR;
+				break;
+			case TraceDqr::TCODE_CORRELATION:
+				rc = parseCorrelation(nm,analytics);
+				break;
+			case TraceDqr::TCODE_AUXACCESS_WRITE:
+				rc = parseAuxAccessWrite(nm,analytics);
+				break;
+			case TraceDqr::TCODE_INDIRECTBRANCHHISTORY:
+				rc = parseIndirectHistory(nm,analytics);
+				break;
+			case TraceDqr::TCODE_INDIRECTBRANCHHISTORY_WS:
+				rc = parseIndirectHistoryWS(nm,analytics);
+				break;
+			case TraceDqr::TCODE_INCIRCUITTRACE:
+				rc = parseICT(nm,analytics);
+				break;
+			case TraceDqr::TCODE_INCIRCUITTRACE_WS:
+				rc = parseICTWS(nm,analytics);
+				break;
+			case TraceDqr::TCODE_RESOURCEFULL:
+				rc = parseResourceFull(nm,analytics);
 				break;
 			default:
-				ss = STRIPPING_DONE;
+				std::cout << "Error: readNextTraceMsg(): Unknown TCODE " << std::hex << int(tcode) << std::dec << std::endl;
+				rc = TraceDqr::DQERR_ERR;
 			}
-			break;
-		case STRIPPING_COMMENT:
-			switch (c) {
-			case '\n':
-				ss = STRIPPING_WHITESPACE;
-				break;
+
+			if (rc != TraceDqr::DQERR_OK) {
+				std::cout << "Error possibly due to corrupted first message in trace - skipping message" << std::endl;
+			}
+		}
+
+		getMsgAttempt -= 1;
+	} while ((rc != TraceDqr::DQERR_OK) && (getMsgAttempt > 0));
+
+	status = rc;
+
+	return status;
+}
+
+TraceIndex::TraceIndex()
+{
+	status = TraceDqr::DQERR_OK;
+	idxData = nullptr;
+	idxSize = 0;
+	mapped = false;
+	header = nullptr;
+	entries = nullptr;
+}
+
+TraceIndex::~TraceIndex()
+{
+	cleanUp();
+}
+
+void TraceIndex::cleanUp()
+{
+	if (idxData != nullptr) {
+#ifndef WINDOWS
+		if (mapped) {
+			munmap(idxData,idxSize);
+		}
+		else {
+			delete [] idxData;
+		}
+#else // WINDOWS
+		delete [] idxData;
+#endif // WINDOWS
+
+		idxData = nullptr;
+	}
+
+	idxSize = 0;
+	mapped = false;
+	header = nullptr;
+	entries = nullptr;
+}
+
+// Read trace file tf_name once and build an index of its sync messages in memory. Timestamps are
+// rebuilt per core the same way Trace::processTS() does, so an index entry has the time the decoder
+// would have at that message
+
+TraceDqr::DQErr TraceIndex::build(char *tf_name,int srcBits,int tsSize)
+{
+	cleanUp();
+
+	status = TraceDqr::DQERR_ERR;
+
+	if (tf_name == nullptr) {
+		printf("Error: TraceIndex::build(): Bad tf_name argument\n");
+
+		return status;
+	}
+
+	if ((tsSize <= 0) || (tsSize > 64)) {
+		printf("Error: TraceIndex::build(): Bad tsSize %d\n",tsSize);
+
+		return status;
+	}
+
+	SliceFileParser *sfp;
+
+	sfp = new (std::nothrow) SliceFileParser(tf_name,srcBits);
+	if (sfp == nullptr) {
+		printf("Error: TraceIndex::build(): Could not create SliceFileParser object\n");
+
+		return status;
+	}
+
+	if (sfp->getErr() != TraceDqr::DQERR_OK) {
+		printf("Error: TraceIndex::build(): Could not open trace file %s\n",tf_name);
+
+		delete sfp;
+		sfp = nullptr;
+
+		return status;
+	}
+
+	int64_t maxEntries = 1024;
+
+	idxData = new (std::nothrow) uint8_t[sizeof(TraceIndexHeader) + maxEntries * sizeof(TraceIndexEntry)];
+	if (idxData == nullptr) {
+		printf("Error: TraceIndex::build(): Could not allocate index\n");
+
+		delete sfp;
+		sfp = nullptr;
+
+		return status;
+	}
+
+	TraceIndexHeader *hdr = (TraceIndexHeader*)idxData;
+
+	memset(hdr,0,sizeof *hdr);
+
+	memcpy(hdr->magic,DQR_INDEX_MAGIC,sizeof hdr->magic);
+	hdr->version = DQR_INDEX_VERSION;
+	hdr->entrySize = sizeof(TraceIndexEntry);
+	hdr->srcBits = srcBits;
+	hdr->tsSize = tsSize;
+
+	Analytics analytics;
+	NexusMessage nm;
+	TraceDqr::TIMESTAMP lastTime[DQR_MAXCORES];
+	TraceDqr::TIMESTAMP maxTime;
+	TraceDqr::DQErr rc;
+	bool haveMsg;
+
+	for (int i = 0; i < DQR_MAXCORES; i++) {
+		lastTime[i] = 0;
+	}
+
+	maxTime = 0;
+
+	rc = TraceDqr::DQERR_OK;
+
+	while (rc == TraceDqr::DQERR_OK) {
+		rc = sfp->readNextTraceMsg(nm,analytics,haveMsg);
+		if ((rc != TraceDqr::DQERR_OK) || (haveMsg == false)) {
+			continue;
+		}
+
+		if (nm.coreId >= DQR_MAXCORES) {
+			printf("Error: TraceIndex::build(): Core %d out of range\n",nm.coreId);
+
+			rc = TraceDqr::DQERR_ERR;
+			continue;
+		}
+
+		hdr->numMsgs += 1;
+
+		bool isSync;
+		TraceDqr::TIMESTAMP ts;
+
+		switch (nm.tcode) {
+		case TraceDqr::TCODE_SYNC:
+		case TraceDqr::TCODE_DIRECT_BRANCH_WS:
+		case TraceDqr::TCODE_INDIRECT_BRANCH_WS:
+		case TraceDqr::TCODE_INDIRECTBRANCHHISTORY_WS:
+		case TraceDqr::TCODE_INCIRCUITTRACE_WS:
+			isSync = true;
+
+			if (nm.haveTimestamp) {
+				// full timestamp. Add in the wrap from previous timestamps
+
+				ts = nm.timestamp + (lastTime[nm.coreId] & (~((((TraceDqr::TIMESTAMP)1) << tsSize)-1)));
+
+				if (ts < lastTime[nm.coreId]) {
+					ts += ((TraceDqr::TIMESTAMP)1) << tsSize;
+				}
+
+				lastTime[nm.coreId] = ts;
 			}
 			break;
+		case TraceDqr::TCODE_ERROR:
+			// messages have been missed. Time is unknown until the next sync
+
+			isSync = false;
+			lastTime[nm.coreId] = 0;
+			break;
 		default:
+			isSync = false;
+
+			if (nm.haveTimestamp && (lastTime[nm.coreId] != 0)) {
+				ts = lastTime[nm.coreId] ^ nm.timestamp;
+
+				if (ts < lastTime[nm.coreId]) {
+					ts += ((TraceDqr::TIMESTAMP)1) << tsSize;
+				}
+
+				lastTime[nm.coreId] = ts;
+			}
 			break;
 		}
-	} while (ss != STRIPPING_DONE);
 
-	// now try to get two hex digits
+		if (lastTime[nm.coreId] > maxTime) {
+			maxTime = lastTime[nm.coreId];
+		}
+
+		if (isSync == false) {
+			continue;
+		}
+
+		if ((int64_t)hdr->numEntries >= maxEntries) {
+			uint8_t *newData;
+
+			newData = new (std::nothrow) uint8_t[sizeof(TraceIndexHeader) + maxEntries * 2 * sizeof(TraceIndexEntry)];
+			if (newData == nullptr) {
+				printf("Error: TraceIndex::build(): Could not allocate index\n");
+
+				rc = TraceDqr::DQERR_ERR;
+				continue;
+			}
+
+			memcpy(newData,idxData,sizeof(TraceIndexHeader) + maxEntries * sizeof(TraceIndexEntry));
+
+			delete [] idxData;
+
+			idxData = newData;
+			hdr = (TraceIndexHeader*)idxData;
+			maxEntries *= 2;
+		}
+
+		TraceIndexEntry *entry = &((TraceIndexEntry*)(idxData + sizeof(TraceIndexHeader)))[hdr->numEntries];
+
+		memset(entry,0,sizeof *entry);
+
+		entry->offset = nm.offset;
+		entry->faddr = nm.getF_Addr() << 1;
+		entry->timestamp = lastTime[nm.coreId];
+		entry->maxTimestamp = maxTime;
+		for (int i = 0; i < DQR_MAXCORES; i++) {
+			entry->coreTime[i] = lastTime[i];
+		}
+		entry->msgNum = nm.msgNum;
+		entry->core = nm.coreId;
+		entry->tcode = (uint8_t)nm.tcode;
+
+		hdr->numEntries += 1;
+	}
+
+	int64_t size;
+	int64_t offset;
+
+	sfp->getFileOffset(size,offset);
+
+	hdr->traceSize = offset;
+
+	delete sfp;
+	sfp = nullptr;
+
+	if (rc != TraceDqr::DQERR_EOF) {
+		printf("Error: TraceIndex::build(): Error reading trace file %s\n",tf_name);
+
+		cleanUp();
+
+		return status;
+	}
+
+	idxSize = sizeof(TraceIndexHeader) + hdr->numEntries * sizeof(TraceIndexEntry);
+	header = hdr;
+	entries = (const TraceIndexEntry*)(idxData + sizeof(TraceIndexHeader));
+
+	status = TraceDqr::DQERR_OK;
+
+	return status;
+}
+
+TraceDqr::DQErr TraceIndex::save(char *idx_name)
+{
+	if (idx_name == nullptr) {
+		printf("Error: TraceIndex::save(): Bad idx_name argument\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	if (header == nullptr) {
+		printf("Error: TraceIndex::save(): No index to save\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	int fd;
+
+#ifdef WINDOWS
+	fd = ::open(idx_name,O_WRONLY | O_CREAT | O_TRUNC | O_BINARY,S_IRUSR | S_IWUSR);
+#else // WINDOWS
+	fd = ::open(idx_name,O_WRONLY | O_CREAT | O_TRUNC,S_IRUSR | S_IWUSR);
+#endif // WINDOWS
+
+	if (fd < 0) {
+		printf("Error: TraceIndex::save(): Couldn't open file %s for writing\n",idx_name);
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	bool writeErr = false;
+	int64_t n = 0;
+	int rc;
+
+	while ((n < idxSize) && (writeErr == false)) {
+		rc = write(fd,&idxData[n],(idxSize - n > 0x40000000) ? 0x40000000 : (unsigned int)(idxSize - n));
+		if (rc <= 0) {
+			writeErr = true;
+		}
+		else {
+			n += rc;
+		}
+	}
+
+	if (close(fd) != 0) {
+		writeErr = true;
+	}
+
+	if (writeErr) {
+		printf("Error: TraceIndex::save(): Error writing file %s\n",idx_name);
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	return TraceDqr::DQERR_OK;
+}
+
+TraceDqr::DQErr TraceIndex::open(char *idx_name)
+{
+	cleanUp();
+
+	status = TraceDqr::DQERR_ERR;
+
+	if (idx_name == nullptr) {
+		printf("Error: TraceIndex::open(): Bad idx_name argument\n");
+
+		return status;
+	}
+
+	int fd;
+
+#ifdef WINDOWS
+	fd = ::open(idx_name,O_RDONLY | O_BINARY);
+#else // WINDOWS
+	fd = ::open(idx_name,O_RDONLY);
+#endif // WINDOWS
+
+	if (fd < 0) {
+		printf("Error: TraceIndex::open(): Could not open index file %s\n",idx_name);
+
+		return status;
+	}
+
+	struct stat st;
+
+	if ((fstat(fd,&st) != 0) || (st.st_size < (off_t)sizeof(TraceIndexHeader))) {
+		printf("Error: TraceIndex::open(): %s is not an index file\n",idx_name);
+
+		close(fd);
+
+		return status;
+	}
+
+	idxSize = st.st_size;
+
+#ifndef WINDOWS
+	void *p;
+
+	p = mmap(nullptr,idxSize,PROT_READ,MAP_PRIVATE,fd,0);
+	if (p != MAP_FAILED) {
+		idxData = (uint8_t*)p;
+		mapped = true;
+	}
+#endif // WINDOWS
+
+	if (idxData == nullptr) {
+		idxData = new (std::nothrow) uint8_t[idxSize];
+		if (idxData == nullptr) {
+			printf("Error: TraceIndex::open(): Could not allocate %lld bytes for index\n",(long long)idxSize);
+
+			close(fd);
+
+			return status;
+		}
+
+		int64_t n = 0;
+		int rc;
+
+		while (n < idxSize) {
+			rc = read(fd,&idxData[n],(idxSize - n > 0x40000000) ? 0x40000000 : (unsigned int)(idxSize - n));
+			if (rc <= 0) {
+				printf("Error: TraceIndex::open(): Error reading index file %s\n",idx_name);
+
+				close(fd);
+				cleanUp();
+
+				return status;
+			}
+
+			n += rc;
+		}
+	}
+
+	close(fd);
 
-	tf.read((char*)&c,sizeof c);
-	if (!tf) {
-		tf.close();
+	header = (const TraceIndexHeader*)idxData;
 
-		status = TraceDqr::DQERR_EOF;
+	if (memcmp(header->magic,DQR_INDEX_MAGIC,sizeof header->magic) != 0) {
+		printf("Error: TraceIndex::open(): %s is not an index file\n",idx_name);
 
-		return TraceDqr::DQERR_EOF;
+		cleanUp();
+
+		return status;
 	}
 
-	int hd;
-	uint8_t hn;
+	if ((header->version != DQR_INDEX_VERSION) || (header->entrySize != sizeof(TraceIndexEntry))) {
+		printf("Error: TraceIndex::open(): %s is an unsupported index version (%u)\n",idx_name,header->version);
 
-	hd = atoh(c);
-	if (hd < 0) {
-		status = TraceDqr::DQERR_ERR;
+		cleanUp();
 
-		return TraceDqr::DQERR_ERR;
+		return status;
 	}
 
-	hn = hd << 4;
+	if (header->numEntries > (uint64_t)(idxSize - sizeof(TraceIndexHeader)) / sizeof(TraceIndexEntry)) {
+		printf("Error: TraceIndex::open(): Index file %s is truncated\n",idx_name);
 
-	hd = atoh(c);
-	if (hd < 0) {
-		status = TraceDqr::DQERR_ERR;
+		cleanUp();
 
-		return TraceDqr::DQERR_ERR;
+		return status;
 	}
 
-	hn = hn | hd;
+	entries = (const TraceIndexEntry*)(idxData + sizeof(TraceIndexHeader));
 
-	*byte = hn;
+	status = TraceDqr::DQERR_OK;
 
-	return TraceDqr::DQERR_OK;
+	return status;
 }
 
-TraceDqr::DQErr SliceFileParser::readNextTraceMsg(NexusMessage &nm,Analytics &analytics,bool &haveMsg)	// generator to read trace messages one at a time
+const TraceIndexEntry *TraceIndex::getEntry(int64_t index)
 {
-	haveMsg = false;
+	if ((entries == nullptr) || (index < 0) || (index >= (int64_t)header->numEntries)) {
+		return nullptr;
+	}
 
-	if (status != TraceDqr::DQERR_OK) {
-		return status;
+	return &entries[index];
+}
+
+// Return the index of the last entry with key <= value, or -1 if there is none. Entries are in trace
+// file order, so offsets and message numbers increase. Per core timestamps need not increase across
+// cores (or after a wrap or error), so KEY_TIMESTAMP searches the running maximum, which gives the last
+// sync point before any message later than value
+
+int64_t TraceIndex::findEntry(Key key,uint64_t value)
+{
+	if (entries == nullptr) {
+		return -1;
 	}
 
-	TraceDqr::DQErr rc;
-	uint64_t   val;
-	uint8_t    tcode;
-	int getMsgAttempt = 3;
+	int64_t lo = 0;
+	int64_t hi = header->numEntries;
 
-	do { // we will try to get a good message most 3 times if there are problems
+	// find the first entry with key > value
 
-		status = TraceDqr::DQERR_OK;
+	while (lo < hi) {
+		int64_t mid = lo + (hi - lo) / 2;
+		uint64_t k;
 
-		// read from file, store in object, compute and fill out full fields, such as address and more later
+		switch (key) {
+		case KEY_OFFSET:
+			k = entries[mid].offset;
+			break;
+		case KEY_MSGNUM:
+			k = entries[mid].msgNum;
+			break;
+		case KEY_TIMESTAMP:
+		default:
+			k = entries[mid].maxTimestamp;
+			break;
+		}
 
-		rc = readBinaryMsg(haveMsg);
-		if (rc != TraceDqr::DQERR_OK) {
+		if (k <= value) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
 
-			// all errors from readBinaryMsg() are non-recoverable.
+	return lo - 1;
+}
 
-			if (rc != TraceDqr::DQERR_EOF) {
-				std::cout << "Error: (): readNextTraceMsg() returned error " << rc << std::endl;
-			}
+CheckpointBuffer::CheckpointBuffer()
+{
+	wrData = nullptr;
+	rdData = nullptr;
+	allocSize = 0;
+	size = 0;
+	pos = 0;
+}
 
-			status = rc;
+CheckpointBuffer::CheckpointBuffer(const uint8_t *data,int64_t size)
+{
+	wrData = nullptr;
+	rdData = data;
+	allocSize = 0;
+	this->size = (data != nullptr) ? size : 0;
+	pos = 0;
+}
 
-			return status;
+CheckpointBuffer::~CheckpointBuffer()
+{
+	if (wrData != nullptr) {
+		delete [] wrData;
+		wrData = nullptr;
+	}
+
+	rdData = nullptr;
+}
+
+bool CheckpointBuffer::put(const void *src,int64_t n)
+{
+	if (rdData != nullptr) {
+		return false;
+	}
+
+	if (size + n > allocSize) {
+		int64_t newSize = (allocSize > 0) ? allocSize * 2 : 4096;
+
+		while (size + n > newSize) {
+			newSize *= 2;
 		}
 
-		if (haveMsg == false) {
-			return TraceDqr::DQERR_OK;
+		uint8_t *newData = new (std::nothrow) uint8_t[newSize];
+		if (newData == nullptr) {
+			return false;
 		}
 
-		nm.offset = msgOffset;
+		if (wrData != nullptr) {
+			memcpy(newData,wrData,size);
+			delete [] wrData;
+		}
 
-		int i = 0;
+		wrData = newData;
+		allocSize = newSize;
+	}
 
-		do {
-			nm.rawData[i] = msg[i];
-			i += 1;
-		} while (((size_t)i < sizeof nm.rawData / sizeof nm.rawData[0]) && ((msg[i-1] & 0x03) != TraceDqr::MSEO_END));
+	memcpy(&wrData[size],src,n);
+	size += n;
 
-		rc = parseFixedField(6, &val);
-		if (rc == TraceDqr::DQERR_OK) {
-			tcode = (uint8_t)val;
+	return true;
+}
 
-			switch (tcode) {
-			case TraceDqr::TCODE_DEBUG_STATUS:
-				std::cout << "Unsupported debug status trace message\n";
-				rc = TraceDqr::DQERR_ERR;
-				break;
-			case TraceDqr::TCODE_DEVICE_ID:
-				std::cout << "Unsupported device id trace message\n";
-				rc = TraceDqr::DQERR_ERR;
-				break;
-			case TraceDqr::TCODE_OWNERSHIP_TRACE:
-				rc = parseOwnershipTrace(nm,analytics);
-				break;
-			case TraceDqr::TCODE_DIRECT_BRANCH:
-				rc = parseDirectBranch(nm,analytics);
-				break;
-			case TraceDqr::TCODE_INDIRECT_BRANCH:
-				rc = parseIndirectBranch(nm,analytics);
-				break;
-			case TraceDqr::TCODE_DATA_WRITE:
-				std::cout << "unsupported data write trace message\n";
-				rc = TraceDqr::DQERR_ERR;
-				break;
-			case TraceDqr::TCODE_DATA_READ:
-				std::cout << "unsupported data read trace message\n";
-				rc = TraceDqr::DQERR_ERR;
-				break;
-			case TraceDqr::TCODE_DATA_ACQUISITION:
-				rc = parseDataAcquisition(nm,analytics);
-				break;
-			case TraceDqr::TCODE_ERROR:
-				rc = parseError(nm,analytics);
-				break;
-			case TraceDqr::TCODE_SYNC:
-				rc = parseSync(nm,analytics);
-				break;
-			case TraceDqr::TCODE_CORRECTION:
-				std::cout << "Unsupported correction trace message\n";
-				rc = TraceDqr::DQERR_ERR;
-				break;
-			case TraceDqr::TCODE_DIRECT_BRANCH_WS:
-				rc = parseDirectBranchWS(nm,analytics);
-				break;
-			case TraceDqr::TCODE_INDIRECT_BRANCH_WS:
-				rc = parseIndirectBranchWS(nm,analytics);
-				break;
-			case TraceDqr::TCODE_DATA_WRITE_WS:
-				std::cout << "unsupported data write with sync trace message\n";
-				rc = TraceDqr::DQERR_ERR;
-				break;
-			case TraceDqr::TCODE_DATA_READ_WS:
-				std::cout << "unsupported data read with sync trace message\n";
-				rc = TraceDqr::DQERR_ERR;
-				break;
-			case TraceDqr::TCODE_WATCHPOINT:
-				std::cout << "unsupported watchpoint trace message\n";
-				rc = TraceDqr::DQERR_ERR;
-				break;
-			case TraceDqr::TCODE_CORRELATION:
-				rc = parseCorrelation(nm,analytics);
-				break;
-			case TraceDqr::TCODE_AUXACCESS_WRITE:
-				rc = parseAuxAccessWrite(nm,analytics);
-				break;
-			case TraceDqr::TCODE_INDIRECTBRANCHHISTORY:
-				rc = parseIndirectHistory(nm,analytics);
-				break;
-			case TraceDqr::TCODE_INDIRECTBRANCHHISTORY_WS:
-				rc = parseIndirectHistoryWS(nm,analytics);
-				break;
-			case TraceDqr::TCODE_INCIRCUITTRACE:
-				rc = parseICT(nm,analytics);
-				break;
-			case TraceDqr::TCODE_INCIRCUITTRACE_WS:
-				rc = parseICTWS(nm,analytics);
-				break;
-			case TraceDqr::TCODE_RESOURCEFULL:
-				rc = parseResourceFull(nm,analytics);
-				break;
-			default:
-				std::cout << "Error: readNextTraceMsg(): Unknown TCODE " << std::hex << int(tcode) << std::dec << std::endl;
-				rc = TraceDqr::DQERR_ERR;
-			}
+bool CheckpointBuffer::get(void *dst,int64_t n)
+{
+	if ((rdData == nullptr) || (n < 0) || (pos + n > size)) {
+		return false;
+	}
 
-			if (rc != TraceDqr::DQERR_OK) {
-				std::cout << "Error possibly due to corrupted first message in trace - skipping message" << std::endl;
-			}
-		}
+	memcpy(dst,&rdData[pos],n);
+	pos += n;
 
-		getMsgAttempt -= 1;
-	} while ((rc != TraceDqr::DQERR_OK) && (getMsgAttempt > 0));
+	return true;
+}
 
-	status = rc;
+// Hand the written checkpoint to the caller, who deletes it with delete []
 
-	return status;
+uint8_t *CheckpointBuffer::release(int64_t &size)
+{
+	uint8_t *data = wrData;
+
+	size = this->size;
+
+	wrData = nullptr;
+	allocSize = 0;
+	this->size = 0;
+
+	return data;
 }
 
 ObjFile::ObjFile(char *ef_name)
@@ -8917,7 +11405,13 @@ TraceDqr::DQErr ObjFile::sourceInfo(TraceDqr::ADDRESS addr,Instruction &instInfo
 		return status;
 	}
 
-	disassembler->Disassemble(addr);
+	const Instruction &dis = disassembler->getInstructionInfo();
+
+	instInfo.addrSize = dis.addrSize;
+	instInfo.addrDispFlags = dis.addrDispFlags;
+	instInfo.addrPrintWidth = dis.addrPrintWidth;
+
+	disassembler->Disassemble(addr,Disassembler::DIS_ALL,&instInfo,&srcInfo);
 
 	s = disassembler->getStatus();
 	if (s != TraceDqr::DQERR_OK) {
@@ -8925,10 +11419,6 @@ TraceDqr::DQErr ObjFile::sourceInfo(TraceDqr::ADDRESS addr,Instruction &instInfo
 		return s;
 	}
 
-//	instructionInfo = disassembler->getInstructionInfo();
-	srcInfo = disassembler->getSourceInfo();
-	instInfo = disassembler->getInstructionInfo();
-
 	return TraceDqr::DQERR_OK;
 }
 
@@ -9031,14 +11521,41 @@ Disassembler::Disassembler(bfd *abfd,bool labelsAreFunctions)
 		status = TraceDqr::DQERR_ERR;
 		return;
 	}
+
+	std::lock_guard<std::recursive_mutex> lock(bfdMutex);
 	pType = TraceDqr::PATH_TO_UNIX;
 
 	this->abfd = abfd;
 
+	// share the ElfReader's mapping of the file, if there is one
+
+	image = (elfImage*)bfd_usrdata(abfd);
+	if (image != nullptr) {
+		image->attach();
+	}
+
+	instructionText[0] = 0;
+	instruction.instructionText = instructionText;
+
+	// default address display for callers that have no trace settings (ObjFile::sourceInfo())
+
+	instruction.addrSize = bfd_arch_bits_per_address(abfd);
+	instruction.addrDispFlags = 0;
+	instruction.addrPrintWidth = (instruction.addrSize + 3) / 4;
+
     prev_index       = -1;
-    cached_sym_index = -1;
-    cached_sym_vma   = 0;
-    cached_sym_size  = 0;
+
+    for (int i = 0; i < SYM_INDEX_CLASSES; i++) {
+    	sym_index[i].flags = 0;
+    	sym_index[i].ranges = nullptr;
+    	sym_index[i].numRanges = 0;
+    }
+
+    for (int i = 0; i < SYM_CACHE_SIZE; i++) {
+    	sym_cache[i].index = -1;
+    }
+
+    next_sym_cache = 0;
 
     start_address = bfd_get_start_address(abfd);
 
@@ -9146,6 +11663,14 @@ Disassembler::Disassembler(bfd *abfd,bool labelsAreFunctions)
 
 //				printf("symbol[%d]:%s, addr:%08x size:%d, flags:%08x\n",i,sorted_syms[i]->name,func_info[i].func_vma,func_info[i].func_size,sorted_syms[i]->flags);
     		}
+
+    		// index the flag combinations that symbols are looked up by, so lookups are a binary search
+
+    		if ((buildSymIndex(sym_index[0],BSF_FUNCTION | BSF_OBJECT) != TraceDqr::DQERR_OK) ||
+    		    (buildSymIndex(sym_index[1],BSF_FUNCTION) != TraceDqr::DQERR_OK)) {
+    			status = TraceDqr::DQERR_ERR;
+    			return;
+    		}
     	}
     }
     else {
@@ -9160,7 +11685,7 @@ Disassembler::Disassembler(bfd *abfd,bool labelsAreFunctions)
             // found a code section, add to list
 
   		  section *sp = new section;
-  		  if (sp->initSection(&codeSectionLst,p,true) == nullptr) {
+  		  if (sp->initSection(&codeSectionLst,p,true,image) == nullptr) {
   			  status = TraceDqr::DQERR_ERR;
   			  return;
   		  }
@@ -9174,6 +11699,11 @@ Disassembler::Disassembler(bfd *abfd,bool labelsAreFunctions)
     	return;
     }
 
+    if (codeSections.init(codeSectionLst) != TraceDqr::DQERR_OK) {
+    	status = TraceDqr::DQERR_ERR;
+    	return;
+    }
+
    	info = new (std::nothrow) disassemble_info;
 
 	if (info == nullptr) {
@@ -9255,12 +11785,26 @@ Disassembler::~Disassembler()
 		func_info = nullptr;
 	}
 
+	for (int i = 0; i < SYM_INDEX_CLASSES; i++) {
+		if (sym_index[i].ranges != nullptr) {
+			delete [] sym_index[i].ranges;
+			sym_index[i].ranges = nullptr;
+		}
+	}
+
 	while (codeSectionLst != nullptr) {
 		section *nextSection = codeSectionLst->next;
 		delete codeSectionLst;
 		codeSectionLst = nextSection;
 	}
 
+	if (image != nullptr) {
+		std::lock_guard<std::recursive_mutex> lock(bfdMutex);
+
+		image->release();
+		image = nullptr;
+	}
+
 	if (info != nullptr) {
 		delete info;
 		info = nullptr;
@@ -9331,35 +11875,107 @@ int Disassembler::lookupInstructionByAddress(bfd_vma vma,uint32_t *ins,int *ins_
 		return 1;
 	}
 
-	section *sp;
+	section *sp;
+
+	sp = codeSections.getSectionByAddress((TraceDqr::ADDRESS)vma);
+
+	if (sp == nullptr) {
+		status = TraceDqr::DQERR_ERR;
+
+		return 1;
+	}
+
+	inst = (uint32_t)sp->code[(vma - sp->startAddr)/2];
+
+	rc = decodeInstructionSize(inst, size);
+	if (rc != 0) {
+		status = TraceDqr::DQERR_ERR;
+
+		return rc;
+	}
+
+	*ins_size = size;
+
+	if (size == 16) {
+		*ins = inst;
+	}
+	else {
+		*ins = (((uint32_t)sp->code[(vma - sp->startAddr)/2+1]) << 16) | inst;
+	}
+
+	return 0;
+}
+
+int Disassembler::sym_range_compare_func(const void *arg1,const void *arg2)
+{
+	bfd_vma first = ((const sym_range_t *)arg1)->start;
+	bfd_vma second = ((const sym_range_t *)arg2)->start;
+
+	if (first < second) {
+		return -1;
+	}
+
+	if (first > second) {
+		return 1;
+	}
+
+	return 0;
+}
+
+// Build the ranges that scanning func_info[] in order would find for symbols with flags: the first
+// symbol whose range holds the address, or the last one of those that start exactly at it
+
+TraceDqr::DQErr Disassembler::buildSymIndex(sym_index_t &si,flagword flags)
+{
+	si.flags = flags;
+	si.numRanges = 0;
+
+	si.ranges = new (std::nothrow) sym_range_t[number_of_syms];
+	if (si.ranges == nullptr) {
+		printf("Error: Disassembler::buildSymIndex(): Could not allocate symbol index\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	bool sorted = true;
+
+	for (int i = 0; i < number_of_syms; i++) {
+		if ((func_info[i].sym_flags & flags) == 0) {
+			continue;
+		}
+
+		sym_range_t *r = nullptr;
 
-	sp = codeSectionLst->getSectionByAddress((TraceDqr::ADDRESS)vma);
+		if (si.numRanges > 0) {
+			r = &si.ranges[si.numRanges-1];
 
-	if (sp == nullptr) {
-		status = TraceDqr::DQERR_ERR;
+			if (func_info[i].func_vma < r->start) {
+				sorted = false;
+			}
 
-		return 1;
-	}
+			if (func_info[i].func_vma != r->start) {
+				r = nullptr;
+			}
+		}
 
-	inst = (uint32_t)sp->code[(vma - sp->startAddr)/2];
+		if (r == nullptr) {
+			r = &si.ranges[si.numRanges];
+			si.numRanges += 1;
 
-	rc = decodeInstructionSize(inst, size);
-	if (rc != 0) {
-		status = TraceDqr::DQERR_ERR;
+			r->start = func_info[i].func_vma;
+		}
 
-		return rc;
+		r->end = func_info[i].func_vma + func_info[i].func_size;
+		r->index = i;
 	}
 
-	*ins_size = size;
+	// sorted_syms[] is sorted by address, but the compare function truncates the difference to an int
 
-	if (size == 16) {
-		*ins = inst;
-	}
-	else {
-		*ins = (((uint32_t)sp->code[(vma - sp->startAddr)/2+1]) << 16) | inst;
+	if (sorted == false) {
+		qsort((void*)si.ranges,(size_t)si.numRanges,sizeof si.ranges[0],sym_range_compare_func);
 	}
 
-	return 0;
+	return TraceDqr::DQERR_OK;
 }
 
 int Disassembler::lookup_symbol_by_address(bfd_vma vma,flagword flags,int *index,int *offset)
@@ -9381,79 +11997,104 @@ int Disassembler::lookup_symbol_by_address(bfd_vma vma,flagword flags,int *index
 	// find the function closest to the address. Address should either be start of function, or in body
 	// of function.
 
-//	lookup symbol by address needs to select between function names and locals+function names
-//	do we build two array and use the correct one?
-
 	if ( vma == 0) {
 		return 0;
 	}
 
 	int i;
 
-	// check for a cache hit
+	// check for a cache hit. Calls and returns go back and forth between a few functions, so
+	// several recent hits are kept
 
-	if (cached_sym_index != -1) {
-		if ((vma >= cached_sym_vma) && (vma < (cached_sym_vma + cached_sym_size))) {
-			*index = cached_sym_index;
-			*offset = vma - cached_sym_vma;
+	for (i = 0; i < SYM_CACHE_SIZE; i++) {
+		if ((sym_cache[i].index != -1) && (sym_cache[i].flags == flags)) {
+			if ((vma >= sym_cache[i].vma) && (vma < (sym_cache[i].vma + sym_cache[i].size))) {
+				*index = sym_cache[i].index;
+				*offset = vma - sym_cache[i].vma;
 
-			return 1;
+				return 1;
+			}
 		}
 	}
 
-	//syms = sorted_syms;
-
-	for (i = 0; i < number_of_syms; i++) {
-		if ((func_info[i].sym_flags & flags) != 0) {
-
-			// note: func_vma already has the base+offset address in it
+	int found = -1;
 
-			if (vma == func_info[i].func_vma) {
-				// exact match on vma. Make sure function isn't zero sized
-				// if it is, try to find a following one at the same address
+	for (i = 0; (i < SYM_INDEX_CLASSES) && (sym_index[i].flags != flags); i++) { /* empty */ }
 
-//				printf("\n->vma:%08x size: %d, i=%d, name: %s\n",vma,func_info[i].func_size,i,sorted_syms[i]->name);
+	if (i < SYM_INDEX_CLASSES) {
+		// binary search for the last range that starts at or before vma
 
-				for (int j = i+1; j < number_of_syms; j++) {
-					if ((func_info[j].sym_flags & flags) != 0) {
-						if (func_info[i].func_vma == func_info[j].func_vma) {
-							i = j;
-						}
-					}
-				}
+		sym_range_t *ranges = sym_index[i].ranges;
+		int lo = 0;
+		int hi = sym_index[i].numRanges;
 
-				// have a match with a function
+		while (lo < hi) {
+			int mid = lo + (hi - lo) / 2;
 
-				//printf("have match. Index %d\n",i);
+			if (ranges[mid].start <= vma) {
+				lo = mid + 1;
+			}
+			else {
+				hi = mid;
+			}
+		}
 
-				// cache it for re-lookup speed improvement
+		if (lo > 0) {
+			sym_range_t *r = &ranges[lo-1];
 
-				cached_sym_index = i;
-				cached_sym_vma = func_info[i].func_vma;
-				cached_sym_size = func_info[i].func_size;
+			if ((vma == r->start) || (vma < r->end)) {
+				found = r->index;
+			}
+		}
+	}
+	else {
+		// no index for these flags; scan all the symbols
 
-				*index = i;
-				*offset = vma - cached_sym_vma;
+		for (i = 0; (i < number_of_syms) && (found == -1); i++) {
+			if ((func_info[i].sym_flags & flags) != 0) {
 
-				return 1;
-			}
-			else if (vma > func_info[i].func_vma) {
-				if (vma < (func_info[i].func_vma + func_info[i].func_size)) {
+				// note: func_vma already has the base+offset address in it
 
-					cached_sym_index = i;
-					cached_sym_vma = func_info[i].func_vma;
-					cached_sym_size = func_info[i].func_size;
+				if (vma == func_info[i].func_vma) {
+					// exact match on vma. Make sure function isn't zero sized
+					// if it is, try to find a following one at the same address
 
-					*index = i;
-					*offset = vma - cached_sym_vma;
+					found = i;
 
-					return 1;
+					for (int j = i+1; j < number_of_syms; j++) {
+						if ((func_info[j].sym_flags & flags) != 0) {
+							if (func_info[found].func_vma == func_info[j].func_vma) {
+								found = j;
+							}
+						}
+					}
+				}
+				else if (vma > func_info[i].func_vma) {
+					if (vma < (func_info[i].func_vma + func_info[i].func_size)) {
+						found = i;
+					}
 				}
 			}
 		}
 	}
 
-	return 0;
+	if (found == -1) {
+		return 0;
+	}
+
+	// cache it for re-lookup speed improvement
+
+	sym_cache[next_sym_cache].flags = flags;
+	sym_cache[next_sym_cache].index = found;
+	sym_cache[next_sym_cache].vma = func_info[found].func_vma;
+	sym_cache[next_sym_cache].size = func_info[found].func_size;
+
+	next_sym_cache = (next_sym_cache + 1) % SYM_CACHE_SIZE;
+
+	*index = found;
+	*offset = vma - func_info[found].func_vma;
+
+	return 1;
 }
 
 void Disassembler::overridePrintAddress(bfd_vma addr, struct disassemble_info *info)
@@ -10549,6 +13190,111 @@ int Disassembler::decodeInstruction(uint32_t instruction,int archSize,int &inst_
 	return rc;
 }
 
+// read all of a file into a new buffer. gzip compressed files are decompressed as they are read
+
+TraceDqr::DQErr loadFile(const char *name,char *&buff,int64_t &size)
+{
+	buff = nullptr;
+	size = 0;
+
+	struct stat sb;
+	int64_t buffSize;
+
+	// the size of a regular file is only a starting point for the buffer. Pipes, fifos and
+	// /dev/stdin have no size; their buffer grows as they are read
+
+	if ((stat(name,&sb) == 0) && S_ISREG(sb.st_mode)) {
+		buffSize = sb.st_size;
+	}
+	else {
+		buffSize = 64*1024;
+	}
+
+	// gzread() reads uncompressed files as is
+
+	gzFile gz;
+
+	gz = gzopen(name,"rb");
+	if (gz == nullptr) {
+		return TraceDqr::DQERR_OPEN;
+	}
+
+	gzbuffer(gz,256*1024);
+
+	if (gzdirect(gz) == 0) {
+		buffSize *= 4;	// initial guess at uncompressed size; grown below if needed
+	}
+
+	if (buffSize == 0) {
+		buffSize = 1;
+	}
+
+	buff = new (std::nothrow) char[buffSize];
+	if (buff == nullptr) {
+		printf("Error: loadFile(): Could not allocate buffer for %s\n",name);
+
+		gzclose(gz);
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	for (;;) {
+		if (size >= buffSize) {
+			char *nb;
+
+			nb = new (std::nothrow) char[buffSize*2];
+			if (nb == nullptr) {
+				printf("Error: loadFile(): Could not allocate buffer for %s\n",name);
+
+				delete [] buff;
+				buff = nullptr;
+				size = 0;
+
+				gzclose(gz);
+
+				return TraceDqr::DQERR_ERR;
+			}
+
+			memcpy(nb,buff,size);
+
+			delete [] buff;
+			buff = nb;
+			buffSize *= 2;
+		}
+
+		int64_t n = buffSize - size;
+
+		if (n > 0x40000000) {
+			n = 0x40000000;
+		}
+
+		n = gzread(gz,buff+size,(unsigned)n);
+		if (n < 0) {
+			int errnum;
+
+			printf("Error: loadFile(): read of %s failed: %s\n",name,gzerror(gz,&errnum));
+
+			delete [] buff;
+			buff = nullptr;
+			size = 0;
+
+			gzclose(gz);
+
+			return TraceDqr::DQERR_ERR;
+		}
+
+		if (n == 0) {
+			break;
+		}
+
+		size += n;
+	}
+
+	gzclose(gz);
+
+	return TraceDqr::DQERR_OK;
+}
+
 // make all path separators either '/' or '\'; also remove '/./' and /../. Remove weird double path
 // showing up on linux (libbfd issue)
 
@@ -10642,15 +13388,12 @@ void sanePath(TraceDqr::pathType pt,const char *src,char *dst)
 	dst[w] = 0;
 }
 
+// The result for each address is kept in the section's per-address cache (the one Disassemble()
+// uses), so the line table search, symbol lookup and path clean up are done once per address.
+// Strings returned are owned by the fileReader and live as long as the disassembler
+
 int Disassembler::getSrcLines(TraceDqr::ADDRESS addr,const char **filename,int *cutPathIndex,const char **functionname,unsigned int *linenumber,const char **lineptr)
 {
-	const char *file = nullptr;
-	const char *function = nullptr;
-	unsigned int line = 0;
-	unsigned int discrim;
-
-	// need to loop through all sections with code below and try to find one that succeeds
-
 	section *sp;
 
 	*filename = nullptr;
@@ -10663,12 +13406,51 @@ int Disassembler::getSrcLines(TraceDqr::ADDRESS addr,const char **filename,int *
 		return 0;
 	}
 
-	sp = codeSectionLst->getSectionByAddress(addr);
+	sp = codeSections.getSectionByAddress(addr);
 
 	if (sp == nullptr) {
 		return 0;
 	}
 
+	cachedInstInfo *cii;
+
+	cii = sp->getCachedInfo(addr);
+	if ((cii != nullptr) && cii->haveSrc) {
+		*filename = cii->filename;
+		*cutPathIndex = cii->cutPathIndex;
+		*functionname = cii->functionname;
+		*linenumber = cii->linenumber;
+		*lineptr = cii->lineptr;
+
+		// lookups only succeed if a file was found
+
+		return (cii->filename != nullptr) ? 1 : 0;
+	}
+
+	std::lock_guard<std::recursive_mutex> lock(bfdMutex);
+
+	int rc;
+
+	rc = lookupSrcLines(sp,addr,filename,cutPathIndex,functionname,linenumber,lineptr);
+
+	if (cii == nullptr) {
+		cii = sp->setCachedInfo(addr);
+	}
+
+	if (cii != nullptr) {
+		cii->setSrcInfo(*filename,*cutPathIndex,*functionname,*linenumber,*lineptr);
+	}
+
+	return rc;
+}
+
+int Disassembler::lookupSrcLines(section *sp,TraceDqr::ADDRESS addr,const char **filename,int *cutPathIndex,const char **functionname,unsigned int *linenumber,const char **lineptr)
+{
+	const char *file = nullptr;
+	const char *function = nullptr;
+	unsigned int line = 0;
+	unsigned int discrim;
+
 	if (bfd_find_nearest_line_discriminator(abfd,sp->asecptr,symbol_table,addr-sp->startAddr,&file,&function,&line,&discrim) == 0) {
 		return 0;
 	}
@@ -10850,7 +13632,19 @@ int Disassembler::getSrcLines(TraceDqr::ADDRESS addr,const char **filename,int *
 	return 1;
 }
 
-int Disassembler::Disassemble(TraceDqr::ADDRESS addr)
+// fields (DIS_INSTRUCTION, DIS_SOURCE) selects what to fill in. Anything not asked for is left as it
+// was, so source lookups and libopcodes are only used for what the caller shows
+
+int Disassembler::Disassemble(TraceDqr::ADDRESS addr,int fields)
+{
+	return Disassemble(addr,fields,&instruction,&source);
+}
+
+// Same as above, but fills in the caller's records. Strings are not copied: instInfo and srcInfo
+// point into the per-address cache, which lives as long as the disassembler does. For an address
+// that is not cached, the instruction text is only good until the next call
+
+int Disassembler::Disassemble(TraceDqr::ADDRESS addr,int fields,Instruction *instInfo,Source *srcInfo)
 {
 	if (disassemble_func == nullptr) {
 		printf("Error: Disassembler::Disassemble(): disassemble_func is null\n");
@@ -10866,70 +13660,179 @@ int Disassembler::Disassemble(TraceDqr::ADDRESS addr)
 		return 1;
 	}
 
-	section *sp = codeSectionLst->getSectionByAddress(addr);
+	section *sp = codeSections.getSectionByAddress(addr);
 
 	if (sp == nullptr) {
 		return 1;
 	}
 
 	cachedInstInfo *cii;
+	int missing = fields;
 
 	cii = sp->getCachedInfo(addr);
 	if (cii != nullptr) {
-		source.sourceFile = cii->filename;
-		source.cutPathIndex = cii->cutPathIndex;
-		source.sourceFunction = cii->functionname;
-		source.sourceLineNum = cii->linenumber;
-		source.sourceLine = cii->lineptr;
-
-		instruction.address = addr;
-		instruction.instruction = cii->instruction;
-		instruction.instSize = cii->instsize;
-		strcpy(instruction.instructionText,cii->instructionText);
-
-		instruction.addressLabel = cii->addressLabel;
-		instruction.addressLabelOffset = cii->addressLabelOffset;
-		instruction.haveOperandAddress = cii->haveOperandAddress;
-		instruction.operandAddress = cii->operandAddress;
-		instruction.operandLabel = cii->operandLabel;
-		instruction.operandLabelOffset = cii->operandLabelOffset;
-
-		// instruction.timestamp = 0;
-		// instruction.cycles = 0;
+		if (cii->haveSrc) {
+			missing &= ~DIS_SOURCE;
+		}
 
-		return 0;
+		if (cii->haveInst) {
+			missing &= ~DIS_INSTRUCTION;
+		}
 	}
 
-	getSrcLines(addr,&source.sourceFile,&source.cutPathIndex,&source.sourceFunction,&source.sourceLineNum,&source.sourceLine);
+	int rc = 0;
 
-	setInstructionAddress(vma);
+	if (missing != 0) {
+		std::lock_guard<std::recursive_mutex> lock(bfdMutex);
 
-	int rc;
+		if (cii == nullptr) {
+			cii = sp->setCachedInfo(addr);
+		}
 
-	instruction.instructionText[0] = 0;
-	dis_output = instruction.instructionText;
+		if (missing & DIS_SOURCE) {
+			// also fills in the cache entry
 
-	instruction.haveOperandAddress = false;
+			getSrcLines(addr,&source.sourceFile,&source.cutPathIndex,&source.sourceFunction,&source.sourceLineNum,&source.sourceLine);
+		}
+
+		if (missing & DIS_INSTRUCTION) {
+			setInstructionAddress(vma);
+
+			instructionText[0] = 0;
+			dis_output = instructionText;
+
+			instruction.address = addr;
+			instruction.instructionText = instructionText;
+
+			instruction.haveOperandAddress = false;
+
+			// before calling disassemble_func, need to update info struct to point to correct section!
+
+			info->buffer_vma = sp->startAddr;
+			info->buffer_length = sp->size;
+			info->section = sp->asecptr;
+
+			// potential memory leak below the first time this is done because buffer was initially allocated by bfd
+
+			info->buffer = (bfd_byte*)sp->code;
 
-	// before calling disassemble_func, need to update info struct to point to correct section!
+			rc = disassemble_func(vma,info);
 
-   	info->buffer_vma = sp->startAddr;
-   	info->buffer_length = sp->size;
-   	info->section = sp->asecptr;
+			// output from disassemble_func is in instructionText
 
-   	// potential memory leak below the first time this is done because buffer was initially allocated by bfd
+			if (cii != nullptr) {
+				cii->setInstInfo(instructionText,instruction.instruction,instruction.instSize,instruction.addressLabel,instruction.addressLabelOffset,instruction.haveOperandAddress,instruction.operandAddress,instruction.operandLabel,instruction.operandLabelOffset);
+			}
+		}
+	}
+
+	if (cii == nullptr) {
+		// not cached; hand back what was just looked up
+
+		if ((fields & DIS_SOURCE) && (srcInfo != &source)) {
+			srcInfo->sourceFile = source.sourceFile;
+			srcInfo->cutPathIndex = source.cutPathIndex;
+			srcInfo->sourceFunction = source.sourceFunction;
+			srcInfo->sourceLineNum = source.sourceLineNum;
+			srcInfo->sourceLine = source.sourceLine;
+		}
+
+		if ((fields & DIS_INSTRUCTION) && (instInfo != &instruction)) {
+			instInfo->address = addr;
+			instInfo->instruction = instruction.instruction;
+			instInfo->instSize = instruction.instSize;
+			instInfo->instructionText = instructionText;
+
+			instInfo->addressLabel = instruction.addressLabel;
+			instInfo->addressLabelOffset = instruction.addressLabelOffset;
+			instInfo->haveOperandAddress = instruction.haveOperandAddress;
+			instInfo->operandAddress = instruction.operandAddress;
+			instInfo->operandLabel = instruction.operandLabel;
+			instInfo->operandLabelOffset = instruction.operandLabelOffset;
+		}
 
-   	info->buffer = (bfd_byte*)sp->code;
+		return rc;
+	}
 
-	rc = disassemble_func(vma,info);
+	if (fields & DIS_SOURCE) {
+		srcInfo->sourceFile = cii->filename;
+		srcInfo->cutPathIndex = cii->cutPathIndex;
+		srcInfo->sourceFunction = cii->functionname;
+		srcInfo->sourceLineNum = cii->linenumber;
+		srcInfo->sourceLine = cii->lineptr;
+	}
 
-	// output from disassemble_func is in instruction.instrucitonText
+	if (fields & DIS_INSTRUCTION) {
+		instInfo->address = addr;
+		instInfo->instruction = cii->instruction;
+		instInfo->instSize = cii->instsize;
+		instInfo->instructionText = cii->instructionText;
 
-	sp->setCachedInfo(addr,source.sourceFile,source.cutPathIndex,source.sourceFunction,source.sourceLineNum,source.sourceLine,instruction.instructionText,instruction.instruction,instruction.instSize,instruction.addressLabel,instruction.addressLabelOffset,instruction.haveOperandAddress,instruction.operandAddress,instruction.operandLabel,instruction.operandLabelOffset);
+		instInfo->addressLabel = cii->addressLabel;
+		instInfo->addressLabelOffset = cii->addressLabelOffset;
+		instInfo->haveOperandAddress = cii->haveOperandAddress;
+		instInfo->operandAddress = cii->operandAddress;
+		instInfo->operandLabel = cii->operandLabel;
+		instInfo->operandLabelOffset = cii->operandLabelOffset;
+	}
 
 	return rc;
 }
 
+BasicBlockCache::BasicBlockCache(int size)
+{
+	this->size = size;
+
+	blocks = new (std::nothrow) BasicBlock[size];
+
+	if (blocks == nullptr) {
+		this->size = 0;
+		return;
+	}
+
+	for (int i = 0; i < size; i++) {
+		blocks[i].startAddr = (TraceDqr::ADDRESS)-1;
+	}
+}
+
+BasicBlockCache::~BasicBlockCache()
+{
+	if (blocks != nullptr) {
+		delete [] blocks;
+		blocks = nullptr;
+	}
+
+	size = 0;
+}
+
+BasicBlock *BasicBlockCache::lookup(TraceDqr::ADDRESS addr)
+{
+	if (size == 0) {
+		return nullptr;
+	}
+
+	BasicBlock *bb = &blocks[(addr >> 1) % size];
+
+	if (bb->startAddr != addr) {
+		return nullptr;
+	}
+
+	return bb;
+}
+
+BasicBlock *BasicBlockCache::insert(BasicBlock &bb)
+{
+	if (size == 0) {
+		return nullptr;
+	}
+
+	BasicBlock *cbb = &blocks[(bb.startAddr >> 1) % size];
+
+	*cbb = bb;
+
+	return cbb;
+}
+
 AddrStack::AddrStack(int size)
 {
 	stackSize = size;
@@ -10983,6 +13886,50 @@ TraceDqr::ADDRESS AddrStack::pop()
 	return t;
 }
 
+// Saved as the number of addresses on the stack followed by the addresses, oldest last
+
+TraceDqr::DQErr AddrStack::saveState(CheckpointBuffer &cb)
+{
+	int n = stackSize - sp;
+
+	if ((cb.put(&n,sizeof n) == false) || ((n > 0) && (cb.put(&stack[sp],n * sizeof stack[0]) == false))) {
+		printf("Error: AddrStack::saveState(): Could not save stack\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	return TraceDqr::DQERR_OK;
+}
+
+TraceDqr::DQErr AddrStack::restoreState(CheckpointBuffer &cb)
+{
+	int n;
+
+	if (cb.get(&n,sizeof n) == false) {
+		printf("Error: AddrStack::restoreState(): Checkpoint is truncated\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	if ((n < 0) || (n > stackSize)) {
+		printf("Error: AddrStack::restoreState(): Saved stack depth %d does not fit in stack of %d\n",n,stackSize);
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	sp = stackSize - n;
+
+	if ((n > 0) && (cb.get(&stack[sp],n * sizeof stack[0]) == false)) {
+		printf("Error: AddrStack::restoreState(): Checkpoint is truncated\n");
+
+		sp = stackSize;
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	return TraceDqr::DQERR_OK;
+}
+
 Simulator::Simulator(char *f_name,int arch_size)
 {
 	TraceDqr::DQErr ec;
@@ -10998,6 +13945,10 @@ Simulator::Simulator(char *f_name,int arch_size)
 	elfReader = nullptr;
 	disassembler = nullptr;
 
+	instructionInfo.addrSize = 0;
+	instructionInfo.addrDispFlags = 0;
+	instructionInfo.addrPrintWidth = 0;
+
 	if (f_name == nullptr) {
 		status = TraceDqr::DQERR_ERR;
 		return;
@@ -11068,6 +14019,10 @@ Simulator::Simulator(char *f_name,char *e_name)
 	cutPath = nullptr;
 	newRoot = nullptr;
 
+	instructionInfo.addrSize = 0;
+	instructionInfo.addrDispFlags = 0;
+	instructionInfo.addrPrintWidth = 0;
+
 	if (f_name == nullptr) {
 		status = TraceDqr::DQERR_ERR;
 		return;
@@ -11273,30 +14228,18 @@ TraceDqr::DQErr Simulator::readFile(char *file)
 
 	strcpy(vf_name,file);
 
-	std::ifstream  f(file, std::ifstream::binary);
+	// read file into buffer, decompressing it if it is gzipped
 
-	if (!f) {
+	int64_t fileSize;
+
+	if (loadFile(file,lineBuff,fileSize) != TraceDqr::DQERR_OK) {
 		printf("Error: Simulator::readAndParse(): could not open verilator file %s for input\n",vf_name);
 		status = TraceDqr::DQERR_ERR;
 
 		return status;
 	}
 
-	// get length of file:
-
-	f.seekg (0, f.end);
-	int length = f.tellg();
-	f.seekg (0, f.beg);
-
-	// allocate memory:
-
-	lineBuff = new char [length];
-
-	// read file into buffer
-
-	f.read(lineBuff,length);
-
-	f.close();
+	int length = (int)fileSize;
 
 	// count lines
 
@@ -12129,7 +15072,7 @@ TraceDqr::DQErr Simulator::computeBranchFlags(int core,TraceDqr::ADDRESS current
 	return TraceDqr::DQERR_OK;
 }
 
-TraceDqr::DQErr Simulator::getTraceFileOffset(int &size,int &offset)
+TraceDqr::DQErr Simulator::getTraceFileOffset(int64_t &size,int64_t &offset)
 {
 	size = numLines;
 	offset = nextLine;
@@ -12193,7 +15136,7 @@ int Simulator::Disassemble(SRec *srec)
 	TraceDqr::DQErr ec;
 
 	if (disassembler != nullptr) {
-		disassembler->Disassemble(srec->pc);
+		disassembler->Disassemble(srec->pc,Disassembler::DIS_ALL,&instructionInfo,&sourceInfo);
 
 		ec = disassembler->getStatus();
 
@@ -12201,13 +15144,6 @@ int Simulator::Disassemble(SRec *srec)
 			status = ec;
 			return 0;
 		}
-
-		// the two lines below copy each structure completely. This is probably
-		// pretty inefficient, and just returning pointers and using pointers
-		// would likely be better
-
-		instructionInfo = disassembler->getInstructionInfo();
-		sourceInfo = disassembler->getSourceInfo();
 	}
 	else {
 		// hafta do it all ourselves!
@@ -12215,8 +15151,9 @@ int Simulator::Disassemble(SRec *srec)
 		disasm_info.buffer_vma = srec->pc;
 		instructionBuffer[0] = srec->inst;
 
-		instructionInfo.instructionText[0] = 0;
-		dis_output = instructionInfo.instructionText;
+		instructionText[0] = 0;
+		dis_output = instructionText;
+		instructionInfo.instructionText = instructionText;
 
 		// don't need to use global dis_output to point to where to print. Instead, override stream to point to char
 		// buffer of where to print data to. This will give multi-instance safe code for verilator and trace objects
@@ -28,6 +28,13 @@
 #include <fstream>
 #include <cstring>
 #include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 #include "dqr.hpp"
 
@@ -40,9 +47,11 @@ static void usage(char *name)
 	printf("           [-trace] [-notrace] [-pathunix] [-pathwindows] [-pathraw] [--strip=path] [-itcprint | -itcprint=n] [-noitcprint]\n");
 	printf("           [-addrsize=n] [-addrsize=n+] [-32] [-64] [-32+] [-archsize=nn] [-addrsep] [-noaddrsep] [-analytics | -analyitcs=n]\n");
 	printf("           [-noanalytics] [-freq nn] [-tssize=n] [-callreturn] [-nocallreturn] [-branches] [-nobranches] [-msglevel=n]\n");
-	printf("           [-cutpath=<base path>] [-s file] [-r addr] [-labels] [-nolables] [-debug] [-nodebug] [-v] [-h]\n");
+	printf("           [-cutpath=<base path>] [-s file] [-r addr] [-labels] [-nolables] [-progress] [-noprogress] [-debug] [-nodebug]\n");
+	printf("           [-index] [-threads=n] [-blocks] [-parseonly] [-v] [-h]\n");
 	printf("\n");
 	printf("-t tracefile: Specify the name of the Nexus trace message file. Must contain the file extension (such as .rtd).\n");
+	printf("              Use - to read the trace from stdin. Pipes, FIFOs, and gzip compressed files may also be used.\n");
 	printf("-e elffile:   Specify the name of the executable elf file. Must contain the file extension (such as .elf).\n");
 	printf("-s simfile:   Specify the name of the simulator output file. When using a simulator output file, cannot use\n");
 	printf("              a tracefile (-t option). Can provide an elf file (-e option), but is not required.\n");
@@ -120,8 +129,25 @@ static void usage(char *name)
 	printf("-pathraw:     Show all file path in the format stored in the elf file\n");
 	printf("-msglevel=n:  Set the Nexus trace message detail level. n must be >= 0, <= 3\n");
 	printf("-r addr:      Display the label information for the address specified for the elf file specified\n");
+	printf("-progress:    Display decode progress on stderr, as a percentage of the trace file, or as bytes consumed if the size of\n");
+	printf("              the trace is not known (stdin, pipes, compressed files)\n");
+	printf("-noprogress:  Do not display decode progress (default)\n");
 	printf("-debug:       Display some debug information for the trace to aid in debugging the trace decoder\n");
 	printf("-nodebug:     Do not display any debug information for the trace decoder\n");
+	printf("-index:       Write an index of the sync messages in the trace file to <tracefile>.idx and exit. Uses the -srcbits=n\n");
+	printf("              and -tssize=n settings. The index lets tools start decoding at any sync message\n");
+	printf("-threads=n:   Decode the trace file with n threads (default 1). n = 0 uses one thread per CPU. A single core\n");
+	printf("              trace is split into segments at sync messages which are decoded in parallel. A multi-core trace\n");
+	printf("              (-srcbits=n) is parsed once and decoded one core (or group of cores) per thread. Output is in\n");
+	printf("              trace order either way. Not used with -ca, -ctf, -analytics, -pf, -32+, or -addrsize=n+, or for a\n");
+	printf("              single core trace read from stdin. ITC prints that span a segment boundary of a single core trace\n");
+	printf("              are split in two\n");
+	printf("-blocks:      Display the executed address ranges (basic blocks) with their instruction counts and how they\n");
+	printf("              end, instead of the instruction trace. Much faster than a full decode\n");
+	printf("-parseonly:   Only parse the trace messages; do not follow the program. The elf file is not read, so\n");
+	printf("              -trace output has no instructions and -analytics has no instruction counts. Much faster than a\n");
+	printf("              full decode when only the messages or message analytics are needed. On by default when there\n");
+	printf("              is no elf file\n");
 	printf("-v:           Display the version number of the DQer and exit.\n");
 	printf("-h:           Display this usage information.\n");
 }
@@ -169,6 +195,1496 @@ static const char *stripPath(const char *prefix,const char *srcpath)
 	return nullptr;
 }
 
+// output settings and state for printing decoded records, so the same code can print to stdout
+// or to the buffer for one segment of a parallel decode
+
+struct PrintOptions {
+	bool        srcFlag;
+	bool        fileFlag;
+	bool        dasmFlag;
+	bool        funcFlag;
+	bool        traceFlag;
+	bool        showBranches;
+	bool        showCallsReturns;
+	bool        showCycles;		// simulator or CA trace
+	char       *stripFlag;
+	int         srcbits;
+	int         msgLevel;
+	int         itcPrintOpts;
+};
+
+struct PrintState {
+	const char       *lastSrcFile;
+	const char       *lastSrcLine;
+	unsigned int      lastSrcLineNum;
+	TraceDqr::ADDRESS lastAddress;
+	int               lastInstSize;
+	bool              firstPrint;
+	char              dst[10000];
+};
+
+// output in a segment of a parallel decode that depends on what was printed before the segment.
+// Positions are file offsets in the segment output, or -1
+
+struct SegmentMarks {
+	bool              haveSrc;		// first source info seen
+	long              srcStart;
+	long              srcEnd;
+	const char       *srcFile;
+	const char       *srcLine;
+	unsigned int      srcLineNum;
+	bool              haveInst;		// first instruction seen
+	long              labelStart;
+	long              labelEnd;
+	TraceDqr::ADDRESS firstAddress;
+	bool              leadNL;		// output starts with a newline because firstPrint was false
+};
+
+static void initPrintState(PrintState &ps,bool firstPrint)
+{
+	ps.lastSrcFile = nullptr;
+	ps.lastSrcLine = nullptr;
+	ps.lastSrcLineNum = 0;
+	ps.lastAddress = 0;
+	ps.lastInstSize = 0;
+	ps.firstPrint = firstPrint;
+}
+
+static void printNL(FILE *out,PrintState &ps,SegmentMarks *marks)
+{
+	if (ps.firstPrint == false) {
+		if ((marks != nullptr) && (ftell(out) == 0)) {
+			marks->leadNL = true;
+		}
+
+		fprintf(out,"\n");
+	}
+}
+
+static void printITCStr(FILE *out,const PrintOptions &opts,PrintState &ps,int core,TraceDqr::TIMESTAMP startTime,TraceDqr::TIMESTAMP endTime,const std::string &s,SegmentMarks *marks)
+{
+	printNL(out,ps,marks);
+
+	if (opts.srcbits > 0) {
+		fprintf(out,"[%d] ",core);
+	}
+
+	fprintf(out,"ITC Print: ");
+
+	if ((startTime != 0) || (endTime != 0)) {
+		fprintf(out,"Msg Tics: <%llu-%llu> ",(unsigned long long)startTime,(unsigned long long)endTime);
+	}
+
+	fprintf(out,"%s",s.c_str());
+
+	ps.firstPrint = false;
+}
+
+static void printITC(FILE *out,const PrintOptions &opts,PrintState &ps,Trace *trace,NexusMessage *msgInfo,bool flush,SegmentMarks *marks)
+{
+	std::string s;
+	bool haveStr;
+	uint32_t core_mask;
+	TraceDqr::TIMESTAMP startTime, endTime;
+
+	if (flush) {
+		core_mask = trace->getITCFlushMask();
+	}
+	else {
+		core_mask = trace->getITCPrintMask();
+	}
+
+	for (int core = 0; core_mask != 0; core++) {
+		if (core_mask & 1) {
+			if (flush) {
+				s = trace->flushITCPrintStr(core,haveStr,startTime,endTime);
+			}
+			else {
+				s = trace->getITCPrintStr(core,haveStr,startTime,endTime);
+			}
+
+			while (haveStr != false) {
+				printITCStr(out,opts,ps,(flush || (msgInfo == nullptr)) ? core : msgInfo->coreId,startTime,endTime,s,marks);
+
+				if (flush) {
+					s = trace->flushITCPrintStr(core,haveStr,startTime,endTime);
+				}
+				else {
+					s = trace->getITCPrintStr(core,haveStr,startTime,endTime);
+				}
+			}
+		}
+
+		core_mask >>= 1;
+	}
+}
+
+static void printRecord(FILE *out,const PrintOptions &opts,PrintState &ps,Trace *trace,Instruction *instInfo,NexusMessage *msgInfo,Source *srcInfo,SegmentMarks *marks)
+{
+	int instlevel = 1;
+
+	if (srcInfo != nullptr) {
+		bool firstSrc = (marks != nullptr) && (marks->haveSrc == false);
+
+		if (firstSrc) {
+			marks->haveSrc = true;
+			marks->srcStart = ftell(out);
+			marks->srcFile = srcInfo->sourceFile;
+			marks->srcLine = srcInfo->sourceLine;
+			marks->srcLineNum = srcInfo->sourceLineNum;
+		}
+
+		if ((ps.lastSrcFile != srcInfo->sourceFile) || (ps.lastSrcLine != srcInfo->sourceLine) || (ps.lastSrcLineNum != srcInfo->sourceLineNum)) {
+			ps.lastSrcFile = srcInfo->sourceFile;
+			ps.lastSrcLine = srcInfo->sourceLine;
+			ps.lastSrcLineNum = srcInfo->sourceLineNum;
+
+			if (opts.fileFlag) {
+				if (srcInfo->sourceFile != nullptr) {
+					printNL(out,ps,marks);
+
+					const char *sfp;
+
+					sfp = stripPath(opts.stripFlag,srcInfo->sourceFile);
+
+					if (opts.srcbits > 0) {
+						fprintf(out,"[%d] ",srcInfo->coreId);
+					}
+
+					int sfpl = 0;
+					int sfl = 0;
+					int stripped = 0;
+
+					if (sfp != srcInfo->sourceFile) {
+						sfpl = strlen(sfp);
+						sfl = strlen(srcInfo->sourceFile);
+						stripped = sfl - sfpl;
+					}
+
+					if (stripped < srcInfo->cutPathIndex) {
+						fprintf(out,"File: [");
+
+						if (sfp != srcInfo->sourceFile) {
+							fprintf(out,"..");
+						}
+
+						for (int i = stripped; i < srcInfo->cutPathIndex; i++) {
+							fprintf(out,"%c",srcInfo->sourceFile[i]);
+						}
+
+						fprintf(out,"]%s:%d\n",&srcInfo->sourceFile[srcInfo->cutPathIndex],srcInfo->sourceLineNum);
+					}
+					else {
+						if (sfp != srcInfo->sourceFile) {
+							fprintf(out,"File: ..%s:%d\n",sfp,srcInfo->sourceLineNum);
+						}
+						else {
+							fprintf(out,"File: %s:%d\n",sfp,srcInfo->sourceLineNum);
+						}
+					}
+
+					ps.firstPrint = false;
+				}
+			}
+
+			if (opts.srcFlag) {
+				if (srcInfo->sourceLine != nullptr) {
+					if (opts.srcbits > 0) {
+						fprintf(out,"[%d] Source: %s\n",srcInfo->coreId,srcInfo->sourceLine);
+					}
+					else {
+						fprintf(out,"Source: %s\n",srcInfo->sourceLine);
+					}
+
+					ps.firstPrint = false;
+				}
+			}
+		}
+
+		if (firstSrc) {
+			marks->srcEnd = ftell(out);
+		}
+	}
+
+	if (opts.dasmFlag && (instInfo != nullptr)) {
+		instInfo->addressToText(ps.dst,sizeof ps.dst,0);
+
+		if (opts.funcFlag) {
+			bool firstInst = (marks != nullptr) && (marks->haveInst == false);
+
+			if (opts.srcbits > 0) {
+				fprintf(out,"[%d] ",instInfo->coreId);
+			}
+
+			if (firstInst) {
+				marks->haveInst = true;
+				marks->firstAddress = instInfo->address;
+				marks->labelStart = ftell(out);
+			}
+
+			if (instInfo->address != (ps.lastAddress + ps.lastInstSize / 8)) {
+				if (instInfo->addressLabel != nullptr) {
+					fprintf(out,"<%s",instInfo->addressLabel);
+					if (instInfo->addressLabelOffset != 0) {
+						fprintf(out,"+%x",instInfo->addressLabelOffset);
+					}
+					fprintf(out,">\n");
+				}
+			}
+
+			if (firstInst) {
+				marks->labelEnd = ftell(out);
+			}
+
+			ps.lastAddress = instInfo->address;
+			ps.lastInstSize = instInfo->instSize;
+		}
+
+		if (opts.srcbits > 0) {
+			fprintf(out,"[%d] ", instInfo->coreId);
+		}
+
+		int n;
+
+		if (opts.showCycles && (instInfo->timestamp != 0)) {
+			n = fprintf(out,"t:%d ",instInfo->timestamp);
+
+			if (instInfo->caFlags & (TraceDqr::CAFLAG_PIPE0 | TraceDqr::CAFLAG_PIPE1)) {
+				if (instInfo->caFlags & TraceDqr::CAFLAG_PIPE0) {
+					n += fprintf(out,"[0:%d",instInfo->pipeCycles);
+				}
+				else if (instInfo->caFlags & TraceDqr::CAFLAG_PIPE1) {
+					n += fprintf(out,"[1:%d",instInfo->pipeCycles);
+				}
+
+				if (instInfo->caFlags & TraceDqr::CAFLAG_VSTART) {
+					n += fprintf(out,"(%d)-%d(%dA,%dL,%dS)",instInfo->qDepth,instInfo->VIStartCycles,instInfo->arithInProcess,instInfo->loadInProcess,instInfo->storeInProcess);
+				}
+
+				if (instInfo->caFlags & TraceDqr::CAFLAG_VARITH) {
+					n += fprintf(out,"-%dA",instInfo->VIFinishCycles);
+				}
+
+				if (instInfo->caFlags & TraceDqr::CAFLAG_VLOAD) {
+					n += fprintf(out,"-%dL",instInfo->VIFinishCycles);
+				}
+
+				if (instInfo->caFlags & TraceDqr::CAFLAG_VSTORE) {
+					n += fprintf(out,"-%dS",instInfo->VIFinishCycles);
+				}
+
+				n += fprintf(out,"] ");
+			}
+
+			for (int i = n; i < 14; i++) {
+				fprintf(out," ");
+			}
+		}
+
+		n = fprintf(out,"    %s:",ps.dst);
+
+		for (int i = n; i < 20; i++) {
+			fprintf(out," ");
+		}
+
+		instInfo->instructionToText(ps.dst,sizeof ps.dst,instlevel);
+		fprintf(out,"  %s",ps.dst);
+
+		if (opts.showBranches == true) {
+			switch (instInfo->brFlags) {
+			case TraceDqr::BRFLAG_none:
+				break;
+			case TraceDqr::BRFLAG_unknown:
+				fprintf(out," [u]");
+				break;
+			case TraceDqr::BRFLAG_taken:
+				fprintf(out," [t]");
+				break;
+			case TraceDqr::BRFLAG_notTaken:
+				fprintf(out," [nt]");
+				break;
+			}
+		}
+
+		if (opts.showCallsReturns == true) {
+			if (instInfo->CRFlag != TraceDqr::isNone) {
+				const char *format = "%s";
+
+				fprintf(out," [");
+
+				if (instInfo->CRFlag & TraceDqr::isCall) {
+					fprintf(out,format,"Call");
+					format = ",%s";
+				}
+
+				if (instInfo->CRFlag & TraceDqr::isReturn) {
+					fprintf(out,format,"Return");
+					format = ",%s";
+				}
+
+				if (instInfo->CRFlag & TraceDqr::isSwap) {
+					fprintf(out,format,"Swap");
+					format = ",%s";
+				}
+
+				if (instInfo->CRFlag & TraceDqr::isInterrupt) {
+					fprintf(out,format,"Interrupt");
+					format = ",%s";
+				}
+
+				if (instInfo->CRFlag & TraceDqr::isException) {
+					fprintf(out,format,"Exception");
+					format = ",%s";
+				}
+
+				if (instInfo->CRFlag & TraceDqr::isExceptionReturn) {
+					fprintf(out,format,"Exception Return");
+					format = ",%s";
+				}
+
+				fprintf(out,"]");
+			}
+		}
+
+		fprintf(out,"\n");
+
+		ps.firstPrint = false;
+	}
+
+	if (opts.traceFlag && (msgInfo != nullptr)) {
+		// got the goods! Get to it!
+
+		if (globalDebugFlag) {
+			msgInfo->dumpRawMessage();
+		}
+
+		msgInfo->messageToText(ps.dst,sizeof ps.dst,opts.msgLevel);
+
+		printNL(out,ps,marks);
+
+		if (opts.srcbits > 0) {
+			fprintf(out,"[%d] ",msgInfo->coreId);
+		}
+
+		fprintf(out,"Trace: %s",ps.dst);
+
+		fprintf(out,"\n");
+
+		ps.firstPrint = false;
+	}
+
+	if ((trace != nullptr) && (opts.itcPrintOpts != TraceDqr::ITC_OPT_NONE)) {
+		printITC(out,opts,ps,trace,msgInfo,false,marks);
+	}
+}
+
+// settings to create a Trace object, so each thread of a parallel decode can make its own
+
+struct TraceOptions {
+	char               *tfName;
+	char               *efName;
+	char               *pfName;
+	int                 numAddrBits;
+	uint32_t            addrDispFlags;
+	int                 srcbits;
+	uint32_t            freq;
+	TraceDqr::TraceType traceType;
+	int                 tssize;
+	TraceDqr::pathType  pt;
+	char               *cutPath;
+	char               *newRoot;
+	int                 itcPrintOpts;
+	int                 itcPrintChannel;
+	bool                labelFlag;
+	bool                parseOnly;
+};
+
+static Trace *openTrace(const TraceOptions &opts)
+{
+	Trace *trace;
+	TraceDqr::DQErr rc;
+
+	if (opts.pfName != nullptr) {
+		trace = new (std::nothrow) Trace(opts.pfName);
+
+		if (trace == nullptr) {
+			printf("Error: Could not create Trace object\n");
+
+			return nullptr;
+		}
+
+		if (trace->getStatus() != TraceDqr::DQERR_OK) {
+			delete trace;
+			trace = nullptr;
+
+			printf("Error: new Trace() failed\n",opts.pfName);
+
+			return nullptr;
+		}
+
+		return trace;
+	}
+
+	trace = new (std::nothrow) Trace(opts.tfName,opts.efName,opts.numAddrBits,opts.addrDispFlags,opts.srcbits,opts.freq);
+
+	if (trace == nullptr) {
+		printf("Error: Could not create Trace object\n");
+
+		return nullptr;
+	}
+
+	if (trace->getStatus() != TraceDqr::DQERR_OK) {
+		delete trace;
+		trace = nullptr;
+
+		printf("Error: new Trace(%s,%s) failed\n",opts.tfName,opts.efName);
+
+		return nullptr;
+	}
+
+	trace->setTraceType(opts.traceType);
+	trace->setTSSize(opts.tssize);
+	trace->setPathType(opts.pt);
+
+	if (opts.cutPath != nullptr) {
+		rc = trace->subSrcPath(opts.cutPath,opts.newRoot);
+		if (rc != TraceDqr::DQERR_OK) {
+			printf("Error: Could not set cutPath or newRoot\n");
+
+			delete trace;
+			trace = nullptr;
+
+			return nullptr;
+		}
+	}
+
+	// NLS is on by default when the trace object is created. Only
+	// set the print options if something has changed
+
+	if (opts.itcPrintOpts != TraceDqr::ITC_OPT_NLS) {
+		trace->setITCPrintOptions(opts.itcPrintOpts,4096,opts.itcPrintChannel);
+	}
+
+	// -parseonly does not read the elf file, and without one setLabelMode() would fail the trace object
+
+	if (opts.parseOnly == false) {
+		trace->setLabelMode(opts.labelFlag);
+	}
+
+	return trace;
+}
+
+// Parallel decode: the trace is split into segments that start at sync messages, which reset the
+// decoder to a known address. Segments are decoded by a pool of threads, each with its own Trace
+// object, into temporary files that are copied to stdout in trace order. Output at the start of a
+// segment that depends on what came before it (source file headers, function labels, separating
+// newlines) is marked so it can be dropped when the previous segment makes it redundant
+
+#define MIN_SEGMENT_SIZE	(64*1024)
+
+// source file and line, kept as strings because the pointers belong to the Trace object of one thread
+
+struct SrcKey {
+	bool         fileNull;
+	std::string  file;
+	bool         lineNull;
+	std::string  line;
+	unsigned int lineNum;
+};
+
+static void setSrcKey(SrcKey &key,const char *file,const char *line,unsigned int lineNum)
+{
+	key.fileNull = (file == nullptr);
+	key.file = (file != nullptr) ? file : "";
+	key.lineNull = (line == nullptr);
+	key.line = (line != nullptr) ? line : "";
+	key.lineNum = lineNum;
+}
+
+static bool sameSrcKey(const SrcKey &a,const SrcKey &b)
+{
+	return (a.fileNull == b.fileNull) && (a.file == b.file) && (a.lineNull == b.lineNull) && (a.line == b.line) && (a.lineNum == b.lineNum);
+}
+
+struct Segment {
+	const TraceIndexEntry *entry;		// sync message the segment starts at, nullptr for start of trace
+	int64_t                end;			// offset of the sync message starting the next segment
+	FILE                  *out;
+	FILE                  *tail;		// ITC prints flushed at the end of the trace (last segment only)
+	TraceDqr::DQErr        ec;
+	bool                   done;
+	SegmentMarks           marks;
+	SegmentMarks           tailMarks;
+	SrcKey                 firstSrc;
+	SrcKey                 lastSrc;		// print state at the end of the segment
+	TraceDqr::ADDRESS      lastAddress;
+	int                    lastInstSize;
+};
+
+struct ParallelDecode {
+	const TraceOptions     *traceOpts;
+	const PrintOptions     *printOpts;
+	Segment                *segments;
+	int                     numSegments;
+	std::atomic<int>        nextSegment;
+	std::mutex              mutex;
+	std::condition_variable cv;
+};
+
+static void initSegmentMarks(SegmentMarks &marks)
+{
+	marks.haveSrc = false;
+	marks.srcStart = -1;
+	marks.srcEnd = -1;
+	marks.srcFile = nullptr;
+	marks.srcLine = nullptr;
+	marks.srcLineNum = 0;
+	marks.haveInst = false;
+	marks.labelStart = -1;
+	marks.labelEnd = -1;
+	marks.firstAddress = 0;
+	marks.leadNL = false;
+}
+
+static TraceDqr::DQErr decodeSegment(Trace *trace,const PrintOptions &opts,Segment &seg,bool first,bool last)
+{
+	TraceDqr::DQErr ec;
+	Instruction *instInfo;
+	NexusMessage *msgInfo;
+	Source *srcInfo;
+	PrintState ps;
+
+	initPrintState(ps,first);
+	initSegmentMarks(seg.marks);
+	initSegmentMarks(seg.tailMarks);
+
+	Instruction **instp = opts.dasmFlag ? &instInfo : nullptr;
+	Source **srcp = (opts.srcFlag || opts.fileFlag) ? &srcInfo : nullptr;
+
+	instInfo = nullptr;
+	srcInfo = nullptr;
+
+	ec = trace->seekToIndexEntry(seg.entry);
+	if (ec != TraceDqr::DQERR_OK) {
+		return ec;
+	}
+
+	do {
+		ec = trace->NextInstruction(instp,&msgInfo,srcp);
+
+		if (ec == TraceDqr::DQERR_OK) {
+			if ((msgInfo != nullptr) && ((int64_t)msgInfo->offset >= seg.end)) {
+				// first message of the next segment
+
+				break;
+			}
+
+			printRecord(seg.out,opts,ps,trace,instInfo,msgInfo,srcInfo,&seg.marks);
+		}
+	} while (ec == TraceDqr::DQERR_OK);
+
+	if ((ec != TraceDqr::DQERR_OK) && (ec != TraceDqr::DQERR_EOF)) {
+		return ec;
+	}
+
+	// ITC prints not finished in this segment are flushed so they are not lost. At the end of the
+	// trace they go after the End of Trace File line, same as a single threaded decode
+
+	if (opts.itcPrintOpts != TraceDqr::ITC_OPT_NONE) {
+		if (last) {
+			seg.tail = tmpfile();
+			if (seg.tail == nullptr) {
+				printf("Error: Could not create temporary file for decode output\n");
+
+				return TraceDqr::DQERR_ERR;
+			}
+
+			printITC(seg.tail,opts,ps,trace,nullptr,true,&seg.tailMarks);
+		}
+		else {
+			printITC(seg.out,opts,ps,trace,nullptr,true,&seg.marks);
+		}
+	}
+
+	setSrcKey(seg.firstSrc,seg.marks.srcFile,seg.marks.srcLine,seg.marks.srcLineNum);
+	setSrcKey(seg.lastSrc,ps.lastSrcFile,ps.lastSrcLine,ps.lastSrcLineNum);
+	seg.lastAddress = ps.lastAddress;
+	seg.lastInstSize = ps.lastInstSize;
+
+	return ec;
+}
+
+static void decodeSegments(ParallelDecode *pd)
+{
+	Trace *trace;
+
+	trace = openTrace(*pd->traceOpts);
+
+	for (;;) {
+		int i = pd->nextSegment++;
+
+		if (i >= pd->numSegments) {
+			break;
+		}
+
+		Segment &seg = pd->segments[i];
+		TraceDqr::DQErr ec;
+
+		seg.out = tmpfile();
+
+		if (trace == nullptr) {
+			ec = TraceDqr::DQERR_ERR;
+		}
+		else if (seg.out == nullptr) {
+			printf("Error: Could not create temporary file for decode output\n");
+
+			ec = TraceDqr::DQERR_ERR;
+		}
+		else {
+			ec = decodeSegment(trace,*pd->printOpts,seg,i == 0,i == pd->numSegments-1);
+		}
+
+		std::unique_lock<std::mutex> lock(pd->mutex);
+
+		seg.ec = ec;
+		seg.done = true;
+
+		pd->cv.notify_all();
+	}
+
+	if (trace != nullptr) {
+		delete trace;
+		trace = nullptr;
+	}
+}
+
+// copy the output of a segment to stdout, leaving out the bytes in [skipStart[i],skipEnd[i]).
+// Returns the number of bytes copied
+
+static long copySegmentOutput(FILE *f,long skipStart[],long skipEnd[],int numSkips)
+{
+	char buff[64*1024];
+	long pos = 0;
+	long copied = 0;
+	size_t n;
+
+	rewind(f);
+
+	while ((n = fread(buff,1,sizeof buff,f)) > 0) {
+		size_t i = 0;
+
+		while (i < n) {
+			bool skip = false;
+
+			for (int k = 0; k < numSkips; k++) {
+				if ((pos + (long)i >= skipStart[k]) && (pos + (long)i < skipEnd[k])) {
+					skip = true;
+				}
+			}
+
+			// find the end of the run of bytes that are all copied or all skipped
+
+			size_t j = i + 1;
+			bool runSkip = skip;
+
+			while ((j < n) && (runSkip == skip)) {
+				runSkip = false;
+
+				for (int k = 0; k < numSkips; k++) {
+					if ((pos + (long)j >= skipStart[k]) && (pos + (long)j < skipEnd[k])) {
+						runSkip = true;
+					}
+				}
+
+				if (runSkip == skip) {
+					j += 1;
+				}
+			}
+
+			if (skip == false) {
+				fwrite(&buff[i],1,j - i,stdout);
+				copied += j - i;
+			}
+
+			i = j;
+		}
+
+		pos += n;
+	}
+
+	fclose(f);
+
+	return copied;
+}
+
+// returns the exit code for dqr, or -1 if the trace could not be split and should be decoded by one thread
+
+static int decodeParallel(const TraceOptions &traceOpts,const PrintOptions &printOpts,Trace *trace,int numThreads,bool progressFlag)
+{
+	TraceIndex *index;
+	int64_t size;
+	int64_t offset;
+
+	index = trace->getTraceIndex();
+	if (index == nullptr) {
+		printf("Info: Could not index trace file for parallel decode. Decoding with one thread\n");
+
+		return -1;
+	}
+
+	if ((trace->getTraceFileOffset(size,offset) != TraceDqr::DQERR_OK) || (size <= 0)) {
+		size = index->getTraceSize();
+	}
+
+	// a few segments per thread so threads that finish early can pick up more work
+
+	int64_t maxSegments = numThreads * 4;
+
+	if (maxSegments > size / MIN_SEGMENT_SIZE + 1) {
+		maxSegments = size / MIN_SEGMENT_SIZE + 1;
+	}
+
+	std::vector<Segment> segments;
+	Segment seg;
+
+	seg.entry = nullptr;
+	seg.end = INT64_MAX;
+	seg.out = nullptr;
+	seg.tail = nullptr;
+	seg.ec = TraceDqr::DQERR_OK;
+	seg.done = false;
+
+	segments.push_back(seg);
+
+	int64_t lastStart = 0;
+
+	for (int64_t i = 1; i < maxSegments; i++) {
+		int64_t e = index->findEntry(TraceIndex::KEY_OFFSET,size * i / maxSegments);
+
+		if (e >= 0) {
+			seg.entry = index->getEntry(e);
+
+			if ((int64_t)seg.entry->offset > lastStart) {
+				lastStart = seg.entry->offset;
+				segments.back().end = lastStart;
+				segments.push_back(seg);
+			}
+		}
+	}
+
+	int numSegments = segments.size();
+
+	if (numThreads > numSegments) {
+		numThreads = numSegments;
+	}
+
+	ParallelDecode pd;
+
+	pd.traceOpts = &traceOpts;
+	pd.printOpts = &printOpts;
+	pd.segments = segments.data();
+	pd.numSegments = numSegments;
+	pd.nextSegment = 0;
+
+	std::vector<std::thread> threads;
+
+	for (int i = 0; i < numThreads; i++) {
+		threads.push_back(std::thread(decodeSegments,&pd));
+	}
+
+	// print state of the output so far, to decide what to drop from the start of each segment
+
+	bool firstPrint = true;
+	SrcKey lastSrc;
+	TraceDqr::ADDRESS lastAddress = 0;
+	int lastInstSize = 0;
+
+	setSrcKey(lastSrc,nullptr,nullptr,0);
+
+	TraceDqr::DQErr ec = TraceDqr::DQERR_OK;
+
+	for (int i = 0; (i < numSegments) && (ec == TraceDqr::DQERR_OK); i++) {
+		Segment &s = segments[i];
+
+		{
+			std::unique_lock<std::mutex> lock(pd.mutex);
+
+			while (s.done == false) {
+				pd.cv.wait(lock);
+			}
+		}
+
+		ec = s.ec;
+
+		if ((ec != TraceDqr::DQERR_OK) && (ec != TraceDqr::DQERR_EOF)) {
+			// stop handing out segments
+
+			pd.nextSegment = numSegments;
+
+			break;
+		}
+
+		long skipStart[3];
+		long skipEnd[3];
+		int numSkips = 0;
+
+		if (s.marks.leadNL && firstPrint) {
+			skipStart[numSkips] = 0;
+			skipEnd[numSkips] = 1;
+			numSkips += 1;
+		}
+
+		if (s.marks.haveSrc && sameSrcKey(s.firstSrc,lastSrc)) {
+			skipStart[numSkips] = s.marks.srcStart;
+			skipEnd[numSkips] = s.marks.srcEnd;
+			numSkips += 1;
+		}
+
+		if (s.marks.haveInst && (s.marks.firstAddress == (lastAddress + lastInstSize / 8))) {
+			skipStart[numSkips] = s.marks.labelStart;
+			skipEnd[numSkips] = s.marks.labelEnd;
+			numSkips += 1;
+		}
+
+		if (copySegmentOutput(s.out,skipStart,skipEnd,numSkips) > 0) {
+			firstPrint = false;
+		}
+
+		s.out = nullptr;
+
+		if (s.marks.haveSrc) {
+			lastSrc = s.lastSrc;
+		}
+
+		if (s.marks.haveInst) {
+			lastAddress = s.lastAddress;
+			lastInstSize = s.lastInstSize;
+		}
+
+		if (progressFlag) {
+			fprintf(stderr,"\rProgress: %d%%",(i+1)*100/numSegments);
+		}
+	}
+
+	for (auto &t : threads) {
+		t.join();
+	}
+
+	if (progressFlag) {
+		fprintf(stderr,"\n");
+	}
+
+	if (ec != TraceDqr::DQERR_EOF) {
+		for (auto &s : segments) {
+			if (s.out != nullptr) {
+				fclose(s.out);
+				s.out = nullptr;
+			}
+
+			if (s.tail != nullptr) {
+				fclose(s.tail);
+				s.tail = nullptr;
+			}
+		}
+
+		if (ec == TraceDqr::DQERR_OK) {
+			// last segment stopped without reaching the end of the trace
+
+			ec = TraceDqr::DQERR_ERR;
+		}
+
+		printf("Error (%d) terminated trace decode\n",ec);
+
+		return 1;
+	}
+
+	if (firstPrint == false) {
+		printf("\n");
+	}
+	printf("End of Trace File\n");
+
+	Segment &last = segments[numSegments-1];
+
+	if (last.tail != nullptr) {
+		copySegmentOutput(last.tail,nullptr,nullptr,0);
+		last.tail = nullptr;
+	}
+
+	return 0;
+}
+
+// Per-core decode of a multi-core trace: the main thread parses the trace file once and hands each message
+// to the thread decoding its core (core % numThreads), which has its own Trace object and is given the
+// messages with Trace::pushTraceMsg(). Messages are handed out in batches. When every thread has decoded its
+// share of a batch, the main thread prints the records in the order of the messages they came from, which
+// is the order a single threaded decode prints them in. A few batches are in flight at a time, so parsing
+// and printing overlap the decode
+
+#define CORE_BATCH_MSGS	512
+#define CORE_BATCHES	4
+
+struct ITCRecord {
+	int                 core;
+	TraceDqr::TIMESTAMP startTime;
+	TraceDqr::TIMESTAMP endTime;
+	std::string         s;
+};
+
+struct CoreRecord {
+	bool         haveInst;
+	Instruction  inst;
+	bool         haveMsg;
+	NexusMessage msg;
+	bool         haveSrc;
+	Source       src;
+	int          itcStart;		// ITC prints in CoreWork::itc
+	int          itcCount;
+};
+
+// the messages of a batch for one thread, and the records decoded from them
+
+struct CoreWork {
+	std::vector<NexusMessage>        msgs;
+	std::vector<TraceDqr::TraceType> traceTypes;	// trace type to decode each message with
+	std::vector<CoreRecord>          records;
+	std::vector<ITCRecord>           itc;
+	std::vector<size_t>              msgEnd;		// records from msgs[i] end at records[msgEnd[i]]
+	bool                             last;			// the end of the trace follows these messages
+	bool                             done;
+	TraceDqr::DQErr                  ec;
+	size_t                           ecMsg;		// message the decode stopped at when ec is an error
+};
+
+struct CoreBatch {
+	std::vector<int> order;		// thread of each message, in trace order
+	CoreWork        *work;		// one per thread
+};
+
+struct CoreQueue {
+	std::deque<CoreWork*>  work;
+	std::vector<ITCRecord> flush;		// ITC prints flushed at the end of the trace
+};
+
+struct CoreDecode {
+	const TraceOptions     *traceOpts;
+	const PrintOptions     *printOpts;
+	CoreQueue              *queues;
+	bool                    stop;
+	std::mutex              mutex;
+	std::condition_variable cv;
+};
+
+static void getITCRecords(Trace *trace,NexusMessage *msgInfo,bool flush,std::vector<ITCRecord> &itc)
+{
+	ITCRecord r;
+	bool haveStr;
+	uint32_t core_mask;
+
+	if (flush) {
+		core_mask = trace->getITCFlushMask();
+	}
+	else {
+		core_mask = trace->getITCPrintMask();
+	}
+
+	for (int core = 0; core_mask != 0; core++) {
+		if (core_mask & 1) {
+			r.core = (flush || (msgInfo == nullptr)) ? core : msgInfo->coreId;
+
+			for (;;) {
+				if (flush) {
+					r.s = trace->flushITCPrintStr(core,haveStr,r.startTime,r.endTime);
+				}
+				else {
+					r.s = trace->getITCPrintStr(core,haveStr,r.startTime,r.endTime);
+				}
+
+				if (haveStr == false) {
+					break;
+				}
+
+				itc.push_back(r);
+			}
+		}
+
+		core_mask >>= 1;
+	}
+}
+
+// decode the messages of one thread's share of a batch. Sets work->ec, and returns DQERR_OK while there
+// is more to decode
+
+static TraceDqr::DQErr decodeCoreWork(Trace *trace,const PrintOptions &opts,CoreWork *work,std::vector<ITCRecord> &flush)
+{
+	TraceDqr::DQErr ec = TraceDqr::DQERR_WOULDBLOCK;
+	Instruction *instInfo = nullptr;
+	NexusMessage *msgInfo;
+	Source *srcInfo = nullptr;
+	bool itc = opts.itcPrintOpts != TraceDqr::ITC_OPT_NONE;
+	size_t numMsgs = work->msgs.size();
+
+	// only ask for the records that will be printed
+
+	Instruction **instp = opts.dasmFlag ? &instInfo : nullptr;
+	Source **srcp = (opts.srcFlag || opts.fileFlag) ? &srcInfo : nullptr;
+
+	work->records.reserve(numMsgs * 8);
+	work->msgEnd.reserve(numMsgs);
+
+	// after the messages of the last batch, push the end of the trace
+
+	for (size_t i = 0; (i < numMsgs) || ((i == numMsgs) && work->last); i++) {
+		if (i < numMsgs) {
+			if (work->traceTypes[i] != trace->getTraceType()) {
+				trace->setTraceType(work->traceTypes[i]);
+			}
+
+			ec = trace->pushTraceMsg(&work->msgs[i]);
+		}
+		else {
+			ec = trace->pushTraceMsg(nullptr);
+		}
+
+		// decode until the decoder asks for the next message
+
+		while (ec == TraceDqr::DQERR_OK) {
+			ec = trace->NextInstruction(instp,&msgInfo,srcp);
+
+			if (ec == TraceDqr::DQERR_OK) {
+				CoreRecord r;
+
+				r.haveInst = (instInfo != nullptr);
+				if (r.haveInst) {
+					r.inst = *instInfo;
+				}
+				r.haveMsg = (msgInfo != nullptr);
+				if (r.haveMsg) {
+					r.msg = *msgInfo;
+				}
+				r.haveSrc = (srcInfo != nullptr);
+				if (r.haveSrc) {
+					r.src = *srcInfo;
+				}
+				r.itcStart = work->itc.size();
+
+				if (itc) {
+					getITCRecords(trace,msgInfo,false,work->itc);
+				}
+
+				r.itcCount = work->itc.size() - r.itcStart;
+
+				work->records.push_back(r);
+			}
+		}
+
+		if (i < numMsgs) {
+			work->msgEnd.push_back(work->records.size());
+		}
+
+		if (ec != TraceDqr::DQERR_WOULDBLOCK) {
+			work->ecMsg = i;
+			break;
+		}
+	}
+
+	if (ec == TraceDqr::DQERR_WOULDBLOCK) {
+		ec = TraceDqr::DQERR_OK;
+	}
+
+	if ((ec == TraceDqr::DQERR_EOF) && itc) {
+		getITCRecords(trace,nullptr,true,flush);
+	}
+
+	work->ec = ec;
+
+	return ec;
+}
+
+static void decodeCores(CoreDecode *cd,int t)
+{
+	CoreQueue &q = cd->queues[t];
+	Trace *trace;
+	TraceDqr::DQErr ec;
+
+	trace = openTrace(*cd->traceOpts);
+
+	ec = (trace != nullptr) ? TraceDqr::DQERR_OK : TraceDqr::DQERR_ERR;
+
+	for (;;) {
+		CoreWork *work;
+
+		{
+			std::unique_lock<std::mutex> lock(cd->mutex);
+
+			while (q.work.empty() && (cd->stop == false)) {
+				cd->cv.wait(lock);
+			}
+
+			if (cd->stop) {
+				break;
+			}
+
+			work = q.work.front();
+			q.work.pop_front();
+		}
+
+		// nothing is decoded after an error. The main thread stops printing at the message it happened at
+
+		if (ec == TraceDqr::DQERR_OK) {
+			ec = decodeCoreWork(trace,*cd->printOpts,work,q.flush);
+		}
+		else {
+			work->ec = ec;
+			work->ecMsg = 0;
+		}
+
+		bool last = work->last;
+
+		{
+			std::unique_lock<std::mutex> lock(cd->mutex);
+
+			work->done = true;
+
+			cd->cv.notify_all();
+		}
+
+		if (last) {
+			break;
+		}
+	}
+
+	// the main thread prints records that point at labels and source lines owned by the Trace object,
+	// so it is deleted only after everything has been printed
+
+	{
+		std::unique_lock<std::mutex> lock(cd->mutex);
+
+		while (cd->stop == false) {
+			cd->cv.wait(lock);
+		}
+	}
+
+	if (trace != nullptr) {
+		delete trace;
+		trace = nullptr;
+	}
+}
+
+// Each thread reads the source files itself, so the same source line has a different pointer for
+// each thread. Use the pointers of the line printed last when it is the same line, so it is not
+// printed again
+
+static void matchLastSrc(const PrintState &ps,Source &src)
+{
+	if ((src.sourceFile == ps.lastSrcFile) && (src.sourceLine == ps.lastSrcLine)) {
+		return;
+	}
+
+	if ((src.sourceLineNum != ps.lastSrcLineNum) || (src.sourceFile == nullptr) || (ps.lastSrcFile == nullptr) ||
+	    (src.sourceLine == nullptr) || (ps.lastSrcLine == nullptr)) {
+		return;
+	}
+
+	if ((strcmp(src.sourceFile,ps.lastSrcFile) == 0) && (strcmp(src.sourceLine,ps.lastSrcLine) == 0)) {
+		src.sourceFile = ps.lastSrcFile;
+		src.sourceLine = ps.lastSrcLine;
+	}
+}
+
+static void deleteCoreBatch(CoreBatch *batch)
+{
+	delete [] batch->work;
+	batch->work = nullptr;
+
+	delete batch;
+}
+
+// trace is the parser, opened on the trace file with traceOpts. Returns the exit code for dqr
+
+static int decodeCoresParallel(const TraceOptions &traceOpts,const PrintOptions &printOpts,Trace *trace,int numThreads,bool progressFlag)
+{
+	int numCores = 1 << printOpts.srcbits;
+
+	if (numCores > DQR_MAXCORES) {
+		numCores = DQR_MAXCORES;
+	}
+
+	if (numThreads > numCores) {
+		numThreads = numCores;
+	}
+
+	// the threads decode the messages pushed to them, and do not read the trace file
+
+	TraceOptions workerOpts = traceOpts;
+
+	workerOpts.tfName = (char*)DQR_PUSHED_TRACE;
+
+	std::vector<CoreQueue> queues(numThreads);
+	CoreDecode cd;
+
+	cd.traceOpts = &workerOpts;
+	cd.printOpts = &printOpts;
+	cd.queues = queues.data();
+	cd.stop = false;
+
+	std::vector<std::thread> threads;
+
+	for (int i = 0; i < numThreads; i++) {
+		threads.push_back(std::thread(decodeCores,&cd,i));
+	}
+
+	std::deque<CoreBatch*> batches;
+	PrintState ps;
+	TraceDqr::DQErr rc = TraceDqr::DQERR_OK;		// trace file parse
+	TraceDqr::DQErr ec = TraceDqr::DQERR_EOF;
+	int progressCount = 0;
+	bool progressShown = false;
+
+	initPrintState(ps,true);
+
+	while (ec == TraceDqr::DQERR_EOF) {
+		// parse ahead until CORE_BATCHES batches are being decoded
+
+		while ((rc == TraceDqr::DQERR_OK) && (batches.size() < CORE_BATCHES)) {
+			CoreBatch *batch;
+
+			batch = new (std::nothrow) CoreBatch;
+			if (batch != nullptr) {
+				batch->work = new (std::nothrow) CoreWork[numThreads];
+				if (batch->work == nullptr) {
+					delete batch;
+					batch = nullptr;
+				}
+			}
+
+			if (batch == nullptr) {
+				printf("Error: Could not allocate decode buffer\n");
+
+				rc = TraceDqr::DQERR_ERR;
+				break;
+			}
+
+			batch->order.reserve(CORE_BATCH_MSGS);
+
+			while ((rc == TraceDqr::DQERR_OK) && (batch->order.size() < CORE_BATCH_MSGS)) {
+				NexusMessage *msgInfo;
+
+				rc = trace->NextRawMessage(&msgInfo);
+
+				if ((rc == TraceDqr::DQERR_OK) && (msgInfo != nullptr)) {
+					int t = msgInfo->coreId % numThreads;
+
+					batch->order.push_back(t);
+					batch->work[t].msgs.push_back(*msgInfo);
+					batch->work[t].traceTypes.push_back(trace->getTraceType());
+				}
+			}
+
+			for (int i = 0; i < numThreads; i++) {
+				batch->work[i].last = (rc != TraceDqr::DQERR_OK);
+				batch->work[i].done = false;
+				batch->work[i].ec = TraceDqr::DQERR_OK;
+				batch->work[i].ecMsg = 0;
+			}
+
+			batches.push_back(batch);
+
+			std::unique_lock<std::mutex> lock(cd.mutex);
+
+			for (int i = 0; i < numThreads; i++) {
+				queues[i].work.push_back(&batch->work[i]);
+			}
+
+			cd.cv.notify_all();
+		}
+
+		if (batches.empty()) {
+			break;
+		}
+
+		CoreBatch *batch = batches.front();
+
+		batches.pop_front();
+
+		{
+			std::unique_lock<std::mutex> lock(cd.mutex);
+
+			for (int i = 0; i < numThreads; i++) {
+				while (batch->work[i].done == false) {
+					cd.cv.wait(lock);
+				}
+			}
+		}
+
+		// print in message order, up to the first message a thread could not decode
+
+		std::vector<size_t> next(numThreads,0);
+
+		for (size_t m = 0; (m < batch->order.size()) && (ec == TraceDqr::DQERR_EOF); m++) {
+			int t = batch->order[m];
+			CoreWork &w = batch->work[t];
+			size_t i = next[t]++;
+
+			if (i < w.msgEnd.size()) {
+				for (size_t k = (i > 0) ? w.msgEnd[i-1] : 0; k < w.msgEnd[i]; k++) {
+					CoreRecord &r = w.records[k];
+
+					if (r.haveSrc) {
+						matchLastSrc(ps,r.src);
+					}
+
+					printRecord(stdout,printOpts,ps,nullptr,r.haveInst ? &r.inst : nullptr,r.haveMsg ? &r.msg : nullptr,r.haveSrc ? &r.src : nullptr,nullptr);
+
+					for (int j = 0; j < r.itcCount; j++) {
+						ITCRecord &itc = w.itc[r.itcStart + j];
+
+						printITCStr(stdout,printOpts,ps,itc.core,itc.startTime,itc.endTime,itc.s,nullptr);
+					}
+				}
+			}
+
+			if ((w.ec != TraceDqr::DQERR_OK) && (w.ec != TraceDqr::DQERR_EOF) && (i >= w.ecMsg)) {
+				ec = w.ec;
+			}
+		}
+
+		// errors at the end of the trace, after the last message
+
+		for (int i = 0; (i < numThreads) && (ec == TraceDqr::DQERR_EOF); i++) {
+			CoreWork &w = batch->work[i];
+
+			if ((w.ec != TraceDqr::DQERR_OK) && (w.ec != TraceDqr::DQERR_EOF) && (w.ecMsg >= w.msgs.size())) {
+				ec = w.ec;
+			}
+		}
+
+		deleteCoreBatch(batch);
+		batch = nullptr;
+
+		if (progressFlag) {
+			progressCount += 1;
+
+			if ((progressCount & 0x7f) == 0) {
+				int64_t size;
+				int64_t offset;
+
+				if (trace->getTraceFileOffset(size,offset) == TraceDqr::DQERR_OK) {
+					if (size > 0) {
+						fprintf(stderr,"\rProgress: %d%%",(int)(offset*100/size));
+					}
+					else {
+						fprintf(stderr,"\rProgress: %lld bytes",(long long)offset);
+					}
+
+					progressShown = true;
+				}
+			}
+		}
+	}
+
+	// everything parsed has been printed, so a parse error comes after it
+
+	if ((ec == TraceDqr::DQERR_EOF) && (rc != TraceDqr::DQERR_EOF)) {
+		ec = rc;
+	}
+
+	if (progressShown) {
+		fprintf(stderr,"\n");
+	}
+
+	if (ec == TraceDqr::DQERR_EOF) {
+		if (ps.firstPrint == false) {
+			printf("\n");
+		}
+		printf("End of Trace File\n");
+
+		// flush in core order, same as a single threaded decode
+
+		for (int core = 0; core < numCores; core++) {
+			for (auto &itc : queues[core % numThreads].flush) {
+				if (itc.core == core) {
+					printITCStr(stdout,printOpts,ps,itc.core,itc.startTime,itc.endTime,itc.s,nullptr);
+				}
+			}
+		}
+	}
+	else {
+		printf("Error (%d) terminated trace decode\n",ec);
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(cd.mutex);
+
+		cd.stop = true;
+
+		cd.cv.notify_all();
+	}
+
+	for (auto &t : threads) {
+		t.join();
+	}
+
+	for (auto batch : batches) {
+		deleteCoreBatch(batch);
+	}
+
+	batches.clear();
+
+	return (ec == TraceDqr::DQERR_EOF) ? 0 : 1;
+}
+
+// -blocks: print the executed address ranges instead of the instruction trace
+
+static int decodeBlocks(Trace *trace)
+{
+	TraceDqr::DQErr ec;
+	InstructionBlock block;
+
+	do {
+		ec = trace->NextBlock(&block);
+		if (ec == TraceDqr::DQERR_OK) {
+			printf("[%d] %08llx - %08llx %6d insts t:%llu",block.coreId,(unsigned long long)block.startAddress,(unsigned long long)block.endAddress,block.numInstructions,(unsigned long long)block.timestamp);
+
+			if (block.brFlags == TraceDqr::BRFLAG_taken) {
+				printf(" taken");
+			}
+			else if (block.brFlags == TraceDqr::BRFLAG_notTaken) {
+				printf(" not taken");
+			}
+
+			if (block.CRFlag & TraceDqr::isCall) {
+				printf(" call");
+			}
+			if (block.CRFlag & TraceDqr::isReturn) {
+				printf(" return");
+			}
+			if (block.CRFlag & TraceDqr::isSwap) {
+				printf(" swap");
+			}
+			if (block.CRFlag & TraceDqr::isInterrupt) {
+				printf(" interrupt");
+			}
+			if (block.CRFlag & TraceDqr::isException) {
+				printf(" exception");
+			}
+			if (block.CRFlag & TraceDqr::isExceptionReturn) {
+				printf(" exception return");
+			}
+
+			printf("\n");
+		}
+	} while (ec == TraceDqr::DQERR_OK);
+
+	if (ec != TraceDqr::DQERR_EOF) {
+		printf("Error (%d) terminated trace decode\n",ec);
+		return 1;
+	}
+
+	printf("End of Trace File\n");
+
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	char *tf_name = nullptr;
@@ -206,6 +1722,11 @@ int main(int argc, char *argv[])
 	char *cutPath = nullptr;
 	char *newRoot = nullptr;
 	bool ctf_flag = false;
+	bool progress_flag = false;
+	bool index_flag = false;
+	bool blocks_flag = false;
+	bool parseonly_flag = false;
+	int numThreads = 1;
 
 	for (int i = 1; i < argc; i++) {
 		if (strcmp("-t",argv[i]) == 0) {
@@ -570,6 +2091,37 @@ int main(int argc, char *argv[])
 		else if (strcmp("-nolabels",argv[i]) == 0) {
 			labelFlag = false;
 		}
+		else if (strcmp("-progress",argv[i]) == 0) {
+			progress_flag = true;
+		}
+		else if (strcmp("-noprogress",argv[i]) == 0) {
+			progress_flag = false;
+		}
+		else if (strcmp("-index",argv[i]) == 0) {
+			index_flag = true;
+		}
+		else if (strcmp("-blocks",argv[i]) == 0) {
+			blocks_flag = true;
+		}
+		else if (strcmp("-parseonly",argv[i]) == 0) {
+			parseonly_flag = true;
+		}
+		else if (strncmp("-threads=",argv[i],strlen("-threads=")) == 0) {
+			numThreads = atoi(argv[i]+strlen("-threads="));
+
+			if (numThreads < 0) {
+				printf("Error: threads must be >= 0\n");
+				return 1;
+			}
+
+			if (numThreads == 0) {
+				numThreads = std::thread::hardware_concurrency();
+
+				if (numThreads == 0) {
+					numThreads = 1;
+				}
+			}
+		}
 		else if (strcmp("-debug",argv[i]) == 0) {
 			globalDebugFlag = 1;
 		}
@@ -625,6 +2177,83 @@ int main(int argc, char *argv[])
 		buff_index += strlen(ef_name) + 1;
 	}
 
+	if (index_flag) {
+		if ((tf_name == nullptr) || (strcmp(tf_name,"-") == 0)) {
+			printf("Error: -index requires a trace file (-t or -n flag)\n");
+			return 1;
+		}
+
+		char *idx_name;
+		TraceDqr::DQErr rc;
+
+		idx_name = new (std::nothrow) char[strlen(tf_name) + sizeof ".idx"];
+		if (idx_name == nullptr) {
+			printf("Error: Could not allocate index file name\n");
+			return 1;
+		}
+
+		strcpy(idx_name,tf_name);
+		strcat(idx_name,".idx");
+
+		TraceIndex index;
+
+		rc = index.build(tf_name,srcbits,tssize);
+		if (rc == TraceDqr::DQERR_OK) {
+			rc = index.save(idx_name);
+		}
+
+		if (rc != TraceDqr::DQERR_OK) {
+			printf("Error: Could not create index file %s\n",idx_name);
+			delete [] idx_name;
+			return 1;
+		}
+
+		printf("Wrote %s: %lld sync messages out of %lld trace messages\n",idx_name,(long long)index.getNumEntries(),(long long)index.getNumMsgs());
+
+		delete [] idx_name;
+
+		return 0;
+	}
+
+	// without an elf file there are no instructions to follow, and a full decode stops at the first one.
+	// Only the messages and message analytics can be shown, so parse only. With an elf file -analytics
+	// includes instruction counts, so -parseonly is still needed to skip the decode
+
+	if ((tf_name != nullptr) && (ef_name == nullptr) && (pf_name == nullptr) && (sf_name == nullptr) &&
+	    (ca_name == nullptr) && (ctf_flag == false) && (blocks_flag == false)) {
+		parseonly_flag = true;
+	}
+
+	if (parseonly_flag) {
+		if ((sf_name != nullptr) || (ca_name != nullptr) || ctf_flag || blocks_flag) {
+			printf("Error: -parseonly cannot be used with -s, -ca, -ctf, or -blocks\n");
+			return 1;
+		}
+
+		// messages are not followed into the program, so there is no need to read the elf file
+
+		ef_name = nullptr;
+	}
+
+	TraceOptions traceOpts;
+
+	traceOpts.tfName = tf_name;
+	traceOpts.efName = ef_name;
+	traceOpts.pfName = pf_name;
+	traceOpts.numAddrBits = numAddrBits;
+	traceOpts.addrDispFlags = addrDispFlags;
+	traceOpts.srcbits = srcbits;
+	traceOpts.freq = freq;
+	traceOpts.traceType = traceType;
+	traceOpts.tssize = tssize;
+	traceOpts.pt = pt;
+	traceOpts.cutPath = cutPath;
+	traceOpts.newRoot = newRoot;
+	traceOpts.itcPrintOpts = itcPrintOpts;
+	traceOpts.itcPrintChannel = itcPrintChannel;
+	traceOpts.labelFlag = labelFlag;
+	traceOpts.parseOnly = parseonly_flag;
+
 	Trace *trace = nullptr;
 	Simulator *sim = nullptr;
 
@@ -676,44 +2305,14 @@ int main(int argc, char *argv[])
 				printf("Error: cannot specify -e flag when -pf is also specified\n");
 				return 1;
 			}
-
-			trace = new (std::nothrow) Trace(pf_name);
-
-			if (trace == nullptr) {
-				printf("Error: Could not create Trace object\n");
-
-				return 1;
-			}
-
-			if (trace->getStatus() != TraceDqr::DQERR_OK) {
-				delete trace;
-				trace = nullptr;
-
-				printf("Error: new Trace() failed\n",pf_name);
-
-				return 1;
-			}
 		}
-		else {
-			trace = new (std::nothrow) Trace(tf_name,ef_name,numAddrBits,addrDispFlags,srcbits,freq);
-
-			if (trace == nullptr) {
-				printf("Error: Could not create Trace object\n");
-
-				return 1;
-			}
-
-			if (trace->getStatus() != TraceDqr::DQERR_OK) {
-				delete trace;
-				trace = nullptr;
-
-				printf("Error: new Trace(%s,%s) failed\n",tf_name,ef_name);
-
-				return 1;
-			}
 
-			trace->setTraceType(traceType);
+		trace = openTrace(traceOpts);
+		if (trace == nullptr) {
+			return 1;
+		}
 
+		if (pf_name == nullptr) {
 			if (ca_name != nullptr) {
 				rc = trace->setCATraceFile(ca_name,caType);
 				if (rc != TraceDqr::DQERR_OK) {
@@ -722,26 +2321,6 @@ int main(int argc, char *argv[])
 				}
 			}
 
-			trace->setTSSize(tssize);
-			trace->setPathType(pt);
-
-			if (cutPath != nullptr) {
-				rc = trace->subSrcPath(cutPath,newRoot);
-				if (rc != TraceDqr::DQERR_OK) {
-					printf("Error: Could not set cutPath or newRoot\n");
-					return 1;
-				}
-			}
-
-			// NLS is on by default when the trace object is created. Only
-			// set the print options if something has changed
-
-			if (itcPrintOpts != TraceDqr::ITC_OPT_NLS) {
-				trace->setITCPrintOptions(itcPrintOpts,4096,itcPrintChannel);
-			}
-
-			trace->setLabelMode(labelFlag);
-
 			if (ctf_flag != false) {
 				rc = trace->enableCTFConverter(-1,nullptr);
 				if (rc != TraceDqr::DQERR_OK) {
@@ -782,296 +2361,138 @@ int main(int argc, char *argv[])
 //
 //	should look at source code display!
 
-	Instruction *instInfo;
-	NexusMessage *msgInfo;
-	Source *srcInfo;
-	char dst[10000];
-	int instlevel = 1;
-	const char *lastSrcFile = nullptr;
-	const char *lastSrcLine = nullptr;
-	unsigned int lastSrcLineNum = 0;
-	TraceDqr::ADDRESS lastAddress = 0;
-	int lastInstSize = 0;
-	bool firstPrint = true;
-	uint32_t core_mask = 0;
-	TraceDqr::TIMESTAMP startTime, endTime;
-
-	do {
-		if (sim != nullptr) {
-			ec = sim->NextInstruction(&instInfo,&msgInfo,&srcInfo);
-		}
-		else {
-			ec = trace->NextInstruction(&instInfo,&msgInfo,&srcInfo);
-		}
-
-		if (ec == TraceDqr::DQERR_OK) {
-			if (srcInfo != nullptr) {
-				if ((lastSrcFile != srcInfo->sourceFile) || (lastSrcLine != srcInfo->sourceLine) || (lastSrcLineNum != srcInfo->sourceLineNum)) {
-					lastSrcFile = srcInfo->sourceFile;
-					lastSrcLine = srcInfo->sourceLine;
-					lastSrcLineNum = srcInfo->sourceLineNum;
-
-					if (file_flag) {
-						if (srcInfo->sourceFile != nullptr) {
-							if (firstPrint == false) {
-								printf("\n");
-							}
-
-							const char *sfp;
-
-							sfp = stripPath(strip_flag,srcInfo->sourceFile);
-
-							if (srcbits > 0) {
-								printf("[%d] ",srcInfo->coreId);
-							}
-
-							int sfpl = 0;
-							int sfl = 0;
-							int stripped = 0;
-
-							if (sfp != srcInfo->sourceFile) {
-								sfpl = strlen(sfp);
-								sfl = strlen(srcInfo->sourceFile);
-								stripped = sfl - sfpl;
-							}
-
-							if (stripped < srcInfo->cutPathIndex) {
-								printf("File: [");
-
-								if (sfp != srcInfo->sourceFile) {
-									printf("..");
-								}
-
-								for (int i = stripped; i < srcInfo->cutPathIndex; i++) {
-									printf("%c",srcInfo->sourceFile[i]);
-								}
-
-								printf("]%s:%d\n",&srcInfo->sourceFile[srcInfo->cutPathIndex],srcInfo->sourceLineNum);
-							}
-							else {
-								if (sfp != srcInfo->sourceFile) {
-									printf("File: ..%s:%d\n",sfp,srcInfo->sourceLineNum);
-								}
-								else {
-									printf("File: %s:%d\n",sfp,srcInfo->sourceLineNum);
-								}
-							}
-
-							firstPrint = false;
-						}
-					}
-
-					if (src_flag) {
-						if (srcInfo->sourceLine != nullptr) {
-							if (srcbits > 0) {
-								printf("[%d] Source: %s\n",srcInfo->coreId,srcInfo->sourceLine);
-							}
-							else {
-								printf("Source: %s\n",srcInfo->sourceLine);
-							}
-
-							firstPrint = false;
-						}
-					}
-				}
-			}
-
-			if (dasm_flag && (instInfo != nullptr)) {
-				instInfo->addressToText(dst,sizeof dst,0);
-
-				if (func_flag) {
-					if (srcbits > 0) {
-						printf("[%d] ",instInfo->coreId);
-					}
-					if (instInfo->address != (lastAddress + lastInstSize / 8)) {
-						if (instInfo->addressLabel != nullptr) {
-							printf("<%s",instInfo->addressLabel);
-							if (instInfo->addressLabelOffset != 0) {
-								printf("+%x",instInfo->addressLabelOffset);
-							}
-							printf(">\n");
-						}
-					}
-
-					lastAddress = instInfo->address;
-					lastInstSize = instInfo->instSize;
-				}
+	PrintOptions printOpts;
 
-				if (srcbits > 0) {
-					printf("[%d] ", instInfo->coreId);
-				}
+	printOpts.srcFlag = src_flag;
+	printOpts.fileFlag = file_flag;
+	printOpts.dasmFlag = dasm_flag;
+	printOpts.funcFlag = func_flag;
+	printOpts.traceFlag = trace_flag;
+	printOpts.showBranches = showBranches;
+	printOpts.showCallsReturns = showCallsReturns;
+	printOpts.showCycles = (sim != nullptr) || (ca_name != nullptr);
+	printOpts.stripFlag = strip_flag;
+	printOpts.srcbits = srcbits;
+	printOpts.msgLevel = msgLevel;
+	printOpts.itcPrintOpts = itcPrintOpts;
 
-				int n;
+	if (blocks_flag && (trace != nullptr)) {
+		int rc;
 
-				if (((sim != nullptr) || (ca_name != nullptr)) && (instInfo->timestamp != 0)) {
-					n = printf("t:%d ",instInfo->timestamp);
+		rc = decodeBlocks(trace);
 
-					if (instInfo->caFlags & (TraceDqr::CAFLAG_PIPE0 | TraceDqr::CAFLAG_PIPE1)) {
-						if (instInfo->caFlags & TraceDqr::CAFLAG_PIPE0) {
-							n += printf("[0:%d",instInfo->pipeCycles);
-						}
-						else if (instInfo->caFlags & TraceDqr::CAFLAG_PIPE1) {
-							n += printf("[1:%d",instInfo->pipeCycles);
-						}
+		trace->cleanUp();
 
-						if (instInfo->caFlags & TraceDqr::CAFLAG_VSTART) {
-							n += printf("(%d)-%d(%dA,%dL,%dS)",instInfo->qDepth,instInfo->VIStartCycles,instInfo->arithInProcess,instInfo->loadInProcess,instInfo->storeInProcess);
-																					}
+		delete trace;
+		trace = nullptr;
 
-						if (instInfo->caFlags & TraceDqr::CAFLAG_VARITH) {
-							n += printf("-%dA",instInfo->VIFinishCycles);
-						}
+		return rc;
+	}
 
-						if (instInfo->caFlags & TraceDqr::CAFLAG_VLOAD) {
-							n += printf("-%dL",instInfo->VIFinishCycles);
-						}
+	// parallel decode of a single core trace needs to seek to sync messages, and a single stream of
+	// instructions that does not depend on state from earlier in the trace. Multi-core traces are
+	// decoded a core per thread instead. Automatic address width (-32+) depends on every address
+	// printed before, so it is only done single threaded
 
-						if (instInfo->caFlags & TraceDqr::CAFLAG_VSTORE) {
-							n += printf("-%dS",instInfo->VIFinishCycles);
-						}
+	bool widthAuto = (addrDispFlags & TraceDqr::ADDRDISP_WIDTHAUTO) != 0;
 
-						n += printf("] ");
-					}
+	if ((numThreads > 1) && (trace != nullptr) && (pf_name == nullptr) && (widthAuto == false) &&
+	    (srcbits > 0) && (ca_name == nullptr) && (ctf_flag == false) && (analytics_detail == 0) && (parseonly_flag == false)) {
+		int rc;
 
-					for (int i = n; i < 14; i++) {
-						printf(" ");
-					}
-				}
+		rc = decodeCoresParallel(traceOpts,printOpts,trace,numThreads,progress_flag);
 
-				n = printf("    %s:",dst);
+		trace->cleanUp();
 
-				for (int i = n; i < 20; i++) {
-					printf(" ");
-				}
+		delete trace;
+		trace = nullptr;
 
-				instInfo->instructionToText(dst,sizeof dst,instlevel);
-				printf("  %s",dst);
-
-				if (showBranches == true) {
-					switch (instInfo->brFlags) {
-					case TraceDqr::BRFLAG_none:
-						break;
-					case TraceDqr::BRFLAG_unknown:
-						printf(" [u]");
-						break;
-					case TraceDqr::BRFLAG_taken:
-						printf(" [t]");
-						break;
-					case TraceDqr::BRFLAG_notTaken:
-						printf(" [nt]");
-						break;
-					}
-				}
+		return rc;
+	}
 
-				if (showCallsReturns == true) {
-					if (instInfo->CRFlag != TraceDqr::isNone) {
-						const char *format = "%s";
+	if ((numThreads > 1) && (trace != nullptr) && (pf_name == nullptr) && (strcmp(tf_name,"-") != 0) && (widthAuto == false) &&
+	    (srcbits == 0) && (ca_name == nullptr) && (ctf_flag == false) && (analytics_detail == 0) && (parseonly_flag == false)) {
+		int rc;
 
-						printf(" [");
+		rc = decodeParallel(traceOpts,printOpts,trace,numThreads,progress_flag);
+		if (rc >= 0) {
+			trace->cleanUp();
 
-						if (instInfo->CRFlag & TraceDqr::isCall) {
-							printf(format,"Call");
-							format = ",%s";
-						}
+			delete trace;
+			trace = nullptr;
 
-						if (instInfo->CRFlag & TraceDqr::isReturn) {
-							printf(format,"Return");
-							format = ",%s";
-						}
+			return rc;
+		}
+	}
 
-						if (instInfo->CRFlag & TraceDqr::isSwap) {
-							printf(format,"Swap");
-							format = ",%s";
-						}
+	Instruction *instInfo;
+	NexusMessage *msgInfo;
+	Source *srcInfo;
+	char dst[10000];
+	PrintState ps;
+	int progressCount = 0;
+	bool progressShown = false;
 
-						if (instInfo->CRFlag & TraceDqr::isInterrupt) {
-							printf(format,"Interrupt");
-							format = ",%s";
-						}
+	// records that will not be printed are not asked for, so the decoder can retire straight-line
+	// code a basic block at a time
 
-						if (instInfo->CRFlag & TraceDqr::isException) {
-							printf(format,"Exception");
-							format = ",%s";
-						}
+	Instruction **instp = printOpts.dasmFlag ? &instInfo : nullptr;
+	Source **srcp = (printOpts.srcFlag || printOpts.fileFlag) ? &srcInfo : nullptr;
 
-						if (instInfo->CRFlag & TraceDqr::isExceptionReturn) {
-							printf(format,"Exception Return");
-							format = ",%s";
-						}
+	instInfo = nullptr;
+	srcInfo = nullptr;
 
-						printf("]");
-					}
-				}
+	// sleep until a live SWT trace sends more, instead of spinning on it
 
-				printf("\n");
+	if ((trace != nullptr) && (trace->getTraceFd() >= 0)) {
+		trace->setWouldBlock(true);
+	}
 
-				firstPrint = false;
-			}
+	initPrintState(ps,true);
 
-			if ((trace != nullptr) && trace_flag && (msgInfo != nullptr)) {
-				// got the goods! Get to it!
+	do {
+		if (sim != nullptr) {
+			ec = sim->NextInstruction(&instInfo,&msgInfo,&srcInfo);
+		}
+		else if (parseonly_flag) {
+			ec = trace->NextMessage(&msgInfo);
+		}
+		else {
+			ec = trace->NextInstruction(instp,&msgInfo,srcp);
+		}
 
-				if (globalDebugFlag) {
-					msgInfo->dumpRawMessage();
-				}
+		if (ec == TraceDqr::DQERR_WOULDBLOCK) {
+			ec = trace->waitForTraceData(-1);
+			continue;
+		}
 
-				msgInfo->messageToText(dst,sizeof dst,msgLevel);
+		if (progress_flag && (trace != nullptr) && ((++progressCount & 0xffff) == 0)) {
+			int64_t size;
+			int64_t offset;
 
-				if (firstPrint == false) {
-					printf("\n");
+			if (trace->getTraceFileOffset(size,offset) == TraceDqr::DQERR_OK) {
+				if (size > 0) {
+					fprintf(stderr,"\rProgress: %d%%",(int)(offset*100/size));
 				}
-
-				if (srcbits > 0) {
-					printf("[%d] ",msgInfo->coreId);
+				else {
+					fprintf(stderr,"\rProgress: %lld bytes",(long long)offset);
 				}
 
-				printf("Trace: %s",dst);
-
-				printf("\n");
-
-				firstPrint = false;
+				progressShown = true;
 			}
+		}
 
-			if ((trace != nullptr) && (itcPrintOpts != TraceDqr::ITC_OPT_NONE)) {
-				std::string s;
-				bool haveStr;
-
-				core_mask = trace->getITCPrintMask();
-
-				for (int core = 0; core_mask != 0; core++) {
-					if (core_mask & 1) {
-						s = trace->getITCPrintStr(core,haveStr,startTime,endTime);
-						while (haveStr != false) {
-							if (firstPrint == false) {
-								printf("\n");
-							}
-
-							if (srcbits > 0) {
-								printf("[%d] ",msgInfo->coreId);
-							}
-
-							std::cout << "ITC Print: ";
-
-							if ((startTime != 0) || (endTime != 0)) {
-								std::cout << "Msg Tics: <" << startTime << "-" << endTime << "> ";
-							}
-
-							std::cout << s;
-
-							firstPrint = false;
-
-							s = trace->getITCPrintStr(core,haveStr,startTime,endTime);
-						}
-					}
-
-					core_mask >>= 1;
-				}
-			}
+		if (ec == TraceDqr::DQERR_OK) {
+			printRecord(stdout,printOpts,ps,trace,instInfo,msgInfo,srcInfo,nullptr);
 		}
 	} while (ec == TraceDqr::DQERR_OK);
 
+	if (progressShown) {
+		fprintf(stderr,"\n");
+	}
+
 	if (ec == TraceDqr::DQERR_EOF) {
-		if (firstPrint == false) {
+		if (ps.firstPrint == false) {
 			printf("\n");
 		}
 		printf("End of Trace File\n");
@@ -1082,41 +2503,11 @@ int main(int argc, char *argv[])
 	}
 
 	if ((trace != nullptr) && (itcPrintOpts != TraceDqr::ITC_OPT_NONE)) {
-		std::string s = "";
-		bool haveStr;
-
-		core_mask = trace->getITCFlushMask();
-
-		for (int core = 0; core_mask != 0; core++) {
-			if (core_mask & 1) {
-				s = trace->flushITCPrintStr(core,haveStr,startTime,endTime);
-				while (haveStr != false) {
-					if (firstPrint == false) {
-						printf("\n");
-					}
-
-					if (srcbits > 0) {
-						printf("[%d] ",core);
-					}
-
-					std::cout << "ITC Print: ";
-
-					if ((startTime != 0) || (endTime != 0)) {
-						std::cout << "Msg Tics: <" << startTime << "-" << endTime << "> ";
-					}
-
-					std::cout << s;
-
-					firstPrint = false;
-
-					s = trace->flushITCPrintStr(core,haveStr,startTime,endTime);
-				}
-			}
-
-			core_mask >>= 1;
-		}
+		printITC(stdout,printOpts,ps,trace,nullptr,true,nullptr);
 	}
 
+	bool firstPrint = ps.firstPrint;
+
 	if (analytics_detail > 0) {
 		if (trace != nullptr) {
 			trace->analyticsToText(dst,sizeof dst,analytics_detail);
@@ -1125,6 +2516,14 @@ int main(int argc, char *argv[])
 			}
 			firstPrint = false;
 			printf("%s",dst);
+
+			int64_t blocks;
+			int64_t stalls;
+
+			if (trace->getTraceFileReadStats(blocks,stalls) == TraceDqr::DQERR_OK) {
+				printf("\nTrace file blocks read:   %lld\n",(long long)blocks);
+				printf("Reader stalls:            %lld\n",(long long)stalls);
+			}
 		}
 		if (sim != nullptr) {
 			sim->analyticsToText(dst,sizeof dst,analytics_detail);
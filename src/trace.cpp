@@ -231,25 +231,19 @@ CATrace::CATrace(char *caf_name,TraceDqr::CATraceType catype)
 		return;
 	}
 
-	std::ifstream catf;
+	// read file into buffer, decompressing it if it is gzipped
 
-	catf.open(caf_name, std::ios::in | std::ios::binary);
+	char *buff;
+	int64_t size;
 
-	if (!catf) {
+	if (loadFile(caf_name,buff,size) != TraceDqr::DQERR_OK) {
 		printf("Error: CATrace::CATrace(): could not open cycle accurate trace file %s for input\n",caf_name);
 		status = TraceDqr::DQERR_OPEN;
 		return;
 	}
 
-	catf.seekg(0, catf.end);
-	caBufferSize = catf.tellg();
-	catf.seekg(0, catf.beg);
-
-	caBuffer = new uint8_t[caBufferSize];
-
-	catf.read((char*)caBuffer,caBufferSize);
-
-	catf.close();
+	caBuffer = (uint8_t*)buff;
+	caBufferSize = (int)size;
 
 //	printf("caBufferSize: %d\n",caBufferSize);
 //
@@ -4953,6 +4947,7 @@ TraceDqr::DQErr Trace::configure(TraceSettings &settings)
 	disassembler = nullptr;
 	caTrace      = nullptr;
 	counts       = nullptr;//delete this line if compile error
+	bbCache      = nullptr;
 	efName       = nullptr;
 	rtdName      = nullptr;
 	cutPath      = nullptr;
@@ -4962,7 +4957,11 @@ TraceDqr::DQErr Trace::configure(TraceSettings &settings)
 	ctf          = nullptr;
 	eventConverter = nullptr;
 	eventFilterMask = 0;
+	msgsPushed = false;
+	pushedMsg = nullptr;
+	pushedMsgsEnd = false;
 	perfConverter = nullptr;
+	traceIndex   = nullptr;
 
 	syncCount = 0;
 	caSyncAddr = (TraceDqr::ADDRESS)-1;
@@ -5125,6 +5124,17 @@ TraceDqr::DQErr Trace::configure(TraceSettings &settings)
 
 	counts = new Count[DQR_MAXCORES];
 
+	// if this fails, instructions are just retired one at a time
+
+	bbCache = new (std::nothrow) BasicBlockCache;
+
+	blockMode = false;
+	resetBlocks();
+
+	// pushed traces only get more data when the caller pushes it, so they always say when they need it
+
+	wouldBlock = (strcmp(settings.tfName,DQR_PUSHED_TRACE) == 0);
+
 	for (int i = 0; (size_t)i < sizeof state / sizeof state[0]; i++ ) {
 		state[i] = TRACE_STATE_GETFIRSTSYNCMSG;
 	}
@@ -5150,6 +5160,7 @@ TraceDqr::DQErr Trace::configure(TraceSettings &settings)
 	instructionInfo.address = 0;
 	instructionInfo.instruction = 0;
 	instructionInfo.instSize = 0;
+	instructionInfo.instructionText = nullptr;
 
 	if (settings.numAddrBits != 0 ) {
 		instructionInfo.addrSize = settings.numAddrBits;
@@ -5342,6 +5353,11 @@ void Trace::cleanUp()
 		counts = nullptr;
 	}
 
+	if (bbCache != nullptr) {
+		delete bbCache;
+		bbCache = nullptr;
+	}
+
 	if (disassembler != nullptr) {
 		delete disassembler;
 		disassembler = nullptr;
@@ -5366,6 +5382,11 @@ void Trace::cleanUp()
 		delete perfConverter;
 		perfConverter = nullptr;
 	}
+
+	if (traceIndex != nullptr) {
+		delete traceIndex;
+		traceIndex = nullptr;
+	}
 }
 
 const char *Trace::version()
@@ -5635,509 +5656,1787 @@ TraceDqr::DQErr Trace::getNumBytesInSWTQ(int &numBytes)
 	return sfp->getNumBytesInSWTQ(numBytes);
 }
 
-TraceDqr::DQErr Trace::getTraceFileOffset(int &size,int &offset)
+TraceDqr::DQErr Trace::setWouldBlock(bool wb)
 {
-	return sfp->getFileOffset(size,offset);
-}
+	if ((wb == false) && (strcmp(rtdName,DQR_PUSHED_TRACE) == 0)) {
+		printf("Error: Trace::setWouldBlock(): Pushed traces always return DQERR_WOULDBLOCK\n");
 
-int Trace::getITCPrintMask()
-{
-	if (itcPrint == nullptr) {
-		return 0;
+		return TraceDqr::DQERR_ERR;
 	}
 
-	return itcPrint->getITCPrintMask();
+	wouldBlock = wb;
+
+	return TraceDqr::DQERR_OK;
 }
 
-int Trace::getITCFlushMask()
+// socket of an SWT trace, or -1 for trace files and pushed traces
+
+int Trace::getTraceFd()
 {
-	if (itcPrint == nullptr) {
-		return 0;
+	if (sfp == nullptr) {
+		return -1;
 	}
 
-	return itcPrint->getITCFlushMask();
+	return sfp->getSocket();
 }
 
-TraceDqr::ADDRESS Trace::computeAddress()
+TraceDqr::DQErr Trace::waitForTraceData(int timeoutMs)
 {
-	switch (nm.tcode) {
-	case TraceDqr::TCODE_DEBUG_STATUS:
-		break;
-	case TraceDqr::TCODE_DEVICE_ID:
-		break;
-	case TraceDqr::TCODE_OWNERSHIP_TRACE:
-		break;
-	case TraceDqr::TCODE_DIRECT_BRANCH:
-//		currentAddress = target of branch.
-		break;
-	case TraceDqr::TCODE_INDIRECT_BRANCH:
-		currentAddress[currentCore] = currentAddress[currentCore] ^ (nm.indirectBranch.u_addr << 1);	// note - this is the next address!
-		break;
-	case TraceDqr::TCODE_DATA_WRITE:
-		break;
-	case TraceDqr::TCODE_DATA_READ:
-		break;
-	case TraceDqr::TCODE_DATA_ACQUISITION:
-		break;
-	case TraceDqr::TCODE_ERROR:
-		break;
-	case TraceDqr::TCODE_SYNC:
-		currentAddress[currentCore] = nm.sync.f_addr << 1;
-		break;
-	case TraceDqr::TCODE_CORRECTION:
-		break;
-	case TraceDqr::TCODE_DIRECT_BRANCH_WS:
-		currentAddress[currentCore] = nm.directBranchWS.f_addr << 1;
-		break;
-	case TraceDqr::TCODE_INDIRECT_BRANCH_WS:
-		currentAddress[currentCore] = nm.indirectBranchWS.f_addr << 1;
-		break;
-	case TraceDqr::TCODE_DATA_WRITE_WS:
-		break;
-	case TraceDqr::TCODE_DATA_READ_WS:
-		break;
-	case TraceDqr::TCODE_WATCHPOINT:
-		break;
-	case TraceDqr::TCODE_CORRELATION:
-		break;
-	case TraceDqr::TCODE_INDIRECTBRANCHHISTORY:
-		currentAddress[currentCore] = currentAddress[currentCore] ^ (nm.indirectHistory.u_addr << 1);	// note - this is the next address!
-		break;
-	case TraceDqr::TCODE_INDIRECTBRANCHHISTORY_WS:
-		currentAddress[currentCore] = nm.indirectHistoryWS.f_addr << 1;
-		break;
-	case TraceDqr::TCODE_RESOURCEFULL:
-		break;
-	default:
-		break;
+	if (sfp == nullptr) {
+		printf("Error: Trace::waitForTraceData(): Null sfp object\n");
+
+		return TraceDqr::DQERR_ERR;
 	}
 
-	std::cout << "New address 0x" << std::hex << currentAddress[currentCore] << std::dec << std::endl;
+	if (status != TraceDqr::DQERR_OK) {
+		return status;
+	}
 
-	return currentAddress[currentCore];
+	return sfp->waitForData(timeoutMs);
 }
 
-int Trace::Disassemble(TraceDqr::ADDRESS addr)
+// consumed is how much of data there was room for; push the rest after decoding what was taken
+
+TraceDqr::DQErr Trace::pushTraceData(const uint8_t *data,int size,int &consumed)
 {
-	if (disassembler == nullptr) {
-		printf("Error: Trace::Disassemble(): No disassembler object\n");
+	consumed = 0;
 
-		status = TraceDqr::DQERR_ERR;
+	if (sfp == nullptr) {
+		printf("Error: Trace::pushTraceData(): Null sfp object\n");
 
-		return 0;
+		return TraceDqr::DQERR_ERR;
 	}
 
-	int   rc;
-	TraceDqr::DQErr s;
+	if (strcmp(rtdName,DQR_PUSHED_TRACE) != 0) {
+		printf("Error: Trace::pushTraceData(): Trace was not created with DQR_PUSHED_TRACE\n");
 
-	rc = disassembler->Disassemble(addr);
+		return TraceDqr::DQERR_ERR;
+	}
 
-	s = disassembler->getStatus();
+	if ((data == nullptr) && (size > 0)) {
+		printf("Error: Trace::pushTraceData(): Argument data is null\n");
 
-	if (s != TraceDqr::DQERR_OK ) {
-	  status = s;
-	  return 0;
+		return TraceDqr::DQERR_ERR;
 	}
 
-	// the two lines below copy each structure completely. This is probably
-	// pretty inefficient, and just returning pointers and using pointers
-	// would likely be better
+	consumed = sfp->pushData(data,size);
 
-	instructionInfo = disassembler->getInstructionInfo();
-	sourceInfo = disassembler->getSourceInfo();
-
-	return rc;
+	return TraceDqr::DQERR_OK;
 }
 
-const char *Trace::getSymbolByAddress(TraceDqr::ADDRESS addr)
-{
-	return symtab->getSymbolByAddress(addr);
-}
+// msgInfo is copied when it is decoded, so it can be reused once NextInstruction() asks for more
 
-const char *Trace::getNextSymbolByAddress()
+TraceDqr::DQErr Trace::pushTraceMsg(const NexusMessage *msgInfo)
 {
-	return symtab->getNextSymbolByAddress();
-}
+	if (strcmp(rtdName,DQR_PUSHED_TRACE) != 0) {
+		printf("Error: Trace::pushTraceMsg(): Trace was not created with DQR_PUSHED_TRACE\n");
 
-TraceDqr::DQErr Trace::setITCPrintOptions(int itcFlags,int buffSize,int channel)
-{
-	if (itcPrint != nullptr) {
-		delete itcPrint;
-		itcPrint = nullptr;
+		return TraceDqr::DQERR_ERR;
 	}
 
-	if (itcFlags != TraceDqr::ITC_OPT_NONE) {
-		if ((nlsStrings == nullptr) && (elfReader != nullptr)) {
-			TraceDqr::DQErr rc;
+	if (pushedMsgsEnd) {
+		printf("Error: Trace::pushTraceMsg(): End of trace was already pushed\n");
 
-			nlsStrings = new TraceDqr::nlStrings[32];
+		return TraceDqr::DQERR_ERR;
+	}
 
-			rc = elfReader->parseNLSStrings(nlsStrings);
-			if (rc != TraceDqr::DQERR_OK) {
-				status = rc;
+	if (pushedMsg != nullptr) {
+		printf("Error: Trace::pushTraceMsg(): Previous message has not been decoded\n");
 
-				delete [] nlsStrings;
-				nlsStrings = nullptr;
+		return TraceDqr::DQERR_ERR;
+	}
 
-				return rc;
-			}
-		}
+	msgsPushed = true;
 
-		itcPrint = new ITCPrint(itcFlags,1 << srcbits,buffSize,channel,nlsStrings);
+	if (msgInfo == nullptr) {
+		pushedMsgsEnd = true;
+	}
+	else {
+		pushedMsg = msgInfo;
 	}
 
 	return TraceDqr::DQERR_OK;
 }
 
-TraceDqr::DQErr Trace::haveITCPrintData(int numMsgs[DQR_MAXCORES], bool havePrintData[DQR_MAXCORES])
+TraceDqr::DQErr Trace::decodeTraceData(const uint8_t *data,int size,TraceRecordCallback callback,void *arg,int flags)
 {
-	if (itcPrint == nullptr) {
+	if (callback == nullptr) {
+		printf("Error: Trace::decodeTraceData(): Argument callback is null\n");
+
 		return TraceDqr::DQERR_ERR;
 	}
 
-	itcPrint->haveITCPrintData(numMsgs, havePrintData);
+	Instruction  *instInfo;
+	NexusMessage *msgInfo;
+	Source       *srcInfo;
+
+	Instruction  **instp = (flags & TraceDqr::TRACE_HAVE_INSTINFO) ? &instInfo : nullptr;
+	NexusMessage **msgp  = (flags & TraceDqr::TRACE_HAVE_MSGINFO) ? &msgInfo : nullptr;
+	Source       **srcp  = (flags & TraceDqr::TRACE_HAVE_SRCINFO) ? &srcInfo : nullptr;
+
+	TraceDqr::DQErr rc;
+	int pos = 0;
+
+	do {
+		int consumed;
+
+		rc = pushTraceData(data+pos,size-pos,consumed);
+		if (rc != TraceDqr::DQERR_OK) {
+			return rc;
+		}
+
+		pos += consumed;
+
+		// decode everything the pushed bytes complete, until the decoder needs more
+
+		for (;;) {
+			instInfo = nullptr;
+			msgInfo = nullptr;
+			srcInfo = nullptr;
+
+			rc = NextInstruction(instp,msgp,srcp);
+			if (rc != TraceDqr::DQERR_OK) {
+				break;
+			}
+
+			if ((instInfo != nullptr) || (msgInfo != nullptr) || (srcInfo != nullptr)) {
+				callback(arg,instInfo,msgInfo,srcInfo);
+			}
+		}
+
+		if (rc != TraceDqr::DQERR_WOULDBLOCK) {
+			return rc;
+		}
+	} while (pos < size);
 
 	return TraceDqr::DQERR_OK;
 }
 
-bool Trace::getITCPrintMsg(int core, char *dst, int dstLen, TraceDqr::TIMESTAMP &startTime, TraceDqr::TIMESTAMP &endTime)
+TraceDqr::DQErr Trace::getTraceFileOffset(int64_t &size,int64_t &offset)
 {
-	if (itcPrint == nullptr) {
-		return false;
-	}
-
-	return itcPrint->getITCPrintMsg(core,dst,dstLen,startTime,endTime);
+	return sfp->getFileOffset(size,offset);
 }
 
-bool Trace::flushITCPrintMsg(int core, char *dst, int dstLen,TraceDqr::TIMESTAMP &startTime,TraceDqr::TIMESTAMP &endTime)
+// blocks read and parser stalls waiting on data, when the trace file is read through the
+// prefetching block reader (network file systems, pipes) instead of being memory mapped
+
+TraceDqr::DQErr Trace::getTraceFileReadStats(int64_t &blocks,int64_t &stalls)
 {
-	if (itcPrint == nullptr) {
-		return false;
+	if (sfp == nullptr) {
+		return TraceDqr::DQERR_ERR;
 	}
 
-	return itcPrint->flushITCPrintMsg(core,dst,dstLen,startTime,endTime);
+	return sfp->getReadStats(blocks,stalls);
 }
 
-std::string Trace::getITCPrintStr(int core, bool &haveData,TraceDqr::TIMESTAMP &startTime,TraceDqr::TIMESTAMP &endTime)
+TraceDqr::DQErr Trace::setTraceIndex(char *idx_name)
 {
-	std::string s = "";
+	TraceIndex *index;
+	TraceDqr::DQErr rc;
 
-	if (itcPrint == nullptr) {
-		haveData = false;
+	index = new (std::nothrow) TraceIndex;
+	if (index == nullptr) {
+		printf("Error: Trace::setTraceIndex(): Could not create TraceIndex object\n");
+
+		return TraceDqr::DQERR_ERR;
 	}
-	else {
-		haveData = itcPrint->getITCPrintStr(core,s,startTime,endTime);
+
+	rc = index->open(idx_name);
+	if (rc != TraceDqr::DQERR_OK) {
+		delete index;
+		index = nullptr;
+
+		return rc;
 	}
 
-	return s;
-}
+	if (index->getSrcBits() != srcbits) {
+		printf("Error: Trace::setTraceIndex(): Index %s was built with srcbits %d, trace uses %d\n",idx_name,index->getSrcBits(),srcbits);
 
-std::string Trace::getITCPrintStr(int core, bool &haveData,double &startTime,double &endTime)
-{
-	std::string s = "";
-	TraceDqr::TIMESTAMP sts, ets;
+		delete index;
+		index = nullptr;
 
-	if (itcPrint == nullptr) {
-		haveData = false;
+		return TraceDqr::DQERR_ERR;
 	}
-	else {
-		haveData = itcPrint->getITCPrintStr(core,s,sts,ets);
 
-		if (haveData != false) {
-			if (NexusMessage::targetFrequency != 0) {
-				startTime = ((double)sts)/NexusMessage::targetFrequency;
-				endTime = ((double)ets)/NexusMessage::targetFrequency;
-			}
-			else {
-				startTime = sts;
-				endTime = ets;
-			}
-		}
+	if (traceIndex != nullptr) {
+		delete traceIndex;
 	}
 
-	return s;
+	traceIndex = index;
+
+	return TraceDqr::DQERR_OK;
 }
 
-std::string Trace::flushITCPrintStr(int core, bool &haveData,TraceDqr::TIMESTAMP &startTime,TraceDqr::TIMESTAMP &endTime)
+TraceDqr::DQErr Trace::loadTraceIndex()
 {
-	std::string s = "";
-
-	if (itcPrint == nullptr) {
-		haveData = false;
+	if (traceIndex != nullptr) {
+		return TraceDqr::DQERR_OK;
 	}
-	else {
-		haveData = itcPrint->flushITCPrintStr(core,s,startTime,endTime);
+
+	if ((rtdName == nullptr) || (strcmp(rtdName,"-") == 0)) {
+		printf("Error: Trace::loadTraceIndex(): Cannot index trace read from stdin\n");
+
+		return TraceDqr::DQERR_ERR;
 	}
 
-	return s;
-}
+	TraceDqr::DQErr rc;
+	char *idxName;
 
-std::string Trace::flushITCPrintStr(int core, bool &haveData,double &startTime,double &endTime)
-{
-	std::string s = "";
-	TraceDqr::TIMESTAMP sts, ets;
+	idxName = new (std::nothrow) char[strlen(rtdName) + sizeof ".idx"];
+	if (idxName == nullptr) {
+		printf("Error: Trace::loadTraceIndex(): Could not allocate index file name\n");
 
-	if (itcPrint == nullptr) {
-		haveData = false;
+		return TraceDqr::DQERR_ERR;
 	}
-	else {
-		haveData = itcPrint->flushITCPrintStr(core,s,sts,ets);
 
-		if (haveData != false) {
-			if (NexusMessage::targetFrequency != 0) {
-				startTime = ((double)sts)/NexusMessage::targetFrequency;
-				endTime = ((double)ets)/NexusMessage::targetFrequency;
-			}
-			else {
-				startTime = sts;
-				endTime = ets;
+	strcpy(idxName,rtdName);
+	strcat(idxName,".idx");
+
+	// use the sidecar index written by dqr -index if it is there and matches this trace
+
+	std::ifstream f(idxName);
+
+	if (f.good()) {
+		f.close();
+
+		int64_t size;
+		int64_t offset;
+
+		sfp->getFileOffset(size,offset);
+
+		traceIndex = new (std::nothrow) TraceIndex;
+		if (traceIndex != nullptr) {
+			rc = traceIndex->open(idxName);
+			if ((rc != TraceDqr::DQERR_OK) || (traceIndex->getSrcBits() != srcbits) || (traceIndex->getTSSize() != tsSize) || ((size != 0) && (traceIndex->getTraceSize() != size))) {
+				printf("Info: Trace::loadTraceIndex(): Index file %s does not match trace file. Rebuilding index\n",idxName);
+
+				delete traceIndex;
+				traceIndex = nullptr;
 			}
 		}
 	}
 
-	return s;
+	delete [] idxName;
+	idxName = nullptr;
+
+	if (traceIndex != nullptr) {
+		return TraceDqr::DQERR_OK;
+	}
+
+	traceIndex = new (std::nothrow) TraceIndex;
+	if (traceIndex == nullptr) {
+		printf("Error: Trace::loadTraceIndex(): Could not create TraceIndex object\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	rc = traceIndex->build(rtdName,srcbits,tsSize);
+	if (rc != TraceDqr::DQERR_OK) {
+		delete traceIndex;
+		traceIndex = nullptr;
+
+		return rc;
+	}
+
+	return TraceDqr::DQERR_OK;
+}
+
+TraceIndex *Trace::getTraceIndex()
+{
+	if (loadTraceIndex() != TraceDqr::DQERR_OK) {
+		return nullptr;
+	}
+
+	return traceIndex;
+}
+
+// Reposition the trace parser at the sync message entry (or the start of the trace if entry is null)
+// and reset the per-core decode state, as if decoding had just started there. Every core gets back the
+// time base the index recorded for it, and picks up again at its next sync message. Partial ITC print
+// messages from before the seek are dropped
+
+TraceDqr::DQErr Trace::seekToIndexEntry(const TraceIndexEntry *entry)
+{
+	if (sfp == nullptr) {
+		printf("Error: Trace::seekToIndexEntry(): Null sfp object\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	if (caTrace != nullptr) {
+		printf("Error: Trace::seekToIndexEntry(): Seeking is not supported with a cycle accurate trace file\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	TraceDqr::DQErr rc;
+
+	rc = sfp->seek((entry != nullptr) ? (int64_t)entry->offset : 0);
+	if (rc != TraceDqr::DQERR_OK) {
+		status = rc;
+		return rc;
+	}
+
+	for (int i = 0; i < DQR_MAXCORES; i++) {
+		state[i] = TRACE_STATE_GETFIRSTSYNCMSG;
+		currentAddress[i] = 0;
+		lastFaddr[i] = 0;
+		lastTime[i] = 0;
+		lastCycle[i] = 0;
+		eCycleCount[i] = 0;
+		enterISR[i] = TraceDqr::isNone;
+
+		counts->resetStack(i);
+		counts->resetCounts(i);
+	}
+
+	readNewTraceMessage = true;
+	currentCore = 0;
+
+	resetBlocks();
+
+	if (itcPrint != nullptr) {
+		itcPrint->reset();
+	}
+
+	if (entry != nullptr) {
+		// message numbers continue from the sync message, and timestamps get the timer wraps
+		// they would have had without the seek
+
+		analytics.setCurrentTraceMsgNum(entry->msgNum - 1);
+
+		for (int i = 0; i < DQR_MAXCORES; i++) {
+			lastTime[i] = entry->coreTime[i];
+		}
+	}
+	else {
+		analytics.setCurrentTraceMsgNum(0);
+	}
+
+	status = TraceDqr::DQERR_OK;
+
+	return status;
+}
+
+TraceDqr::DQErr Trace::seekToTimestamp(TraceDqr::TIMESTAMP ts)
+{
+	TraceDqr::DQErr rc;
+
+	rc = loadTraceIndex();
+	if (rc != TraceDqr::DQERR_OK) {
+		return rc;
+	}
+
+	return seekToIndexEntry(traceIndex->getEntry(traceIndex->findEntry(TraceIndex::KEY_TIMESTAMP,ts)));
+}
+
+TraceDqr::DQErr Trace::seekToMessageNumber(int msgNum)
+{
+	TraceDqr::DQErr rc;
+
+	rc = loadTraceIndex();
+	if (rc != TraceDqr::DQERR_OK) {
+		return rc;
+	}
+
+	if (msgNum < 0) {
+		msgNum = 0;
+	}
+
+	return seekToIndexEntry(traceIndex->getEntry(traceIndex->findEntry(TraceIndex::KEY_MSGNUM,msgNum)));
+}
+
+TraceDqr::DQErr Trace::seekToFileOffset(int64_t offset)
+{
+	TraceDqr::DQErr rc;
+
+	rc = loadTraceIndex();
+	if (rc != TraceDqr::DQERR_OK) {
+		return rc;
+	}
+
+	if (offset < 0) {
+		offset = 0;
+	}
+
+	return seekToIndexEntry(traceIndex->getEntry(traceIndex->findEntry(TraceIndex::KEY_OFFSET,offset)));
+}
+
+// The checkpoint is a TraceCheckpointHeader followed by the per-core decode state, the message being
+// retired, the counts and call stacks, any partly built blocks, and the itc print buffers. It is in host
+// byte order and only meant to be read back by the same build
+
+TraceDqr::DQErr Trace::saveCheckpoint(uint8_t *&data,int64_t &size)
+{
+	data = nullptr;
+	size = 0;
+
+	if (sfp == nullptr) {
+		printf("Error: Trace::saveCheckpoint(): Null sfp object\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	if (caTrace != nullptr) {
+		printf("Error: Trace::saveCheckpoint(): Checkpoints are not supported with a cycle accurate trace file\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	TraceCheckpointHeader hdr;
+	int64_t traceSize;
+	int64_t traceOffset;
+
+	if (sfp->getFileOffset(traceSize,traceOffset) != TraceDqr::DQERR_OK) {
+		printf("Error: Trace::saveCheckpoint(): Cannot checkpoint a trace read from a socket\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	memset(&hdr,0,sizeof hdr);
+	strcpy(hdr.magic,DQR_CHECKPOINT_MAGIC);
+	hdr.version = DQR_CHECKPOINT_VERSION;
+	hdr.maxCores = DQR_MAXCORES;
+	hdr.msgSize = sizeof(NexusMessage);
+	hdr.srcBits = srcbits;
+	hdr.tsSize = tsSize;
+	hdr.traceSize = traceSize;
+	hdr.traceOffset = traceOffset;
+
+	CheckpointBuffer cb;
+	int msgNum = analytics.currentTraceMsgNum();
+	bool haveItc = (itcPrint != nullptr);
+	bool ok;
+
+	ok = cb.put(&hdr,sizeof hdr);
+	ok = ok && cb.put(&traceType,sizeof traceType);
+	ok = ok && cb.put(state,sizeof state);
+	ok = ok && cb.put(currentAddress,sizeof currentAddress);
+	ok = ok && cb.put(lastFaddr,sizeof lastFaddr);
+	ok = ok && cb.put(lastTime,sizeof lastTime);
+	ok = ok && cb.put(enterISR,sizeof enterISR);
+	ok = ok && cb.put(&readNewTraceMessage,sizeof readNewTraceMessage);
+	ok = ok && cb.put(&currentCore,sizeof currentCore);
+	ok = ok && cb.put(&msgNum,sizeof msgNum);
+	ok = ok && cb.put(&nm,sizeof nm);
+	ok = ok && cb.put(blocks,sizeof blocks);
+	ok = ok && cb.put(readyBlocks,sizeof readyBlocks);
+	ok = ok && cb.put(&numReadyBlocks,sizeof numReadyBlocks);
+	ok = ok && cb.put(&haveItc,sizeof haveItc);
+
+	if (ok == false) {
+		printf("Error: Trace::saveCheckpoint(): Could not allocate checkpoint\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	TraceDqr::DQErr rc;
+
+	rc = counts->saveState(cb);
+	if (rc != TraceDqr::DQERR_OK) {
+		return rc;
+	}
+
+	if (haveItc) {
+		rc = itcPrint->saveState(cb);
+		if (rc != TraceDqr::DQERR_OK) {
+			return rc;
+		}
+	}
+
+	data = cb.release(size);
+
+	((TraceCheckpointHeader*)data)->size = size;
+
+	return TraceDqr::DQERR_OK;
+}
+
+TraceDqr::DQErr Trace::restoreCheckpoint(const uint8_t *data,int64_t size)
+{
+	if (sfp == nullptr) {
+		printf("Error: Trace::restoreCheckpoint(): Null sfp object\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	if (caTrace != nullptr) {
+		printf("Error: Trace::restoreCheckpoint(): Checkpoints are not supported with a cycle accurate trace file\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	TraceCheckpointHeader hdr;
+
+	if ((data == nullptr) || (size < (int64_t)sizeof hdr)) {
+		printf("Error: Trace::restoreCheckpoint(): Not a checkpoint\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	memcpy(&hdr,data,sizeof hdr);
+
+	if (strncmp(hdr.magic,DQR_CHECKPOINT_MAGIC,sizeof hdr.magic) != 0) {
+		printf("Error: Trace::restoreCheckpoint(): Not a checkpoint\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	if ((hdr.version != DQR_CHECKPOINT_VERSION) || (hdr.maxCores != DQR_MAXCORES) || (hdr.msgSize != sizeof(NexusMessage))) {
+		printf("Error: Trace::restoreCheckpoint(): Checkpoint was saved by a different version of the decoder\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	if (hdr.size != (uint64_t)size) {
+		printf("Error: Trace::restoreCheckpoint(): Checkpoint is truncated\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	if ((hdr.srcBits != (uint32_t)srcbits) || (hdr.tsSize != (uint32_t)tsSize)) {
+		printf("Error: Trace::restoreCheckpoint(): Checkpoint was saved with srcbits %u and tssize %u, trace uses %d and %d\n",hdr.srcBits,hdr.tsSize,srcbits,tsSize);
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	int64_t traceSize;
+	int64_t traceOffset;
+
+	if (sfp->getFileOffset(traceSize,traceOffset) != TraceDqr::DQERR_OK) {
+		printf("Error: Trace::restoreCheckpoint(): Cannot restore a checkpoint into a trace read from a socket\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	if ((traceSize != 0) && (hdr.traceSize != 0) && ((uint64_t)traceSize != hdr.traceSize)) {
+		printf("Error: Trace::restoreCheckpoint(): Checkpoint was saved from a different trace file\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	TraceDqr::DQErr rc;
+
+	rc = sfp->seek((int64_t)hdr.traceOffset);
+	if (rc != TraceDqr::DQERR_OK) {
+		status = rc;
+		return rc;
+	}
+
+	CheckpointBuffer cb(data,size);
+	int msgNum;
+	bool haveItc;
+	bool ok;
+
+	ok = cb.get(&hdr,sizeof hdr);
+	ok = ok && cb.get(&traceType,sizeof traceType);
+	ok = ok && cb.get(state,sizeof state);
+	ok = ok && cb.get(currentAddress,sizeof currentAddress);
+	ok = ok && cb.get(lastFaddr,sizeof lastFaddr);
+	ok = ok && cb.get(lastTime,sizeof lastTime);
+	ok = ok && cb.get(enterISR,sizeof enterISR);
+	ok = ok && cb.get(&readNewTraceMessage,sizeof readNewTraceMessage);
+	ok = ok && cb.get(&currentCore,sizeof currentCore);
+	ok = ok && cb.get(&msgNum,sizeof msgNum);
+	ok = ok && cb.get(&nm,sizeof nm);
+	ok = ok && cb.get(blocks,sizeof blocks);
+	ok = ok && cb.get(readyBlocks,sizeof readyBlocks);
+	ok = ok && cb.get(&numReadyBlocks,sizeof numReadyBlocks);
+	ok = ok && cb.get(&haveItc,sizeof haveItc);
+
+	if (ok && (haveItc != (itcPrint != nullptr))) {
+		printf("Error: Trace::restoreCheckpoint(): Checkpoint was saved with different itc print options\n");
+
+		ok = false;
+	}
+
+	if (ok) {
+		rc = counts->restoreState(cb);
+		if (rc != TraceDqr::DQERR_OK) {
+			ok = false;
+		}
+	}
+
+	if (ok && haveItc) {
+		rc = itcPrint->restoreState(cb);
+		if (rc != TraceDqr::DQERR_OK) {
+			ok = false;
+		}
+	}
+
+	if (ok == false) {
+		printf("Error: Trace::restoreCheckpoint(): Could not restore decoder state\n");
+
+		// a partial restore is not something to decode from
+
+		status = TraceDqr::DQERR_ERR;
+
+		return status;
+	}
+
+	analytics.setCurrentTraceMsgNum(msgNum);
+
+	status = TraceDqr::DQERR_OK;
+
+	return status;
+}
+
+TraceDqr::DQErr Trace::saveCheckpoint(char *cp_name)
+{
+	if (cp_name == nullptr) {
+		printf("Error: Trace::saveCheckpoint(): Bad cp_name argument\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	TraceDqr::DQErr rc;
+	uint8_t *data;
+	int64_t size;
+
+	rc = saveCheckpoint(data,size);
+	if (rc != TraceDqr::DQERR_OK) {
+		return rc;
+	}
+
+	std::ofstream f(cp_name,std::ofstream::binary | std::ofstream::trunc);
+
+	if (f.is_open()) {
+		f.write((const char *)data,size);
+		f.close();
+	}
+
+	delete [] data;
+
+	if (f.fail()) {
+		printf("Error: Trace::saveCheckpoint(): Error writing file %s\n",cp_name);
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	return TraceDqr::DQERR_OK;
+}
+
+TraceDqr::DQErr Trace::restoreCheckpoint(char *cp_name)
+{
+	if (cp_name == nullptr) {
+		printf("Error: Trace::restoreCheckpoint(): Bad cp_name argument\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	std::ifstream f(cp_name,std::ifstream::binary | std::ifstream::ate);
+
+	if (!f.is_open()) {
+		printf("Error: Trace::restoreCheckpoint(): Could not open checkpoint file %s\n",cp_name);
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	int64_t size = f.tellg();
+
+	if (size <= 0) {
+		printf("Error: Trace::restoreCheckpoint(): %s is not a checkpoint file\n",cp_name);
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	uint8_t *data = new (std::nothrow) uint8_t[size];
+
+	if (data == nullptr) {
+		printf("Error: Trace::restoreCheckpoint(): Could not allocate %lld bytes for checkpoint\n",(long long)size);
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	f.seekg(0);
+	f.read((char *)data,size);
+
+	if (f.fail()) {
+		printf("Error: Trace::restoreCheckpoint(): Error reading checkpoint file %s\n",cp_name);
+
+		delete [] data;
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	TraceDqr::DQErr rc;
+
+	rc = restoreCheckpoint(data,size);
+
+	delete [] data;
+
+	return rc;
+}
+
+int Trace::getITCPrintMask()
+{
+	if (itcPrint == nullptr) {
+		return 0;
+	}
+
+	return itcPrint->getITCPrintMask();
+}
+
+int Trace::getITCFlushMask()
+{
+	if (itcPrint == nullptr) {
+		return 0;
+	}
+
+	return itcPrint->getITCFlushMask();
+}
+
+TraceDqr::ADDRESS Trace::computeAddress()
+{
+	switch (nm.tcode) {
+	case TraceDqr::TCODE_DEBUG_STATUS:
+		break;
+	case TraceDqr::TCODE_DEVICE_ID:
+		break;
+	case TraceDqr::TCODE_OWNERSHIP_TRACE:
+		break;
+	case TraceDqr::TCODE_DIRECT_BRANCH:
+//		currentAddress = target of branch.
+		break;
+	case TraceDqr::TCODE_INDIRECT_BRANCH:
+		currentAddress[currentCore] = currentAddress[currentCore] ^ (nm.indirectBranch.u_addr << 1);	// note - this is the next address!
+		break;
+	case TraceDqr::TCODE_DATA_WRITE:
+		break;
+	case TraceDqr::TCODE_DATA_READ:
+		break;
+	case TraceDqr::TCODE_DATA_ACQUISITION:
+		break;
+	case TraceDqr::TCODE_ERROR:
+		break;
+	case TraceDqr::TCODE_SYNC:
+		currentAddress[currentCore] = nm.sync.f_addr << 1;
+		break;
+	case TraceDqr::TCODE_CORRECTION:
+		break;
+	case TraceDqr::TCODE_DIRECT_BRANCH_WS:
+		currentAddress[currentCore] = nm.directBranchWS.f_addr << 1;
+		break;
+	case TraceDqr::TCODE_INDIRECT_BRANCH_WS:
+		currentAddress[currentCore] = nm.indirectBranchWS.f_addr << 1;
+		break;
+	case TraceDqr::TCODE_DATA_WRITE_WS:
+		break;
+	case TraceDqr::TCODE_DATA_READ_WS:
+		break;
+	case TraceDqr::TCODE_WATCHPOINT:
+		break;
+	case TraceDqr::TCODE_CORRELATION:
+		break;
+	case TraceDqr::TCODE_INDIRECTBRANCHHISTORY:
+		currentAddress[currentCore] = currentAddress[currentCore] ^ (nm.indirectHistory.u_addr << 1);	// note - this is the next address!
+		break;
+	case TraceDqr::TCODE_INDIRECTBRANCHHISTORY_WS:
+		currentAddress[currentCore] = nm.indirectHistoryWS.f_addr << 1;
+		break;
+	case TraceDqr::TCODE_RESOURCEFULL:
+		break;
+	default:
+		break;
+	}
+
+	std::cout << "New address 0x" << std::hex << currentAddress[currentCore] << std::dec << std::endl;
+
+	return currentAddress[currentCore];
+}
+
+int Trace::Disassemble(TraceDqr::ADDRESS addr)
+{
+	return Disassemble(addr,true,true);
+}
+
+// Only what is asked for is looked up and copied into instructionInfo and sourceInfo
+
+int Trace::Disassemble(TraceDqr::ADDRESS addr,bool getInstInfo,bool getSrcInfo)
+{
+	if (disassembler == nullptr) {
+		printf("Error: Trace::Disassemble(): No disassembler object\n");
+
+		status = TraceDqr::DQERR_ERR;
+
+		return 0;
+	}
+
+	int   rc;
+	int   fields = 0;
+	TraceDqr::DQErr s;
+
+	if (getInstInfo) {
+		fields |= Disassembler::DIS_INSTRUCTION;
+	}
+
+	if (getSrcInfo) {
+		fields |= Disassembler::DIS_SOURCE;
+	}
+
+	if (fields == 0) {
+		return 0;
+	}
+
+	rc = disassembler->Disassemble(addr,fields,&instructionInfo,&sourceInfo);
+
+	s = disassembler->getStatus();
+
+	if (s != TraceDqr::DQERR_OK ) {
+	  status = s;
+	  return 0;
+	}
+
+	return rc;
+}
+
+const char *Trace::getSymbolByAddress(TraceDqr::ADDRESS addr)
+{
+	return symtab->getSymbolByAddress(addr);
+}
+
+const char *Trace::getNextSymbolByAddress()
+{
+	return symtab->getNextSymbolByAddress();
+}
+
+TraceDqr::DQErr Trace::setITCPrintOptions(int itcFlags,int buffSize,int channel)
+{
+	if (itcPrint != nullptr) {
+		delete itcPrint;
+		itcPrint = nullptr;
+	}
+
+	if (itcFlags != TraceDqr::ITC_OPT_NONE) {
+		if ((nlsStrings == nullptr) && (elfReader != nullptr)) {
+			TraceDqr::DQErr rc;
+
+			nlsStrings = new TraceDqr::nlStrings[32];
+
+			rc = elfReader->parseNLSStrings(nlsStrings);
+			if (rc != TraceDqr::DQERR_OK) {
+				status = rc;
+
+				delete [] nlsStrings;
+				nlsStrings = nullptr;
+
+				return rc;
+			}
+		}
+
+		itcPrint = new ITCPrint(itcFlags,1 << srcbits,buffSize,channel,nlsStrings);
+	}
+
+	return TraceDqr::DQERR_OK;
+}
+
+TraceDqr::DQErr Trace::haveITCPrintData(int numMsgs[DQR_MAXCORES], bool havePrintData[DQR_MAXCORES])
+{
+	if (itcPrint == nullptr) {
+		return TraceDqr::DQERR_ERR;
+	}
+
+	itcPrint->haveITCPrintData(numMsgs, havePrintData);
+
+	return TraceDqr::DQERR_OK;
+}
+
+bool Trace::getITCPrintMsg(int core, char *dst, int dstLen, TraceDqr::TIMESTAMP &startTime, TraceDqr::TIMESTAMP &endTime)
+{
+	if (itcPrint == nullptr) {
+		return false;
+	}
+
+	return itcPrint->getITCPrintMsg(core,dst,dstLen,startTime,endTime);
+}
+
+bool Trace::flushITCPrintMsg(int core, char *dst, int dstLen,TraceDqr::TIMESTAMP &startTime,TraceDqr::TIMESTAMP &endTime)
+{
+	if (itcPrint == nullptr) {
+		return false;
+	}
+
+	return itcPrint->flushITCPrintMsg(core,dst,dstLen,startTime,endTime);
+}
+
+std::string Trace::getITCPrintStr(int core, bool &haveData,TraceDqr::TIMESTAMP &startTime,TraceDqr::TIMESTAMP &endTime)
+{
+	std::string s = "";
+
+	if (itcPrint == nullptr) {
+		haveData = false;
+	}
+	else {
+		haveData = itcPrint->getITCPrintStr(core,s,startTime,endTime);
+	}
+
+	return s;
+}
+
+std::string Trace::getITCPrintStr(int core, bool &haveData,double &startTime,double &endTime)
+{
+	std::string s = "";
+	TraceDqr::TIMESTAMP sts, ets;
+
+	if (itcPrint == nullptr) {
+		haveData = false;
+	}
+	else {
+		haveData = itcPrint->getITCPrintStr(core,s,sts,ets);
+
+		if (haveData != false) {
+			if (NexusMessage::targetFrequency != 0) {
+				startTime = ((double)sts)/NexusMessage::targetFrequency;
+				endTime = ((double)ets)/NexusMessage::targetFrequency;
+			}
+			else {
+				startTime = sts;
+				endTime = ets;
+			}
+		}
+	}
+
+	return s;
+}
+
+std::string Trace::flushITCPrintStr(int core, bool &haveData,TraceDqr::TIMESTAMP &startTime,TraceDqr::TIMESTAMP &endTime)
+{
+	std::string s = "";
+
+	if (itcPrint == nullptr) {
+		haveData = false;
+	}
+	else {
+		haveData = itcPrint->flushITCPrintStr(core,s,startTime,endTime);
+	}
+
+	return s;
+}
+
+std::string Trace::flushITCPrintStr(int core, bool &haveData,double &startTime,double &endTime)
+{
+	std::string s = "";
+	TraceDqr::TIMESTAMP sts, ets;
+
+	if (itcPrint == nullptr) {
+		haveData = false;
+	}
+	else {
+		haveData = itcPrint->flushITCPrintStr(core,s,sts,ets);
+
+		if (haveData != false) {
+			if (NexusMessage::targetFrequency != 0) {
+				startTime = ((double)sts)/NexusMessage::targetFrequency;
+				endTime = ((double)ets)/NexusMessage::targetFrequency;
+			}
+			else {
+				startTime = sts;
+				endTime = ets;
+			}
+		}
+	}
+
+	return s;
+}
+
+// This routine only works for event traces! In particular, brFlags will assumes there is an
+// event message at addresses for conditional branches because the branch was taken!
+
+TraceDqr::DQErr Trace::getCRBRFlags(TraceDqr::ICTReason cksrc,TraceDqr::ADDRESS addr,int &crFlag,int &brFlag)
+{
+	int rc;
+	TraceDqr::DQErr ec;
+	const decodedInst *di;
+	uint32_t inst;
+	int inst_size;
+	TraceDqr::InstType inst_type;
+	int32_t immediate;
+	bool isBranch;
+	TraceDqr::Reg rs1;
+	TraceDqr::Reg rd;
+
+	//	Need to get the destination of the call, which is in the immediate field
+
+	crFlag = TraceDqr::isNone;
+	brFlag = TraceDqr::BRFLAG_none;
+
+	switch (cksrc) {
+	case TraceDqr::ICT_CONTROL:
+	case TraceDqr::ICT_EXT_TRIG:
+	case TraceDqr::ICT_WATCHPOINT:
+	case TraceDqr::ICT_PC_SAMPLE:
+		break;
+	case TraceDqr::ICT_INFERABLECALL:
+		ec = elfReader->getDecodedInstruction(addr,di);
+		if (ec != TraceDqr::DQERR_OK) {
+			printf("Error: getCRBRFlags() failed\n");
+
+			status = ec;
+			return ec;
+		}
+
+		inst = di->inst;
+		rc = di->getDecodedFields(inst_size,inst_type,rs1,rd,immediate,isBranch);
+		if (rc != 0) {
+			printf("Error: getCRBRFlags(): Cann't decode size of instruction %04x\n",inst);
+
+			status = TraceDqr::DQERR_ERR;
+			return TraceDqr::DQERR_ERR;
+		}
+
+		switch (inst_type) {
+		case TraceDqr::INST_JALR:
+			if ((rd == TraceDqr::REG_1) || (rd == TraceDqr::REG_5)) { // rd == link
+				if ((rs1 != TraceDqr::REG_1) && (rs1 != TraceDqr::REG_5)) { // rd == link; rs1 != link
+					crFlag = TraceDqr::isCall;
+				}
+				else if (rd != rs1) { // rd == link; rs1 == link; rd != rs1
+					crFlag = TraceDqr::isSwap;
+				}
+				else { // rd == link; rs1 == link; rd == rs1
+					crFlag = TraceDqr::isCall;
+				}
+			}
+			else if ((rs1 == TraceDqr::REG_1) || (rs1 == TraceDqr::REG_5)) { // rd != link; rs1 == link
+				crFlag = TraceDqr::isReturn;
+			}
+			break;
+		case TraceDqr::INST_JAL:
+			if ((rd == TraceDqr::REG_1) || (rd == TraceDqr::REG_5)) { // rd == link
+				crFlag = TraceDqr::isCall;
+			}
+			break;
+		case TraceDqr::INST_C_JAL:
+			if ((rd == TraceDqr::REG_1) || (rd == TraceDqr::REG_5)) { // rd == link
+				crFlag = TraceDqr::isCall;
+			}
+			break;
+		case TraceDqr::INST_C_JR:
+			if ((rs1 == TraceDqr::REG_1) || (rs1 == TraceDqr::REG_5)) {
+				crFlag = TraceDqr::isReturn;
+			}
+			break;
+		case TraceDqr::INST_EBREAK:
+		case TraceDqr::INST_ECALL:
+			crFlag = TraceDqr::isException;
+			break;
+		case TraceDqr::INST_MRET:
+		case TraceDqr::INST_SRET:
+		case TraceDqr::INST_URET:
+			crFlag = TraceDqr::isExceptionReturn;
+			break;
+		case TraceDqr::INST_BEQ:
+		case TraceDqr::INST_BNE:
+		case TraceDqr::INST_BLT:
+		case TraceDqr::INST_BGE:
+		case TraceDqr::INST_BLTU:
+		case TraceDqr::INST_BGEU:
+		case TraceDqr::INST_C_BEQZ:
+		case TraceDqr::INST_C_BNEZ:
+			brFlag = TraceDqr::BRFLAG_taken;
+			break;
+		default:
+			break;
+		}
+		break;
+	case TraceDqr::ICT_EXCEPTION:
+		crFlag = TraceDqr::isException;
+		break;
+	case TraceDqr::ICT_INTERRUPT:
+		crFlag = TraceDqr::isInterrupt;
+		break;
+	case TraceDqr::ICT_CONTEXT:
+		crFlag = TraceDqr::isSwap;
+		break;
+	default:
+		printf("Error: getCRBRFlags(): Invalid crsrc\n");
+
+		status = TraceDqr::DQERR_ERR;
+		return TraceDqr::DQERR_ERR;
+	}
+
+	return TraceDqr::DQERR_OK;
+}
+
+// Note: This next instruction only computes nextAddr for inferable calls. It does set the crFlag
+// correctly for others.
+
+TraceDqr::DQErr Trace::nextAddr(TraceDqr::ADDRESS addr,TraceDqr::ADDRESS &nextAddr,int &crFlag)
+{
+	int rc;
+	TraceDqr::DQErr ec;
+	const decodedInst *di;
+	uint32_t inst;
+	int inst_size;
+	TraceDqr::InstType inst_type;
+	int32_t immediate;
+	bool isBranch;
+	TraceDqr::Reg rs1;
+	TraceDqr::Reg rd;
+
+	ec = elfReader->getDecodedInstruction(addr,di);
+	if (ec != TraceDqr::DQERR_OK) {
+		printf("Error: nextAddr() failed\n");
+
+		status = ec;
+		return ec;
+	}
+
+	//	Need to get the destination of the call, which is in the immediate field
+
+	crFlag = TraceDqr::isNone;
+	nextAddr = 0;
+
+	inst = di->inst;
+	rc = di->getDecodedFields(inst_size,inst_type,rs1,rd,immediate,isBranch);
+	if (rc != 0) {
+		printf("Error: Cann't decode size of instruction %04x\n",inst);
+
+		status = TraceDqr::DQERR_ERR;
+		return TraceDqr::DQERR_ERR;
+	}
+
+	switch (inst_type) {
+	case TraceDqr::INST_JALR:
+		if ((rd == TraceDqr::REG_1) || (rd == TraceDqr::REG_5)) { // rd == link
+			if ((rs1 != TraceDqr::REG_1) && (rs1 != TraceDqr::REG_5)) { // rd == link; rs1 != link
+				crFlag |= TraceDqr::isCall;
+			}
+			else if (rd != rs1) { // rd == link; rs1 == link; rd != rs1
+				crFlag |= TraceDqr::isSwap;
+			}
+			else { // rd == link; rs1 == link; rd == rs1
+				crFlag |= TraceDqr::isCall;
+			}
+		}
+		else if ((rs1 == TraceDqr::REG_1) || (rs1 == TraceDqr::REG_5)) { // rd != link; rs1 == link
+			crFlag |= TraceDqr::isReturn;
+		}
+		break;
+	case TraceDqr::INST_JAL:
+		if ((rd == TraceDqr::REG_1) || (rd == TraceDqr::REG_5)) { // rd == link
+			crFlag = TraceDqr::isCall;
+		}
+
+		nextAddr = addr + immediate;
+		break;
+	case TraceDqr::INST_C_JAL:
+		if ((rd == TraceDqr::REG_1) || (rd == TraceDqr::REG_5)) { // rd == link
+			crFlag = TraceDqr::isCall;
+		}
+
+		nextAddr = addr + immediate;
+		break;
+	case TraceDqr::INST_C_JR:
+		// pc = pc + rs1
+		// not inferrable unconditional
+
+		if ((rs1 == TraceDqr::REG_1) || (rs1 == TraceDqr::REG_5)) {
+			crFlag |= TraceDqr::isReturn;
+		}
+		break;
+	case TraceDqr::INST_C_JALR:
+		if (rs1 == TraceDqr::REG_5) { // is it reg5 only, or also reg1 like non-compact JALR?
+			crFlag |= TraceDqr::isSwap;
+		}
+		else {
+			crFlag |= TraceDqr::isCall;
+		}
+		break;
+	case TraceDqr::INST_EBREAK:
+	case TraceDqr::INST_ECALL:
+		crFlag = TraceDqr::isException;
+		break;
+	case TraceDqr::INST_MRET:
+	case TraceDqr::INST_SRET:
+	case TraceDqr::INST_URET:
+		crFlag = TraceDqr::isExceptionReturn;
+		break;
+	default:
+		printf("Error: Trace::nextAddr(): Instruction at 0x%08x is not a JAL, JALR, C_JAL, C_JR, C_JALR, EBREAK, ECALL, MRET, SRET, or URET\n",addr);
+
+#ifdef foodog
+		printf("Instruction type: %d\n",inst_type);
+
+		// disassemble and display instruction
+
+		Disassemble(addr);
+
+		char dst[256];
+		instructionInfo.addressToText(dst,sizeof dst,0);
+
+		if (instructionInfo.addressLabel != nullptr) {
+			printf("<%s",instructionInfo.addressLabel);
+			if (instructionInfo.addressLabelOffset != 0) {
+				printf("+%x",instructionInfo.addressLabelOffset);
+			}
+			printf(">\n");
+		}
+
+		printf("    %s:    ",dst);
+
+		instructionInfo.instructionToText(dst,sizeof dst,2);
+		printf("  %s\n",dst);
+#endif // foodog
+
+		status = TraceDqr::DQERR_ERR;
+		return TraceDqr::DQERR_ERR;
+	}
+
+	return TraceDqr::DQERR_OK;
 }
 
-// This routine only works for event traces! In particular, brFlags will assumes there is an
-// event message at addresses for conditional branches because the branch was taken!
+// Find the basic block starting at addr, building it if it is not in the cache. Returns nullptr if
+// there is no cache
 
-TraceDqr::DQErr Trace::getCRBRFlags(TraceDqr::ICTReason cksrc,TraceDqr::ADDRESS addr,int &crFlag,int &brFlag)
+BasicBlock *Trace::getBasicBlock(TraceDqr::ADDRESS addr)
 {
-	int rc;
-	TraceDqr::DQErr ec;
-	uint32_t inst;
-	int inst_size;
-	TraceDqr::InstType inst_type;
-	int32_t immediate;
-	bool isBranch;
-	TraceDqr::Reg rs1;
-	TraceDqr::Reg rd;
+	if (bbCache == nullptr) {
+		return nullptr;
+	}
 
-	//	Need to get the destination of the call, which is in the immediate field
+	BasicBlock *bb;
 
-	crFlag = TraceDqr::isNone;
-	brFlag = TraceDqr::BRFLAG_none;
+	bb = bbCache->lookup(addr);
+	if (bb != nullptr) {
+		return bb;
+	}
 
-	switch (cksrc) {
-	case TraceDqr::ICT_CONTROL:
-	case TraceDqr::ICT_EXT_TRIG:
-	case TraceDqr::ICT_WATCHPOINT:
-	case TraceDqr::ICT_PC_SAMPLE:
-		break;
-	case TraceDqr::ICT_INFERABLECALL:
-		ec = elfReader->getInstructionByAddress(addr,inst);
-		if (ec != TraceDqr::DQERR_OK) {
-			printf("Error: getCRBRFlags() failed\n");
+	BasicBlock nbb;
 
-			status = ec;
-			return ec;
+	nbb.startAddr = addr;
+	nbb.length = 0;
+	nbb.numInst16 = 0;
+	nbb.numInst32 = 0;
+	nbb.termType = TraceDqr::INST_UNKNOWN;
+	nbb.termSize = 0;
+	nbb.termTarget = (TraceDqr::ADDRESS)-1;
+	nbb.termCRFlags = TraceDqr::isNone;
+
+	bool haveTerm = false;
+
+	for (int i = 0; (i < BB_MAX_INSTS) && (haveTerm == false); i++) {
+		const decodedInst *di;
+		int inst_size;
+		TraceDqr::InstType inst_type;
+		int32_t immediate;
+		bool isBranch;
+		TraceDqr::Reg rs1;
+		TraceDqr::Reg rd;
+
+		// stop at anything that cannot be read or decoded, and let nextAddr() report it if the
+		// trace actually gets there
+
+		if (elfReader->getDecodedInstruction(addr,di) != TraceDqr::DQERR_OK) {
+			break;
 		}
 
-		rc = decodeInstruction(inst,inst_size,inst_type,rs1,rd,immediate,isBranch);
-		if (rc != 0) {
-			printf("Error: getCRBRFlags(): Cann't decode size of instruction %04x\n",inst);
+		if (di->getDecodedFields(inst_size,inst_type,rs1,rd,immediate,isBranch) != 0) {
+			break;
+		}
 
-			status = TraceDqr::DQERR_ERR;
-			return TraceDqr::DQERR_ERR;
+		if ((inst_size != 16) && (inst_size != 32)) {
+			break;
 		}
 
+		// same cases as nextAddr(). All other instructions go to the next instruction
+
 		switch (inst_type) {
-		case TraceDqr::INST_JALR:
-			if ((rd == TraceDqr::REG_1) || (rd == TraceDqr::REG_5)) { // rd == link
-				if ((rs1 != TraceDqr::REG_1) && (rs1 != TraceDqr::REG_5)) { // rd == link; rs1 != link
-					crFlag = TraceDqr::isCall;
-				}
-				else if (rd != rs1) { // rd == link; rs1 == link; rd != rs1
-					crFlag = TraceDqr::isSwap;
-				}
-				else { // rd == link; rs1 == link; rd == rs1
-					crFlag = TraceDqr::isCall;
-				}
-			}
-			else if ((rs1 == TraceDqr::REG_1) || (rs1 == TraceDqr::REG_5)) { // rd != link; rs1 == link
-				crFlag = TraceDqr::isReturn;
-			}
-			break;
 		case TraceDqr::INST_JAL:
-			if ((rd == TraceDqr::REG_1) || (rd == TraceDqr::REG_5)) { // rd == link
-				crFlag = TraceDqr::isCall;
-			}
-			break;
 		case TraceDqr::INST_C_JAL:
-			if ((rd == TraceDqr::REG_1) || (rd == TraceDqr::REG_5)) { // rd == link
-				crFlag = TraceDqr::isCall;
+			if ((rd == TraceDqr::REG_1) || (rd == TraceDqr::REG_5)) {
+				nbb.termCRFlags = TraceDqr::isCall;
 			}
-			break;
+			// fall through
+		case TraceDqr::INST_C_J:
+		case TraceDqr::INST_BEQ:
+		case TraceDqr::INST_BNE:
+		case TraceDqr::INST_BLT:
+		case TraceDqr::INST_BGE:
+		case TraceDqr::INST_BLTU:
+		case TraceDqr::INST_BGEU:
+		case TraceDqr::INST_C_BEQZ:
+		case TraceDqr::INST_C_BNEZ:
+			nbb.termTarget = addr + immediate;
+			// fall through
+		case TraceDqr::INST_JALR:
 		case TraceDqr::INST_C_JR:
-			if ((rs1 == TraceDqr::REG_1) || (rs1 == TraceDqr::REG_5)) {
-				crFlag = TraceDqr::isReturn;
-			}
-			break;
+		case TraceDqr::INST_C_JALR:
 		case TraceDqr::INST_EBREAK:
 		case TraceDqr::INST_ECALL:
-			crFlag = TraceDqr::isException;
-			break;
 		case TraceDqr::INST_MRET:
 		case TraceDqr::INST_SRET:
 		case TraceDqr::INST_URET:
-			crFlag = TraceDqr::isExceptionReturn;
+			nbb.termType = inst_type;
+			nbb.termSize = inst_size;
+			haveTerm = true;
+			break;
+		default:
+			addr += inst_size / 8;
+			nbb.length += inst_size / 16;
+
+			if (inst_size == 16) {
+				nbb.numInst16 += 1;
+			}
+			else {
+				nbb.numInst32 += 1;
+			}
+			break;
+		}
+	}
+
+	nbb.termAddr = addr;
+
+	return bbCache->insert(nbb);
+}
+
+// Retire basic blocks that end in a conditional branch, taking the branches from the history bits,
+// for as long as the history and i-cnt last. This does what nextAddr() would do for each instruction.
+// A block that branches back to itself is a loop, and the run of taken bits gives the number of
+// times around it, so the whole loop is retired at once
+
+void Trace::retireHistoryBlocks(int core)
+{
+	while (counts->getCurrentCountType(core) == TraceDqr::COUNTTYPE_history) {
+		BasicBlock *bb;
+
+		bb = getBasicBlock(currentAddress[core]);
+		if (bb == nullptr) {
+			return;
+		}
+
+		switch (bb->termType) {
+		case TraceDqr::INST_BEQ:
+		case TraceDqr::INST_BNE:
+		case TraceDqr::INST_BLT:
+		case TraceDqr::INST_BGE:
+		case TraceDqr::INST_BLTU:
+		case TraceDqr::INST_BGEU:
+		case TraceDqr::INST_C_BEQZ:
+		case TraceDqr::INST_C_BNEZ:
+			break;
+		default:
+			return;
+		}
+
+		// leave at least one i-cnt, so the message is retired by the single step code as before
+
+		int blockLen = bb->length + bb->termSize / 16;
+		int iCnt = counts->getICnt(core);
+
+		if (iCnt <= blockLen) {
+			return;
+		}
+
+		int numInst16 = bb->numInst16 + ((bb->termSize == 16) ? 1 : 0);
+		int numInst32 = bb->numInst32 + ((bb->termSize == 32) ? 1 : 0);
+		int numTaken = 0;
+
+		if (bb->termTarget == bb->startAddr) {
+			numTaken = counts->getTakenRun(core);
+			if (numTaken > (iCnt - 1) / blockLen) {
+				numTaken = (iCnt - 1) / blockLen;
+			}
+		}
+
+		if (numTaken > 0) {
+			counts->consumeHistory(core,numTaken);
+			counts->consumeICnt(core,numTaken * blockLen);
+			analytics.updateBlockInfo(core,numTaken * numInst16,numTaken * numInst32);
+			analytics.updateBranchInfo(core,numTaken,0);
+		}
+		else {
+			bool isTaken;
+
+			counts->consumeHistory(core,isTaken);
+			counts->consumeICnt(core,blockLen);
+			analytics.updateBlockInfo(core,numInst16,numInst32);
+
+			if (isTaken) {
+				analytics.updateBranchInfo(core,1,0);
+				currentAddress[core] = bb->termTarget;
+			}
+			else {
+				analytics.updateBranchInfo(core,0,1);
+				currentAddress[core] = bb->termAddr + bb->termSize / 8;
+			}
+		}
+	}
+}
+
+void Trace::resetBlocks()
+{
+	for (int i = 0; i < DQR_MAXCORES; i++) {
+		blocks[i].numInstructions = 0;
+	}
+
+	numReadyBlocks = 0;
+}
+
+// Add retired instructions [start,end) to the block being built for core. A gap in the addresses
+// ends the block before them; endsBlock ends it after them
+
+void Trace::addToBlock(int core,TraceDqr::ADDRESS start,TraceDqr::ADDRESS end,int numInsts,int crFlag,int brFlags,bool endsBlock)
+{
+	InstructionBlock &b = blocks[core];
+
+	if ((b.numInstructions > 0) && (b.endAddress != start)) {
+		readyBlocks[numReadyBlocks] = b;
+		numReadyBlocks += 1;
+
+		b.numInstructions = 0;
+	}
+
+	if (b.numInstructions == 0) {
+		b.coreId = core;
+		b.startAddress = start;
+		b.CRFlag = TraceDqr::isNone;
+		b.brFlags = TraceDqr::BRFLAG_none;
+		b.timestamp = lastTime[core];
+	}
+
+	b.endAddress = end;
+	b.numInstructions += numInsts;
+
+	if (endsBlock) {
+		b.CRFlag = crFlag;
+		b.brFlags = brFlags;
+
+		readyBlocks[numReadyBlocks] = b;
+		numReadyBlocks += 1;
+
+		b.numInstructions = 0;
+	}
+}
+
+TraceDqr::DQErr Trace::NextBlock(InstructionBlock *blockInfo)
+{
+	if (blockInfo == nullptr) {
+		printf("Error: Trace::NextBlock(): Argument blockInfo is null\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	TraceDqr::DQErr rc = TraceDqr::DQERR_OK;
+
+	// no instruction or source records are asked for, so NextInstruction() does no disassembly or
+	// source lookups, and retires straight-line code a basic block at a time
+
+	blockMode = true;
+
+	while ((numReadyBlocks == 0) && (rc == TraceDqr::DQERR_OK)) {
+		NexusMessage *msgInfo;
+
+		rc = NextInstruction(nullptr,&msgInfo,nullptr);
+	}
+
+	blockMode = false;
+
+	if (numReadyBlocks > 0) {
+		*blockInfo = readyBlocks[0];
+
+		numReadyBlocks -= 1;
+		if (numReadyBlocks > 0) {
+			readyBlocks[0] = readyBlocks[1];
+		}
+
+		return TraceDqr::DQERR_OK;
+	}
+
+	// at the end of the trace, return what is left of each core's block
+
+	if (rc == TraceDqr::DQERR_EOF) {
+		for (int i = 0; i < DQR_MAXCORES; i++) {
+			if (blocks[i].numInstructions > 0) {
+				*blockInfo = blocks[i];
+				blocks[i].numInstructions = 0;
+
+				return TraceDqr::DQERR_OK;
+			}
+		}
+	}
+
+	return rc;
+}
+
+TraceDqr::DQErr Trace::NextMessage(NexusMessage *msgInfo,int *flags)
+{
+	TraceDqr::DQErr ec;
+
+	NexusMessage *msgInfop = nullptr;
+
+	ec = NextMessage(&msgInfop);
+
+	*flags = 0;
+
+	if (ec == TraceDqr::DQERR_OK) {
+		if ((msgInfo != nullptr) && (msgInfop != nullptr)) {
+			*msgInfo = *msgInfop;
+			*flags |= TraceDqr::TRACE_HAVE_MSGINFO;
+		}
+
+		if (itcPrint != nullptr) {
+			if (itcPrint->haveITCPrintMsgs() != false) {
+				*flags |= TraceDqr::TRACE_HAVE_ITCPRINTINFO;
+			}
+		}
+	}
+
+	return ec;
+}
+
+// parse only: only the message fields are used to track time and address, so no elf file is needed and
+// each message costs one parse. *msgInfo is left null for messages consumed as itc prints
+
+TraceDqr::DQErr Trace::NextMessage(NexusMessage **msgInfo)
+{
+	if (sfp == nullptr) {
+		printf("Error: Trace::NextMessage(): Null sfp object\n");
+
+		status = TraceDqr::DQERR_ERR;
+		return status;
+	}
+
+	if (msgInfo == nullptr) {
+		printf("Error: Trace::NextMessage(): Argument msgInfo is null\n");
+
+		return TraceDqr::DQERR_ERR;
+	}
+
+	*msgInfo = nullptr;
+
+	if (status != TraceDqr::DQERR_OK) {
+		return status;
+	}
+
+	analytics.setParseOnly(true);
+
+	for (;;) {
+		TraceDqr::DQErr rc;
+		TraceDqr::ADDRESS addr;
+		bool haveMsg;
+
+		rc = readNextTraceMsg(haveMsg);
+		if (rc != TraceDqr::DQERR_OK) {
+			status = rc;
+
+			if (status != TraceDqr::DQERR_EOF) {
+				printf("Error: Trace file does not contain any trace messages, or is unreadable\n");
+			}
+
+			return status;
+		}
+
+		if (haveMsg == false) {
+			if (wouldBlock && (msgsPushed || sfp->isStarved())) {
+				return TraceDqr::DQERR_WOULDBLOCK;
+			}
+
+			return status;
+		}
+
+		currentCore = nm.coreId;
+
+		switch (nm.tcode) {
+		case TraceDqr::TCODE_SYNC:
+		case TraceDqr::TCODE_DIRECT_BRANCH_WS:
+		case TraceDqr::TCODE_INDIRECT_BRANCH_WS:
+		case TraceDqr::TCODE_INDIRECTBRANCHHISTORY_WS:
+		case TraceDqr::TCODE_INCIRCUITTRACE_WS:
+			if (nm.haveTimestamp) {
+				lastTime[currentCore] = processTS(TraceDqr::TS_full,lastTime[currentCore],nm.timestamp);
+			}
+
+			addr = nm.getF_Addr();
+			if (addr != (TraceDqr::ADDRESS)-1) {
+				lastFaddr[currentCore] = addr << 1;
+				currentAddress[currentCore] = lastFaddr[currentCore];
+			}
 			break;
-		case TraceDqr::INST_BEQ:
-		case TraceDqr::INST_BNE:
-		case TraceDqr::INST_BLT:
-		case TraceDqr::INST_BGE:
-		case TraceDqr::INST_BLTU:
-		case TraceDqr::INST_BGEU:
-		case TraceDqr::INST_C_BEQZ:
-		case TraceDqr::INST_C_BNEZ:
-			brFlag = TraceDqr::BRFLAG_taken;
+		case TraceDqr::TCODE_INDIRECT_BRANCH:
+		case TraceDqr::TCODE_INDIRECTBRANCHHISTORY:
+		case TraceDqr::TCODE_INCIRCUITTRACE:
+			if (nm.haveTimestamp) {
+				lastTime[currentCore] = processTS(TraceDqr::TS_rel,lastTime[currentCore],nm.timestamp);
+			}
+
+			addr = nm.getU_Addr();
+			if (addr != (TraceDqr::ADDRESS)-1) {
+				lastFaddr[currentCore] = lastFaddr[currentCore] ^ (addr << 1);
+				currentAddress[currentCore] = lastFaddr[currentCore];
+			}
+			break;
+		case TraceDqr::TCODE_ERROR:
+			if (nm.haveTimestamp) {
+				lastTime[currentCore] = processTS(TraceDqr::TS_rel,lastTime[currentCore],nm.timestamp);
+			}
+
+			// messages were dropped, so the address is not known until the next sync
+
+			lastFaddr[currentCore] = 0;
+			currentAddress[currentCore] = 0;
 			break;
 		default:
+			if (nm.haveTimestamp) {
+				lastTime[currentCore] = processTS(TraceDqr::TS_rel,lastTime[currentCore],nm.timestamp);
+			}
 			break;
 		}
-		break;
-	case TraceDqr::ICT_EXCEPTION:
-		crFlag = TraceDqr::isException;
-		break;
-	case TraceDqr::ICT_INTERRUPT:
-		crFlag = TraceDqr::isInterrupt;
-		break;
-	case TraceDqr::ICT_CONTEXT:
-		crFlag = TraceDqr::isSwap;
-		break;
-	default:
-		printf("Error: getCRBRFlags(): Invalid crsrc\n");
 
-		status = TraceDqr::DQERR_ERR;
-		return TraceDqr::DQERR_ERR;
+		messageInfo = nm;
+
+		messageInfo.currentAddress = currentAddress[currentCore];
+		messageInfo.time = lastTime[currentCore];
+
+		if (messageInfo.processITCPrintData(itcPrint) == false) {
+			*msgInfo = &messageInfo;
+		}
+
+		return TraceDqr::DQERR_OK;
+	}
+}
+
+// next trace message into nm, from the trace file or from pushTraceMsg(). haveMsg is false when a live
+// or pushed trace has no complete message yet
+
+TraceDqr::DQErr Trace::readNextTraceMsg(bool &haveMsg)
+{
+	if (msgsPushed == false) {
+		return sfp->readNextTraceMsg(nm,analytics,haveMsg);
+	}
+
+	haveMsg = false;
+
+	if (pushedMsg != nullptr) {
+		nm = *pushedMsg;
+		pushedMsg = nullptr;
+
+		haveMsg = true;
+	}
+	else if (pushedMsgsEnd) {
+		return TraceDqr::DQERR_EOF;
 	}
 
 	return TraceDqr::DQERR_OK;
 }
 
-// Note: This next instruction only computes nextAddr for inferable calls. It does set the crFlag
-// correctly for others.
+// if set see if HTM trace message, switch to HTM mode. Errors on messages the decoder does not support
 
-TraceDqr::DQErr Trace::nextAddr(TraceDqr::ADDRESS addr,TraceDqr::ADDRESS &nextAddr,int &crFlag)
+TraceDqr::DQErr Trace::updateTraceType()
 {
-	int rc;
-	TraceDqr::DQErr ec;
-	uint32_t inst;
-	int inst_size;
-	TraceDqr::InstType inst_type;
-	int32_t immediate;
-	bool isBranch;
-	TraceDqr::Reg rs1;
-	TraceDqr::Reg rd;
+	if (traceType == TraceDqr::TRACETYPE_HTM) {
+		return TraceDqr::DQERR_OK;
+	}
 
-	ec = elfReader->getInstructionByAddress(addr,inst);
-	if (ec != TraceDqr::DQERR_OK) {
-		printf("Error: nextAddr() failed\n");
+	switch (nm.tcode) {
+	case TraceDqr::TCODE_OWNERSHIP_TRACE:
+	case TraceDqr::TCODE_DIRECT_BRANCH:
+	case TraceDqr::TCODE_INDIRECT_BRANCH:
+	case TraceDqr::TCODE_DATA_ACQUISITION:
+	case TraceDqr::TCODE_ERROR:
+	case TraceDqr::TCODE_SYNC:
+	case TraceDqr::TCODE_DIRECT_BRANCH_WS:
+	case TraceDqr::TCODE_INDIRECT_BRANCH_WS:
+	case TraceDqr::TCODE_AUXACCESS_WRITE:
+	case TraceDqr::TCODE_INCIRCUITTRACE:
+	case TraceDqr::TCODE_INCIRCUITTRACE_WS:
+		break;
+	case TraceDqr::TCODE_CORRELATION:
+		if (nm.correlation.cdf == 1) {
+			traceType = TraceDqr::TRACETYPE_HTM;
+			if (globalDebugFlag) printf("TCODE_CORRELATION, cdf == 1: switching to HTM mode\n");
+		}
+		break;
+	case TraceDqr::TCODE_RESOURCEFULL:
+	case TraceDqr::TCODE_INDIRECTBRANCHHISTORY:
+	case TraceDqr::TCODE_INDIRECTBRANCHHISTORY_WS:
+		traceType = TraceDqr::TRACETYPE_HTM;
+		if (globalDebugFlag) printf("History/taken/not taken count TCODE: switching to HTM mode\n");
+		break;
+	case TraceDqr::TCODE_REPEATBRANCH:
+	case TraceDqr::TCODE_REPEATINSTRUCTION:
+	case TraceDqr::TCODE_REPEATINSTRUCTION_WS:
+	case TraceDqr::TCODE_AUXACCESS_READNEXT:
+	case TraceDqr::TCODE_AUXACCESS_WRITENEXT:
+	case TraceDqr::TCODE_AUXACCESS_RESPONSE:
+	case TraceDqr::TCODE_OUTPUT_PORTREPLACEMENT:
+	case TraceDqr::TCODE_INPUT_PORTREPLACEMENT:
+	case TraceDqr::TCODE_AUXACCESS_READ:
+	case TraceDqr::TCODE_DATA_WRITE_WS:
+	case TraceDqr::TCODE_DATA_READ_WS:
+	case TraceDqr::TCODE_WATCHPOINT:
+	case TraceDqr::TCODE_CORRECTION:
+	case TraceDqr::TCODE_DATA_WRITE:
+	case TraceDqr::TCODE_DATA_READ:
+	case TraceDqr::TCODE_DEBUG_STATUS:
+	case TraceDqr::TCODE_DEVICE_ID:
+		printf("Error: NextInstruction(): Unsupported tcode type (%d)\n",nm.tcode);
+		status = TraceDqr::DQERR_ERR;
+		state[currentCore] = TRACE_STATE_ERROR;
 
-		status = ec;
-		return ec;
-	}
+		return status;
+	case TraceDqr::TCODE_UNDEFINED:
+		printf("Error: NextInstruction(): Undefined tcode type (%d)\n",nm.tcode);
+		status = TraceDqr::DQERR_ERR;
+		state[currentCore] = TRACE_STATE_ERROR;
 
-	//	Need to get the destination of the call, which is in the immediate field
+		return status;
+	}
 
-	crFlag = TraceDqr::isNone;
-	nextAddr = 0;
+	return TraceDqr::DQERR_OK;
+}
 
-	rc = decodeInstruction(inst,inst_size,inst_type,rs1,rd,immediate,isBranch);
-	if (rc != 0) {
-		printf("Error: Cann't decode size of instruction %04x\n",inst);
+TraceDqr::DQErr Trace::NextRawMessage(NexusMessage **msgInfo)
+{
+	if (sfp == nullptr) {
+		printf("Error: Trace::NextRawMessage(): Null sfp object\n");
 
 		status = TraceDqr::DQERR_ERR;
-		return TraceDqr::DQERR_ERR;
+		return status;
 	}
 
-	switch (inst_type) {
-	case TraceDqr::INST_JALR:
-		if ((rd == TraceDqr::REG_1) || (rd == TraceDqr::REG_5)) { // rd == link
-			if ((rs1 != TraceDqr::REG_1) && (rs1 != TraceDqr::REG_5)) { // rd == link; rs1 != link
-				crFlag |= TraceDqr::isCall;
-			}
-			else if (rd != rs1) { // rd == link; rs1 == link; rd != rs1
-				crFlag |= TraceDqr::isSwap;
-			}
-			else { // rd == link; rs1 == link; rd == rs1
-				crFlag |= TraceDqr::isCall;
-			}
-		}
-		else if ((rs1 == TraceDqr::REG_1) || (rs1 == TraceDqr::REG_5)) { // rd != link; rs1 == link
-			crFlag |= TraceDqr::isReturn;
-		}
-		break;
-	case TraceDqr::INST_JAL:
-		if ((rd == TraceDqr::REG_1) || (rd == TraceDqr::REG_5)) { // rd == link
-			crFlag = TraceDqr::isCall;
-		}
+	if (msgInfo == nullptr) {
+		printf("Error: Trace::NextRawMessage(): Argument msgInfo is null\n");
 
-		nextAddr = addr + immediate;
-		break;
-	case TraceDqr::INST_C_JAL:
-		if ((rd == TraceDqr::REG_1) || (rd == TraceDqr::REG_5)) { // rd == link
-			crFlag = TraceDqr::isCall;
-		}
+		return TraceDqr::DQERR_ERR;
+	}
 
-		nextAddr = addr + immediate;
-		break;
-	case TraceDqr::INST_C_JR:
-		// pc = pc + rs1
-		// not inferrable unconditional
+	*msgInfo = nullptr;
 
-		if ((rs1 == TraceDqr::REG_1) || (rs1 == TraceDqr::REG_5)) {
-			crFlag |= TraceDqr::isReturn;
-		}
-		break;
-	case TraceDqr::INST_C_JALR:
-		if (rs1 == TraceDqr::REG_5) { // is it reg5 only, or also reg1 like non-compact JALR?
-			crFlag |= TraceDqr::isSwap;
-		}
-		else {
-			crFlag |= TraceDqr::isCall;
-		}
-		break;
-	case TraceDqr::INST_EBREAK:
-	case TraceDqr::INST_ECALL:
-		crFlag = TraceDqr::isException;
-		break;
-	case TraceDqr::INST_MRET:
-	case TraceDqr::INST_SRET:
-	case TraceDqr::INST_URET:
-		crFlag = TraceDqr::isExceptionReturn;
-		break;
-	default:
-		printf("Error: Trace::nextAddr(): Instruction at 0x%08x is not a JAL, JALR, C_JAL, C_JR, C_JALR, EBREAK, ECALL, MRET, SRET, or URET\n",addr);
+	if (status != TraceDqr::DQERR_OK) {
+		return status;
+	}
 
-#ifdef foodog
-		printf("Instruction type: %d\n",inst_type);
+	TraceDqr::DQErr rc;
+	bool haveMsg;
 
-		// disassemble and display instruction
+	rc = readNextTraceMsg(haveMsg);
+	if (rc != TraceDqr::DQERR_OK) {
+		status = rc;
 
-		Disassemble(addr);
+		if (status != TraceDqr::DQERR_EOF) {
+			printf("Error: Trace file does not contain any trace messages, or is unreadable\n");
+		}
 
-		char dst[256];
-		instructionInfo.addressToText(dst,sizeof dst,0);
+		return status;
+	}
 
-		if (instructionInfo.addressLabel != nullptr) {
-			printf("<%s",instructionInfo.addressLabel);
-			if (instructionInfo.addressLabelOffset != 0) {
-				printf("+%x",instructionInfo.addressLabelOffset);
-			}
-			printf(">\n");
+	if (haveMsg == false) {
+		if (wouldBlock && (msgsPushed || sfp->isStarved())) {
+			return TraceDqr::DQERR_WOULDBLOCK;
 		}
 
-		printf("    %s:    ",dst);
+		return status;
+	}
 
-		instructionInfo.instructionToText(dst,sizeof dst,2);
-		printf("  %s\n",dst);
-#endif // foodog
+	currentCore = nm.coreId;
 
-		status = TraceDqr::DQERR_ERR;
-		return TraceDqr::DQERR_ERR;
+	rc = updateTraceType();
+	if (rc != TraceDqr::DQERR_OK) {
+		return rc;
 	}
 
+	*msgInfo = &nm;
+
 	return TraceDqr::DQERR_OK;
 }
 
@@ -6148,6 +7447,7 @@ TraceDqr::DQErr Trace::nextAddr(TraceDqr::ADDRESS addr,TraceDqr::ADDRESS &nextAd
 TraceDqr::DQErr Trace::nextAddr(int core,TraceDqr::ADDRESS addr,TraceDqr::ADDRESS &pc,TraceDqr::TCode tcode,int &crFlag,TraceDqr::BranchFlags &brFlag)
 {
 	TraceDqr::CountType ct;
+	const decodedInst *di;
 	uint32_t inst;
 	int inst_size;
 	TraceDqr::InstType inst_type;
@@ -6158,7 +7458,7 @@ TraceDqr::DQErr Trace::nextAddr(int core,TraceDqr::ADDRESS addr,TraceDqr::ADDRES
 	TraceDqr::Reg rd;
 	bool isTaken;
 
-	status = elfReader->getInstructionByAddress(addr,inst);
+	status = elfReader->getDecodedInstruction(addr,di);
 	if (status != TraceDqr::DQERR_OK) {
 		printf("Error: nextAddr(): getInstructionByAddress() failed\n");
 
@@ -6171,7 +7471,8 @@ TraceDqr::DQErr Trace::nextAddr(int core,TraceDqr::ADDRESS addr,TraceDqr::ADDRES
 	// figure out how big the instruction is
 	// Note: immediate will already be adjusted - don't need to mult by 2 before adding to address
 
-	rc = decodeInstruction(inst,inst_size,inst_type,rs1,rd,immediate,isBranch);
+	inst = di->inst;
+	rc = di->getDecodedFields(inst_size,inst_type,rs1,rd,immediate,isBranch);
 	if (rc != 0) {
 		printf("Error: nextAddr(): Cannot decode instruction %04x\n",inst);
 
@@ -6519,6 +7820,7 @@ TraceDqr::DQErr Trace::nextAddr(int core,TraceDqr::ADDRESS addr,TraceDqr::ADDRES
 
 TraceDqr::DQErr Trace::nextCAAddr(TraceDqr::ADDRESS &addr,TraceDqr::ADDRESS &savedAddr)
 {
+	const decodedInst *di;
 	uint32_t inst;
 	int inst_size;
 	TraceDqr::InstType inst_type;
@@ -6531,7 +7833,7 @@ TraceDqr::DQErr Trace::nextCAAddr(TraceDqr::ADDRESS &addr,TraceDqr::ADDRESS &sav
 
 	// note: since saveAddr is a single address, we are only implementing a one address stack (not much of a stack)
 
-	status = elfReader->getInstructionByAddress(addr,inst);
+	status = elfReader->getDecodedInstruction(addr,di);
 	if (status != TraceDqr::DQERR_OK) {
 		printf("Error: nextCAAddr(): getInstructionByAddress() failed\n");
 
@@ -6541,7 +7843,8 @@ TraceDqr::DQErr Trace::nextCAAddr(TraceDqr::ADDRESS &addr,TraceDqr::ADDRESS &sav
 	// figure out how big the instruction is
 	// Note: immediate will already be adjusted - don't need to mult by 2 before adding to address
 
-	rc = decodeInstruction(inst,inst_size,inst_type,rs1,rd,immediate,isBranch);
+	inst = di->inst;
+	rc = di->getDecodedFields(inst_size,inst_type,rs1,rd,immediate,isBranch);
 	if (rc != 0) {
 		printf("Error: nextCAAddr(): Cannot decode instruction %04x\n",inst);
 
@@ -7176,7 +8479,7 @@ TraceDqr::DQErr Trace::processTraceMessage(NexusMessage &nm,TraceDqr::ADDRESS &p
 
 TraceDqr::DQErr Trace::getInstructionByAddress(TraceDqr::ADDRESS addr, Instruction *instInfo,Source *srcInfo,int *flags)
 {
-	Disassemble(addr); // should error check disassembl() call!
+	Disassemble(addr,instInfo != nullptr,srcInfo != nullptr); // should error check disassembl() call!
 
 	*flags = 0;
 
@@ -7343,7 +8646,7 @@ TraceDqr::DQErr Trace::NextInstruction(Instruction **instInfo, NexusMessage **ms
 		}
 
 		if (readNewTraceMessage != false) {
-			rc = sfp->readNextTraceMsg(nm,analytics,haveMsg);
+			rc = readNextTraceMsg(haveMsg);
 
 			if (rc != TraceDqr::DQERR_OK) {
 				// have an error. either EOF, or error
@@ -7363,69 +8666,19 @@ TraceDqr::DQErr Trace::NextInstruction(Instruction **instInfo, NexusMessage **ms
 			}
 
 			if (haveMsg == false) {
+				if (wouldBlock && (msgsPushed || sfp->isStarved())) {
+					return TraceDqr::DQERR_WOULDBLOCK;
+				}
+
 				return status;
 			}
 
 			readNewTraceMessage = false;
 			currentCore = nm.coreId;
 
-			// if set see if HTM trace message, switch to HTM mode
-
-			if (traceType != TraceDqr::TRACETYPE_HTM) {
-				switch (nm.tcode) {
-				case TraceDqr::TCODE_OWNERSHIP_TRACE:
-				case TraceDqr::TCODE_DIRECT_BRANCH:
-				case TraceDqr::TCODE_INDIRECT_BRANCH:
-				case TraceDqr::TCODE_DATA_ACQUISITION:
-				case TraceDqr::TCODE_ERROR:
-				case TraceDqr::TCODE_SYNC:
-				case TraceDqr::TCODE_DIRECT_BRANCH_WS:
-				case TraceDqr::TCODE_INDIRECT_BRANCH_WS:
-				case TraceDqr::TCODE_AUXACCESS_WRITE:
-				case TraceDqr::TCODE_INCIRCUITTRACE:
-				case TraceDqr::TCODE_INCIRCUITTRACE_WS:
-					break;
-				case TraceDqr::TCODE_CORRELATION:
-					if (nm.correlation.cdf == 1) {
-						traceType = TraceDqr::TRACETYPE_HTM;
-						if (globalDebugFlag) printf("TCODE_CORRELATION, cdf == 1: switching to HTM mode\n");
-					}
-					break;
-				case TraceDqr::TCODE_RESOURCEFULL:
-				case TraceDqr::TCODE_INDIRECTBRANCHHISTORY:
-				case TraceDqr::TCODE_INDIRECTBRANCHHISTORY_WS:
-					traceType = TraceDqr::TRACETYPE_HTM;
-					if (globalDebugFlag) printf("History/taken/not taken count TCODE: switching to HTM mode\n");
-					break;
-				case TraceDqr::TCODE_REPEATBRANCH:
-				case TraceDqr::TCODE_REPEATINSTRUCTION:
-				case TraceDqr::TCODE_REPEATINSTRUCTION_WS:
-				case TraceDqr::TCODE_AUXACCESS_READNEXT:
-				case TraceDqr::TCODE_AUXACCESS_WRITENEXT:
-				case TraceDqr::TCODE_AUXACCESS_RESPONSE:
-				case TraceDqr::TCODE_OUTPUT_PORTREPLACEMENT:
-				case TraceDqr::TCODE_INPUT_PORTREPLACEMENT:
-				case TraceDqr::TCODE_AUXACCESS_READ:
-				case TraceDqr::TCODE_DATA_WRITE_WS:
-				case TraceDqr::TCODE_DATA_READ_WS:
-				case TraceDqr::TCODE_WATCHPOINT:
-				case TraceDqr::TCODE_CORRECTION:
-				case TraceDqr::TCODE_DATA_WRITE:
-				case TraceDqr::TCODE_DATA_READ:
-				case TraceDqr::TCODE_DEBUG_STATUS:
-				case TraceDqr::TCODE_DEVICE_ID:
-					printf("Error: NextInstruction(): Unsupported tcode type (%d)\n",nm.tcode);
-					status = TraceDqr::DQERR_ERR;
-					state[currentCore] = TRACE_STATE_ERROR;
-
-					return status;
-				case TraceDqr::TCODE_UNDEFINED:
-					printf("Error: NextInstruction(): Undefined tcode type (%d)\n",nm.tcode);
-					status = TraceDqr::DQERR_ERR;
-					state[currentCore] = TRACE_STATE_ERROR;
-
-					return status;
-				}
+			rc = updateTraceType();
+			if (rc != TraceDqr::DQERR_OK) {
+				return rc;
 			}
 
 			// Check if this is a ICT Control message and if we are filtering them out
@@ -7820,7 +9073,7 @@ TraceDqr::DQErr Trace::NextInstruction(Instruction **instInfo, NexusMessage **ms
 				}
 
 				if (srcInfo != nullptr) {
-					Disassemble(currentAddress[currentCore]);
+					Disassemble(currentAddress[currentCore],false,true);
 
 					sourceInfo.coreId = currentCore;
 					*srcInfo = &sourceInfo;
@@ -7861,7 +9114,7 @@ TraceDqr::DQErr Trace::NextInstruction(Instruction **instInfo, NexusMessage **ms
 						// no dasm or src for ext trigger in HTM instruction traces
 					}
 					else if ((instInfo != nullptr) || (srcInfo != nullptr)) {
-						Disassemble(currentAddress[currentCore]);
+						Disassemble(currentAddress[currentCore],instInfo != nullptr,srcInfo != nullptr);
 
 						if (instInfo != nullptr) {
 							instructionInfo.qDepth = 0;
@@ -8021,7 +9274,7 @@ TraceDqr::DQErr Trace::NextInstruction(Instruction **instInfo, NexusMessage **ms
 					else if ((instInfo != nullptr) || (srcInfo != nullptr)) {
 						addr = currentAddress[currentCore];
 
-						Disassemble(addr);
+						Disassemble(addr,instInfo != nullptr,srcInfo != nullptr);
 
 						if (instInfo != nullptr) {
 							instructionInfo.qDepth = 0;
@@ -8191,7 +9444,7 @@ TraceDqr::DQErr Trace::NextInstruction(Instruction **instInfo, NexusMessage **ms
 				}
 
 				if ((srcInfo != nullptr) && (*srcInfo == nullptr)) {
-					Disassemble(currentAddress[currentCore]);
+					Disassemble(currentAddress[currentCore],false,true);
 
 					sourceInfo.coreId = currentCore;
 					*srcInfo = &sourceInfo;
@@ -8362,7 +9615,7 @@ TraceDqr::DQErr Trace::NextInstruction(Instruction **instInfo, NexusMessage **ms
 					else if ((instInfo != nullptr) || (srcInfo != nullptr)) {
 						addr = currentAddress[currentCore];
 
-						Disassemble(addr);
+						Disassemble(addr,instInfo != nullptr,srcInfo != nullptr);
 
 						if (instInfo != nullptr) {
 							instructionInfo.qDepth = 0;
@@ -8492,8 +9745,36 @@ TraceDqr::DQErr Trace::NextInstruction(Instruction **instInfo, NexusMessage **ms
 			// Should always be able to process instruction at addr and compute next addr when we get here.
 			// After processing next addr, if there are no more counts, retire trace message and get another
 
+			// If the caller does not want instruction or source records, retire the straight-line part of
+			// the basic block at once, as long as the i-cnt runs past it. Only i-cnts are consumed by those
+			// instructions, so this is the same as stepping through them. For htm, first follow the
+			// conditional branches that the history bits cover
+
+			if ((instInfo == nullptr) && (srcInfo == nullptr) && (caTrace == nullptr) &&
+			    (counts->getCurrentCountType(currentCore) != TraceDqr::COUNTTYPE_none)) {
+				BasicBlock *bb;
+
+				if ((blockMode == false) && (traceType == TraceDqr::TRACETYPE_HTM) &&
+				    (counts->getCurrentCountType(currentCore) == TraceDqr::COUNTTYPE_history)) {
+					retireHistoryBlocks(currentCore);
+				}
+
+				bb = getBasicBlock(currentAddress[currentCore]);
+				if ((bb != nullptr) && (bb->length > 0) && (counts->getICnt(currentCore) > bb->length)) {
+					counts->consumeICnt(currentCore,bb->length);
+					analytics.updateBlockInfo(currentCore,bb->numInst16,bb->numInst32);
+
+					if (blockMode) {
+						addToBlock(currentCore,bb->startAddr,bb->termAddr,bb->numInst16 + bb->numInst32,TraceDqr::isNone,TraceDqr::BRFLAG_none,false);
+					}
+
+					currentAddress[currentCore] = bb->termAddr;
+				}
+			}
+
 			addr = currentAddress[currentCore];
 
+			const decodedInst *di;
 			uint32_t inst;
 			int inst_size;
 			TraceDqr::InstType inst_type;
@@ -8503,10 +9784,10 @@ TraceDqr::DQErr Trace::NextInstruction(Instruction **instInfo, NexusMessage **ms
 			TraceDqr::Reg rs1;
 			TraceDqr::Reg rd;
 
-			// getInstrucitonByAddress() should cache last instrucioton/address because I thjink
-			// it gets called a couple times for each address/insruction in a row
+			// each address is only decoded once; after that the decoded instruction comes from the
+			// elf reader's table
 
-			status = elfReader->getInstructionByAddress(addr,inst);
+			status = elfReader->getDecodedInstruction(addr,di);
 			if (status != TraceDqr::DQERR_OK) {
 				printf("Error: getInstructionByAddress failed\n");
 
@@ -8517,10 +9798,8 @@ TraceDqr::DQErr Trace::NextInstruction(Instruction **instInfo, NexusMessage **ms
 
 			// figure out how big the instruction is
 
-//			decode instruction/decode instruction size should cache their results (at least last one)
-//			because it gets called a few times here!
-
-			rc = decodeInstruction(inst,inst_size,inst_type,rs1,rd,immediate,isBranch);
+			inst = di->inst;
+			rc = di->getDecodedFields(inst_size,inst_type,rs1,rd,immediate,isBranch);
 			if (rc != 0) {
 				printf("Error: Cann't decode size of instruction %04x\n",inst);
 
@@ -8530,7 +9809,9 @@ TraceDqr::DQErr Trace::NextInstruction(Instruction **instInfo, NexusMessage **ms
 				return status;
 			}
 
-			Disassemble(addr);
+			if ((instInfo != nullptr) || (srcInfo != nullptr) || (caTrace != nullptr)) {
+				Disassemble(addr,(instInfo != nullptr) || (caTrace != nullptr),srcInfo != nullptr);
+			}
 
 			// compute next address (retire this instruction)
 
@@ -8600,6 +9881,15 @@ TraceDqr::DQErr Trace::NextInstruction(Instruction **instInfo, NexusMessage **ms
 				}
 			}
 
+			if (blockMode) {
+				TraceDqr::ADDRESS instAddr = currentAddress[currentCore];
+
+				addToBlock(currentCore,instAddr,instAddr + inst_size/8,1,crFlag | enterISR[currentCore],brFlags,
+				           (addr != instAddr + inst_size/8) || (crFlag != TraceDqr::isNone) || (brFlags != TraceDqr::BRFLAG_none));
+
+				enterISR[currentCore] = TraceDqr::isNone;
+			}
+
 			currentAddress[currentCore] = addr;
 
 			uint32_t prevCycle;